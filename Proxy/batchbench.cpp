@@ -0,0 +1,320 @@
+/*
+   Benchmark for DynamicsBatch: checks that a batch gives the same results as
+   separate QuadXBFDynamics instances, in flight and through takeoffs and
+   landings, then reports vehicle-steps per second for batch sizes from 1 to
+   100k
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../Source/MultiSim/dynamics/Batch.hpp"
+#include "../Source/MultiSim/dynamics/fixedpitch/QuadXBF.hpp"
+
+// Time constant
+static const double DELTA_T = 0.001;
+
+// Total vehicle-steps per timing run
+static const uint32_t WORK = 20000000;
+
+static Dynamics::vehicle_params_t vparams = {
+
+    // Estimated
+    2.E-06, // d torque constant [T=d*w^2]
+
+    // https://www.dji.com/phantom-4/info
+    1.380,  // m mass [kg]
+
+    // Estimated
+    2,      // Ix [kg*m^2]
+    2,      // Iy [kg*m^2]
+    3,      // Iz [kg*m^2]
+    38E-04, // Jr prop inertial [kg*m^2]
+
+    15000,  // maxrpm
+
+    20      // maxspeed [m/s]
+};
+
+static FixedPitchDynamics::fixed_pitch_params_t fparams = {
+
+    // Estimated
+    5.E-06, // b force constatnt [F=b*w^2]
+    0.350   // l arm length [m]
+};
+
+// Cheap, reproducible motor values around hover
+static void makeActuators(std::vector<float> & actuators, uint32_t & seed)
+{
+    for (auto & a : actuators) {
+        seed = seed * 1664525 + 1013904223;
+        a = 0.45f + 0.1f * (seed >> 8) / (float)(1 << 24);
+    }
+}
+
+static DynamicsBatch * makeBatch(const uint32_t count)
+{
+    auto batch = new DynamicsBatch(count, 4,
+            RotorLayout::QUAD_X_BF,
+            vparams, fparams, false); // no auto-land
+
+    const double rotation[3] = {0, 0, 0};
+    batch->init(rotation);
+
+    // Set AGL to arbitrary positive value to avoid kinematic trick
+    for (uint32_t k=0; k<count; ++k) {
+        batch->setAgl(k, 1);
+    }
+
+    return batch;
+}
+
+static void makeSingles(
+        std::vector<QuadXBFDynamics> & singles, const uint32_t count)
+{
+    const double rotation[3] = {0, 0, 0};
+
+    singles.reserve(count);
+
+    for (uint32_t k=0; k<count; ++k) {
+        singles.emplace_back(vparams, fparams, false);
+        singles[k].init(rotation);
+        singles[k].setAgl(1);
+    }
+}
+
+static void updateSingles(
+        std::vector<QuadXBFDynamics> & singles,
+        const std::vector<float> & actuators)
+{
+    const auto count = singles.size();
+
+    for (uint32_t k=0; k<count; ++k) {
+
+        const float motors[4] = {
+            actuators[k],
+            actuators[count + k],
+            actuators[2 * count + k],
+            actuators[3 * count + k]
+        };
+
+        singles[k].update(motors, DELTA_T);
+    }
+}
+
+static uint32_t compare(
+        DynamicsBatch & batch, std::vector<QuadXBFDynamics> & singles)
+{
+    uint32_t mismatches = 0;
+
+    for (uint32_t k=0; k<batch.count(); ++k) {
+
+        auto & s = singles[k];
+
+        mismatches +=
+            batch.getStateX(k) != s.getStateX() ||
+            batch.getStateDx(k) != s.getStateDx() ||
+            batch.getStateY(k) != s.getStateY() ||
+            batch.getStateDy(k) != s.getStateDy() ||
+            batch.getStateZ(k) != s.getStateZ() ||
+            batch.getStateDz(k) != s.getStateDz() ||
+            batch.getStatePhi(k) != s.getStatePhi() ||
+            batch.getStateDphi(k) != s.getStateDphi() ||
+            batch.getStateTheta(k) != s.getStateTheta() ||
+            batch.getStateDtheta(k) != s.getStateDtheta() ||
+            batch.getStatePsi(k) != s.getStatePsi() ||
+            batch.getStateDpsi(k) != s.getStateDpsi();
+    }
+
+    return mismatches;
+}
+
+// Motor lag for the second equivalence check
+static Dynamics::motor_params_t mparams = {
+
+    0.02,  // time constant [s]
+    20,    // max spin-up per second
+    10     // max spin-down per second
+};
+
+static bool checkEquivalence(
+        const uint32_t count, const uint32_t steps, const bool motorModel)
+{
+    auto batch = makeBatch(count);
+
+    std::vector<QuadXBFDynamics> singles;
+    makeSingles(singles, count);
+
+    if (motorModel) {
+        batch->setMotorModel(mparams);
+        for (auto & single : singles) {
+            single.setMotorModel(mparams);
+        }
+    }
+
+    std::vector<float> actuators(4 * count);
+    uint32_t seed = 1;
+
+    for (uint32_t j=0; j<steps; ++j) {
+        makeActuators(actuators, seed);
+        batch->update(actuators.data(), DELTA_T);
+        updateSingles(singles, actuators);
+    }
+
+    const auto mismatches = compare(*batch, singles);
+
+    printf("Equivalence%s: %u vehicles x %u steps: %u mismatched vehicles "
+            "(z=%+3.3f)\n",
+            motorModel ? " with motor lag" : "",
+            count, steps, mismatches, batch->getStateZ(0));
+
+    delete batch;
+
+    return mismatches == 0;
+}
+
+static double seconds(
+        const std::chrono::steady_clock::time_point & start)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchmark(const uint32_t count)
+{
+    const uint32_t steps = WORK / count < 20 ? 20 : WORK / count;
+
+    std::vector<float> actuators(4 * count);
+    uint32_t seed = 1;
+    makeActuators(actuators, seed);
+
+    auto batch = makeBatch(count);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t j=0; j<steps; ++j) {
+        batch->update(actuators.data(), DELTA_T);
+    }
+    const auto batchTime = seconds(start);
+    delete batch;
+
+    std::vector<QuadXBFDynamics> singles;
+    makeSingles(singles, count);
+    start = std::chrono::steady_clock::now();
+    for (uint32_t j=0; j<steps; ++j) {
+        updateSingles(singles, actuators);
+    }
+    const auto singleTime = seconds(start);
+
+    const double work = (double)count * steps;
+
+    printf("%8u  %12.3e  %12.3e  %6.2fx\n",
+            count,
+            work / batchTime,
+            work / singleTime,
+            singleTime / batchTime);
+}
+
+// Vehicles start on the ground at zero AGL, with autoland on, and alternate
+// between climbing and falling back to the ground, each on its own cycle.
+// State and ground contact are compared after every step, so every takeoff,
+// landing, and autoland step is covered.
+static bool checkLandings(const uint32_t count, const uint32_t steps)
+{
+    const double rotation[3] = {0, 0, 0};
+
+    auto batch = new DynamicsBatch(count, 4, RotorLayout::QUAD_X_BF,
+            vparams, fparams, true);
+
+    batch->init(rotation);
+
+    std::vector<QuadXBFDynamics> singles;
+    singles.reserve(count);
+
+    for (uint32_t k=0; k<count; ++k) {
+        singles.emplace_back(vparams, fparams, true);
+        singles[k].init(rotation);
+    }
+
+    std::vector<float> actuators(4 * count);
+    uint32_t seed = 1;
+
+    uint32_t mismatches = 0;
+    uint32_t takeoffs = 0;
+    uint32_t landings = 0;
+
+    for (uint32_t j=0; j<steps; ++j) {
+
+        makeActuators(actuators, seed);
+
+        for (uint32_t k=0; k<count; ++k) {
+
+            const uint32_t cycle = 2000 + 10 * (k % 50);
+
+            // Climb for the first quarter of the cycle, then fall
+            const float offset = j % cycle < cycle / 4 ? 0.1f : -0.2f;
+
+            for (uint8_t i=0; i<4; ++i) {
+                actuators[i * count + k] += offset;
+            }
+
+            // Ground is at z = 0
+            batch->setAgl(k, batch->getStateZ(k));
+            singles[k].setAgl(singles[k].getStateZ());
+        }
+
+        std::vector<bool> wasAirborne(count);
+
+        for (uint32_t k=0; k<count; ++k) {
+            wasAirborne[k] = batch->snapshot(k).airborne;
+        }
+
+        batch->update(actuators.data(), DELTA_T);
+        updateSingles(singles, actuators);
+
+        uint32_t stepMismatches = compare(*batch, singles);
+
+        for (uint32_t k=0; k<count; ++k) {
+
+            const bool airborne = batch->snapshot(k).airborne;
+
+            stepMismatches += airborne != singles[k].snapshot().airborne;
+
+            takeoffs += airborne && !wasAirborne[k];
+            landings += !airborne && wasAirborne[k];
+        }
+
+        mismatches =
+            stepMismatches > mismatches ? stepMismatches : mismatches;
+    }
+
+    printf("Equivalence through %u takeoffs and %u landings: "
+            "%u vehicles x %u steps: %u mismatched vehicles\n",
+            takeoffs, landings, count, steps, mismatches);
+
+    delete batch;
+
+    return mismatches == 0 && takeoffs > 0 && landings > 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if (!checkEquivalence(1000, 2000, false) ||
+            !checkEquivalence(1000, 2000, true) ||
+            !checkLandings(200, 6000)) {
+        return 1;
+    }
+
+    printf("\nvehicles  batch veh/sec  single veh/sec  speedup\n");
+
+    for (uint32_t count=1; count<=100000; count*=10) {
+        benchmark(count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+   Reference receiver for the simulator's camera stream
+
+   Accepts the camera's connection on the image port, reads each frame's
+   header and pixels (see sockets/ImageStream.hpp for the layout), and
+   reports frame rate, throughput, capture-to-receipt latency and frames
+   lost once a second, until the simulator disconnects.
+
+   Usage: camproxy [PORT [FILE]]
+
+   PORT may instead be unix:PATH, to listen on a Unix-domain socket at PATH
+   for a simulator run with MULTISIM_IMAGE_HOST=unix:PATH.
+
+   With FILE, the latest frame is also written there each second, as a PPM
+   image (PGM for grayscale).
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "../Source/MultiSim/sockets/ImageStream.hpp"
+#include "../Source/MultiSim/sockets/TcpServerSocket.hpp"
+
+static const char * HOST = "127.0.0.1";
+
+static const uint16_t IMAGE_PORT = 5002;
+
+static void writeImage(
+        const char * filename,
+        const ImageStream::header_t & header,
+        const std::vector<uint8_t> & pixels)
+{
+    FILE * fp = fopen(filename, "wb");
+
+    if (!fp) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        return;
+    }
+
+    const auto gray = header.format == ImageStream::PIXEL_GRAY8;
+
+    fprintf(fp, "P%c\n%u %u\n255\n", gray ? '5' : '6',
+            header.width, header.height);
+
+    std::vector<uint8_t> row(header.width * 3);
+
+    for (uint16_t j=0; j<header.height; ++j) {
+
+        const auto in = &pixels[j * header.stride];
+
+        if (gray) {
+            fwrite(in, 1, header.width, fp);
+            continue;
+        }
+
+        // Reorder BGRA or RGBA to RGB
+        const auto bgra = header.format == ImageStream::PIXEL_BGRA8;
+
+        for (uint16_t k=0; k<header.width; ++k) {
+            row[3*k]   = in[4*k + (bgra ? 2 : 0)];
+            row[3*k+1] = in[4*k + 1];
+            row[3*k+2] = in[4*k + (bgra ? 0 : 2)];
+        }
+
+        fwrite(&row[0], 1, row.size(), fp);
+    }
+
+    fclose(fp);
+}
+
+int main(int argc, char ** argv)
+{
+    const auto isUnix = argc > 1 && !strncmp(argv[1], "unix:", 5);
+
+    const char * host = isUnix ? argv[1] : HOST;
+
+    const uint16_t port = argc > 1 && !isUnix ? atoi(argv[1]) : IMAGE_PORT;
+
+    const char * filename = argc > 2 ? argv[2] : NULL;
+
+    TcpServerSocket server = TcpServerSocket(host, port);
+
+    if (*server.getMessage()) {
+        fprintf(stderr, "%s\n", server.getMessage());
+        return 1;
+    }
+
+    if (isUnix) {
+        printf("Waiting for camera on %s\n", host + 5);
+    }
+    else {
+        printf("Waiting for camera on port %d\n", port);
+    }
+
+    if (!server.acceptConnection()) {
+        fprintf(stderr, "%s\n", server.getMessage());
+        return 1;
+    }
+
+    std::vector<uint8_t> pixels;
+
+    // Latest frame id from each camera, to spot gaps
+    uint32_t lastFrame[256] = {};
+
+    uint64_t totalFrames = 0;
+    uint64_t totalLost = 0;
+
+    // This second's figures
+    uint32_t frames = 0;
+    uint32_t lost = 0;
+    uint64_t bytes = 0;
+    double latencySum = 0;
+    double latencyMax = 0;
+
+    auto windowStart = ImageStream::wallNow();
+
+    while (true) {
+
+        ImageStream::header_t header = {};
+
+        if (!server.receiveData(&header, sizeof(header))) {
+            break;
+        }
+
+        // Without a good header there is no finding the next frame
+        if (!ImageStream::check(header)) {
+            fprintf(stderr, "Bad frame header; giving up\n");
+            break;
+        }
+
+        pixels.resize(header.size);
+
+        if (header.size > 0 && !server.receiveData(&pixels[0], header.size)) {
+            break;
+        }
+
+        const auto now = ImageStream::wallNow();
+
+        auto & last = lastFrame[header.camera];
+
+        if (last && header.frame > last + 1) {
+            lost += header.frame - last - 1;
+        }
+
+        last = header.frame;
+
+        // Clocks agree on one host; across hosts this is only as good as
+        // their synchronization
+        const auto latency = ((int64_t)(now - header.timestamp)) / 1e6;
+
+        latencySum += latency;
+        latencyMax = latency > latencyMax ? latency : latencyMax;
+
+        frames++;
+        bytes += sizeof(header) + header.size;
+
+        const auto elapsed = (now - windowStart) / 1e9;
+
+        if (elapsed >= 1) {
+
+            printf("camera %u  %ux%u  %5.1f frames/s  %7.1f MB/s  "
+                    "latency mean %6.2f max %6.2f ms  %u lost\n",
+                    header.camera,
+                    header.width,
+                    header.height,
+                    frames / elapsed,
+                    bytes / elapsed / 1e6,
+                    latencySum / frames,
+                    latencyMax,
+                    lost);
+
+            if (filename) {
+                writeImage(filename, header, pixels);
+            }
+
+            totalFrames += frames;
+            totalLost += lost;
+
+            frames = 0;
+            lost = 0;
+            bytes = 0;
+            latencySum = 0;
+            latencyMax = 0;
+
+            windowStart = now;
+        }
+    }
+
+    printf("Camera disconnected after %llu frames, %llu lost\n",
+            (unsigned long long)(totalFrames + frames),
+            (unsigned long long)(totalLost + lost));
+
+    server.closeConnection();
+
+    if (isUnix) {
+        unlink(host + 5);
+    }
+
+    return 0;
+}
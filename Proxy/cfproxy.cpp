@@ -4,16 +4,20 @@
    Just lifts off to 40cm after enough throttle is applied; no
    other control.
 
+   Serves any number of clients at once, each flying its own vehicle,
+   sleeping until one of them sends something.
+
    Copyright(C) 2023 Simon D.Levy
 
    MIT License
  */
 
-#include <stdio.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdint.h>
 
-#include "../Source/MultiSim/sockets/TcpServerSocket.hpp"
+#include "../Source/MultiSim/sockets/EventLoop.hpp"
+#include "../Source/MultiSim/sockets/TcpEndpoint.hpp"
 #include "../Source/MultiSim/dynamics/fixedpitch/QuadXBF.hpp"
 
 // Comms
@@ -23,6 +27,9 @@ static const uint16_t  PORT = 5000;
 // Time constant
 static const double DELTA_T = 0.001;
 
+// Seconds between status reports
+static const double REPORT_PERIOD = 1;
+
 // Throttle threshold for liftoff
 static const float THROTTLE_THRESHOLD = 0.5;
 
@@ -46,7 +53,9 @@ static Dynamics::vehicle_params_t vparams = {
     3,      // Iz [kg*m^2] 
     38E-04, // Jr prop inertial [kg*m^2] 
 
-    15000 // maxrpm
+    15000,  // maxrpm
+
+    20      // maxspeed [m/s]
 };
 
 static FixedPitchDynamics::fixed_pitch_params_t fparams = {
@@ -61,93 +70,197 @@ static float constrain(const float val, const float min, const float max)
     return val < min ? min : val > max ? max : val;
 }
 
-// Altitude PI controller
-static float getThrottle(const double z, const double dz)
-{
-    const auto error = (Z_TARGET - z) - dz;
-
-    static double errorIntegral;
+// One client's vehicle: sends its pose, then updates it with the client's
+// stick values, forever
+class Session : public TcpConnection {
 
-    errorIntegral = constrain(
-            errorIntegral + error, -K_WINDUP_MAX, +K_WINDUP_MAX);
+    private:
 
-    return constrain(K_P * error + K_I * errorIntegral, 0, 1);
-}
+        uint32_t _id = 0;
 
-int main(int argc, char ** argv)
-{
-    auto server = TcpServerSocket(HOST, PORT, true);
+        QuadXBFDynamics _dynamics =
+            QuadXBFDynamics(vparams, fparams, false); // no auto-land
 
-    // Guards socket comms
-    auto connected = false;
+        bool _airborne = false;
 
-    // Create quadcopter dynamics model
-    auto dynamics = QuadXBFDynamics(vparams, fparams, false); // no auto-land
+        double _errorIntegral = 0;
 
-    // Set up initial conditions
-    const double rotation[3] = {0,0,0};
-    dynamics.init(rotation);
+        float _throttle = 0;
 
-    printf("Listening for client on %s:%d \n", HOST, PORT);
+        // Altitude PI controller
+        float getThrottle(const double z, const double dz)
+        {
+            const auto error = (Z_TARGET - z) - dz;
 
-    // Loop forever, waiting for clients
-    for (uint32_t k=0; ; k++) {
+            _errorIntegral = constrain(
+                    _errorIntegral + error, -K_WINDUP_MAX, +K_WINDUP_MAX);
 
-        if (connected) {
+            return constrain(K_P * error + K_I * _errorIntegral, 0, 1);
+        }
 
-            const auto vstate = dynamics.vstate;
-          
+        void sendPose(void)
+        {
             const double pose[] = {
 
-                vstate.x,
-                vstate.y,
-                -vstate.z, // NED => ENU
-                vstate.phi,
-                vstate.theta,
-                vstate.psi
+                _dynamics.getStateX(),
+                _dynamics.getStateY(),
+                _dynamics.getStateZ(), // ENU
+                _dynamics.getStatePhi(),
+                _dynamics.getStateTheta(),
+                _dynamics.getStatePsi()
             };
 
-            server.sendData((void *)pose, sizeof(pose));
+            send((void *)pose, sizeof(pose));
+        }
+
+    public:
+
+        Session(EventLoop & loop, const socket_t sock, const uint32_t id)
+            : TcpConnection(loop, sock)
+        {
+            _id = id;
+
+            // Set up initial conditions
+            const double rotation[3] = {0,0,0};
+            _dynamics.init(rotation);
 
+            printf("Client %u connected\n", _id);
+
+            sendPose();
+        }
+
+        virtual void onReceive(void) override
+        {
             double joyvals[4] = {};
-            server.receiveData(joyvals, sizeof(joyvals));
 
-            float sticks[4] = {
-                (float)joyvals[0] / 80,
-                (float)joyvals[1] / 31,
-                (float)joyvals[2] / 31,
-                (float)joyvals[3] / 200,
-            };
+            while (read(joyvals, sizeof(joyvals))) {
+
+                float sticks[4] = {
+                    (float)joyvals[0] / 80,
+                    (float)joyvals[1] / 31,
+                    (float)joyvals[2] / 31,
+                    (float)joyvals[3] / 200,
+                };
+
+                if (sticks[0] > THROTTLE_THRESHOLD) {
+                    _airborne = true;
+                }
+
+                _throttle = _airborne ?
+                    getThrottle(_dynamics.getStateZ(),
+                            _dynamics.getStateDz()) :
+                    0;
 
-            static bool airborne;
+                // Set all motors to same value for now
+                const float motors[4] = {
+                    _throttle, _throttle, _throttle, _throttle};
 
-            if (sticks[0] > THROTTLE_THRESHOLD) {
-                airborne = true;
+                // Update dynamics with motor values
+                _dynamics.update(motors, DELTA_T);
+
+                // Set AGL to arbitrary positive value to avoid kinematic
+                // trick
+                _dynamics.setAgl(1);
+
+                sendPose();
             }
+        }
+
+        virtual void onClose(void) override
+        {
+            printf("Client %u disconnected\n", _id);
+        }
+
+        void report(void)
+        {
+            printf("client %u: throttle=%3.3f  altitude=%3.3f\n",
+                    _id, _throttle, _dynamics.getStateZ());
+        }
 
-            const auto throttle = airborne ? 
-                getThrottle(-vstate.z, -vstate.dz) : 
-                0;
+}; // class Session
 
-            printf("throttle=%3.3f  altitude=%3.3f\n", throttle, -vstate.z);
-            
-            // Set all motors to same value for now
-            const float motors[4] = {throttle, throttle, throttle, throttle};
+class Server : public TcpListener {
 
-            // Update dynamics with motor values
-            dynamics.update(motors, DELTA_T);
+    private:
 
-            // Set AGL to arbitrary positive value to avoid kinematic trick
-            dynamics.setAgl(1);
+        uint32_t _nextId = 0;
+
+    public:
+
+        Server(EventLoop & loop)
+            : TcpListener(loop, HOST, PORT)
+        {
+        }
+
+        virtual TcpConnection * accepted(EventLoop & loop,
+                const socket_t sock) override
+        {
+            return new Session(loop, sock, ++_nextId);
         }
 
-        else {
+}; // class Server
+
+// Reports every client's throttle and altitude
+class Reporter : public EventTimer {
+
+    private:
+
+        Server * _server = NULL;
 
-            connected = server.acceptConnection();
+    public:
 
+        Reporter(EventLoop & loop, Server & server)
+            : EventTimer(loop)
+        {
+            _server = &server;
         }
 
-    } // while (true)
+        virtual void onTimer(void) override
+        {
+            for (size_t k=0; k<_server->connectionCount(); ++k) {
+                ((Session *)_server->connection(k))->report();
+            }
+        }
+
+}; // class Reporter
+
+static EventLoop * loop;
+
+static void handleSignal(int signum)
+{
+    (void)signum;
+
+    loop->stop();
+}
+
+int main(int argc, char ** argv)
+{
+    EventLoop eventLoop;
+
+    loop = &eventLoop;
+
+    Server server(eventLoop);
+
+    if (*server.getMessage()) {
+        fprintf(stderr, "%s\n", server.getMessage());
+        return 1;
+    }
+
+    Reporter reporter(eventLoop, server);
+    reporter.start(REPORT_PERIOD);
+
+    // Ctrl-C closes every connection cleanly
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+
+    printf("Listening for clients on %s:%d \n", HOST, PORT);
+
+    eventLoop.run();
+
+    printf("Served %llu clients\n",
+            (unsigned long long)server.acceptedCount());
+
+    server.close();
 
     return 0;
 }
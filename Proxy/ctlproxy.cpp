@@ -0,0 +1,194 @@
+/*
+   Proxy flight controller for testing MulticopterSim telemetry comms
+
+   Holds altitude with a PD controller on the telemetry it receives, over
+   UDP or shared memory, until the simulator halts.
+
+   Usage: ctlproxy [ADDRESS [ALTITUDE [FORMAT [lockstep]]]]
+
+   ADDRESS is the simulator's host (default 127.0.0.1), shm:NAME for the
+   shared-memory segment NAME, or unix:PATH for Unix-domain sockets at
+   PATH.motor and PATH.telem.  FORMAT is raw (the default), wire or wire32,
+   and must match the simulator's.  Give lockstep for a simulator run in
+   lockstep mode with the raw format, to echo the sequence number each
+   telemetry message carries; framed messages carry theirs in the header.
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <thread>
+
+#include "../Source/MultiSim/Telemetry.hpp"
+#include "../Source/MultiSim/Transport.hpp"
+
+// Comms
+static uint16_t  MOTOR_PORT = 5000;
+static uint16_t  TELEM_PORT = 5001;
+
+// PD controller constants
+static const double K_P = 0.5;
+static const double K_D = 0.8;
+static const double HOVER = 0.6;
+
+static float constrain(const float val, const float min, const float max)
+{
+    return val < min ? min : val > max ? max : val;
+}
+
+int main(int argc, char ** argv)
+{
+    const char * address = argc > 1 ? argv[1] : "127.0.0.1";
+
+    const double target = argc > 2 ? atof(argv[2]) : 10;
+
+    auto format = Telemetry::FORMAT_RAW;
+
+    if (argc > 3 && !Telemetry::parseFormat(argv[3], format)) {
+        fprintf(stderr, "Unknown format %s\n", argv[3]);
+        return 1;
+    }
+
+    const auto lockstep = argc > 4 && !strcmp(argv[4], "lockstep");
+
+    if (argc > 4 && !lockstep) {
+        fprintf(stderr, "Unknown mode %s\n", argv[4]);
+        return 1;
+    }
+
+    const auto wire = format != Telemetry::FORMAT_RAW;
+
+    // Raw lockstep telemetry has the sequence number after the values
+    const auto telemetrySize = !wire && lockstep ?
+        Telemetry::SEQUENCED_SIZE * sizeof(double) :
+        Telemetry::telemetrySize(format);
+
+    ControllerTransport * transport = NULL;
+
+    // The simulator creates a shared-memory segment, so wait for it
+    while (true) {
+
+        transport = ControllerTransport::open(address,
+                MOTOR_PORT, TELEM_PORT, 0,
+                ControllerTransport::SIDE_CONTROLLER);
+
+        if (!*transport->getMessage()) {
+            break;
+        }
+
+        delete transport;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    printf("Listening for telemetry on %s\n", address);
+
+    uint64_t exchanges = 0;
+
+    uint32_t sequence = 0;
+
+    double z = 0;
+
+    while (true) {
+
+        uint8_t message[Telemetry::MAX_BYTES] = {};
+
+        if (!transport->receiveData(message, telemetrySize)) {
+            continue;
+        }
+
+        // Telemetry is time followed by x, dx, y, dy, z, dz, ...
+        double telemetry[Telemetry::SIZE] = {};
+
+        WireProtocol::header_t header = {};
+
+        if (wire) {
+
+            // ... with the time in the header
+            if (WireProtocol::decode(message, Telemetry::telemetrySize(format),
+                        header, &telemetry[1], Telemetry::WIRE_SIZE) < 0) {
+                continue;
+            }
+
+            if (header.flags & WireProtocol::FLAG_HALT) {
+                break;
+            }
+
+            telemetry[0] = header.simTime;
+        }
+
+        else {
+
+            memcpy(telemetry, message, sizeof(telemetry));
+
+            // Simulator sends a negative time to halt
+            if (telemetry[0] < 0) {
+                break;
+            }
+        }
+
+        z = telemetry[5];
+
+        const auto dz = telemetry[6];
+
+        const auto throttle =
+            constrain(HOVER + K_P * (target - z) - K_D * dz, 0, 1);
+
+        if (wire) {
+
+            const double motors[4] = {throttle, throttle, throttle, throttle};
+
+            // Answers the telemetry by its sequence number
+            const auto reply = WireProtocol::header(
+                    WireProtocol::SCHEMA_MOTORS, ++sequence, header.sequence,
+                    header.simTime, WireProtocol::FLAG_FLOAT32);
+
+            const auto size = WireProtocol::encode(
+                    reply, motors, 4, message, sizeof(message));
+
+            transport->sendData(message, size);
+        }
+
+        else {
+
+            float motors[4] = {throttle, throttle, throttle, throttle};
+
+            if (!lockstep) {
+                transport->sendData(motors, sizeof(motors));
+            }
+
+            else {
+
+                // Echo the sequence number after the motor values
+                double echoed = 0;
+                memcpy(&echoed, message + Telemetry::SIZE * sizeof(double),
+                        sizeof(echoed));
+
+                const auto answered = (uint32_t)echoed;
+
+                uint8_t reply[sizeof(motors) + sizeof(answered)] = {};
+                memcpy(reply, motors, sizeof(motors));
+                memcpy(reply + sizeof(motors), &answered, sizeof(answered));
+
+                transport->sendData(reply, sizeof(reply));
+            }
+        }
+
+        exchanges++;
+    }
+
+    printf("%llu exchanges, final altitude %3.3f\n",
+            (unsigned long long)exchanges, z);
+
+    transport->closeConnection();
+
+    delete transport;
+
+    return 0;
+}
@@ -0,0 +1,543 @@
+/*
+   Headless MulticopterSim: flies the same dynamics, with the same telemetry
+   and motor protocol, as FVehicleThread, but without Unreal Engine.  The
+   ground is flat at zero altitude.
+
+   Time can be scaled relative to the wall clock, or run as fast as the
+   flight controller can keep up (--time-scale 0), for flying long
+   simulations in CI or training jobs.  With --decoupled, a scaled-time run
+   talks to the flight controller on its own I/O thread, as FVehicleThread
+   does, instead of waiting for each motor packet.  With --lockstep, each
+   telemetry message carries a sequence number that the controller must
+   echo, making runs reproducible.  On Linux, the simulation and I/O threads
+   can be pinned to cores and given real-time priority, and memory locked.
+   With --host shm:NAME or unix:PATH, messages go over shared memory or
+   Unix-domain sockets instead of UDP, to a controller on the same host,
+   and with --protocol wire or wire32 they
+   are framed with sequence numbers and timestamps.  Built with
+   MULTISIM_TRACE, --trace writes a timeline of the run for chrome://tracing
+   or ui.perfetto.dev.
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "../Source/MultiSim/Clock.hpp"
+#include "../Source/MultiSim/ControllerLink.hpp"
+#include "../Source/MultiSim/Latency.hpp"
+#include "../Source/MultiSim/Placement.hpp"
+#include "../Source/MultiSim/Scheduler.hpp"
+#include "../Source/MultiSim/Telemetry.hpp"
+#include "../Source/MultiSim/Trace.hpp"
+#include "../Source/MultiSim/dynamics/fixedpitch/QuadXBF.hpp"
+
+static Dynamics::vehicle_params_t vparams = {
+
+    // Estimated
+    2.E-06, // d torque constant [T=d*w^2]
+
+    // https://www.dji.com/phantom-4/info
+    1.380,  // m mass [kg]
+
+    // Estimated
+    2,      // Ix [kg*m^2]
+    2,      // Iy [kg*m^2]
+    3,      // Iz [kg*m^2]
+    38E-04, // Jr prop inertial [kg*m^2]
+
+    15000,  // maxrpm
+
+    20      // maxspeed [m/s]
+};
+
+static FixedPitchDynamics::fixed_pitch_params_t fparams = {
+
+    // Estimated
+    5.E-06, // b force constatnt [F=b*w^2]
+    0.350   // l arm length [m]
+};
+
+typedef struct {
+
+    const char * host;
+    uint16_t motorPort;
+    uint16_t telemPort;
+
+    double physicsRate;      // Hz
+    uint32_t controllerPeriod; // dynamics updates per controller update
+
+    double timeScale; // simulated seconds per wall-clock second; 0 = max
+
+    double wakeRate; // wall-clock wakeups per second with timeScale > 0
+
+    double duration; // simulated seconds; 0 = until controller halts
+
+    uint32_t timeoutMsec; // motor receive timeout; 0 = wait forever
+
+    bool decoupled; // motor I/O on its own thread
+
+    bool lockstep; // sequence-numbered exchanges; implies timeScale = 0
+
+    bool quiet;
+
+    const char * traceFile; // NULL for no trace
+
+    // Starts from the MULTISIM_* environment variables
+    ThreadPlacement::placement_t placement;
+
+    // Starts from MULTISIM_PROTOCOL
+    Telemetry::format_t format;
+
+} options_t;
+
+static void usage(const char * name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --host HOST              flight controller host, shm:NAME\n"
+            "                           for shared memory, or unix:PATH\n"
+            "                           for Unix-domain sockets at\n"
+            "                           PATH.motor and PATH.telem\n"
+            "                           [127.0.0.1]\n"
+            "  --motor-port PORT        port for motors in [5000]\n"
+            "  --telem-port PORT        port for telemetry out [5001]\n"
+            "  --physics-rate HZ        dynamics update rate [10000]\n"
+            "  --controller-period N    dynamics updates per controller\n"
+            "                           update [100]\n"
+            "  --time-scale X           simulated seconds per wall-clock\n"
+            "                           second; 0 for as fast as possible [1]\n"
+            "  --wake-rate HZ           wakeups per wall-clock second when\n"
+            "                           time is scaled [1000]\n"
+            "  --duration SEC           simulated seconds to fly; 0 to fly\n"
+            "                           until the controller halts [0]\n"
+            "  --timeout MSEC           motor receive timeout, keeping the\n"
+            "                           previous motor values; 0 to wait\n"
+            "                           forever [0]\n"
+            "  --decoupled              talk to the controller on an I/O\n"
+            "                           thread, never waiting for motors\n"
+            "                           (needs a nonzero time scale)\n"
+            "  --lockstep               number each exchange and wait for\n"
+            "                           the controller to echo the number,\n"
+            "                           as fast as possible\n"
+            "  --cores LIST             cores for the simulation thread,\n"
+            "                           e.g. 2-3,6 [any]\n"
+            "  --priority N             SCHED_FIFO priority for the\n"
+            "                           simulation thread; 0 for normal [0]\n"
+            "  --io-cores LIST          cores for the I/O thread [any]\n"
+            "  --io-priority N          SCHED_FIFO priority for the I/O\n"
+            "                           thread [0]\n"
+            "  --mlock                  lock all memory, current and future\n"
+            "  --protocol NAME          message format: raw, or wire or\n"
+            "                           wire32 for framed messages with\n"
+            "                           float64 or float32 telemetry [raw]\n"
+            "  --trace FILE             write a Chrome trace of the run\n"
+            "                           (needs a MULTISIM_TRACE build)\n"
+            "  --quiet                  no progress reports\n",
+            name);
+
+    exit(1);
+}
+
+static options_t parseOptions(int argc, char ** argv)
+{
+    options_t options = {
+        "127.0.0.1", 5000, 5001, 10000, 100, 1, 1000, 0, 0, false, false, false,
+            NULL, ThreadPlacement::fromEnvironment(),
+            Telemetry::formatFromEnvironment()
+    };
+
+    for (int k=1; k<argc; ++k) {
+
+        const char * arg = argv[k];
+
+        if (!strcmp(arg, "--quiet")) {
+            options.quiet = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--decoupled")) {
+            options.decoupled = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--lockstep")) {
+            options.lockstep = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--mlock")) {
+            options.placement.lockMemory = true;
+            continue;
+        }
+
+        if (k == argc - 1) {
+            usage(argv[0]);
+        }
+
+        const char * val = argv[++k];
+
+        if (!strcmp(arg, "--host")) {
+            options.host = val;
+        }
+        else if (!strcmp(arg, "--motor-port")) {
+            options.motorPort = (uint16_t)atoi(val);
+        }
+        else if (!strcmp(arg, "--telem-port")) {
+            options.telemPort = (uint16_t)atoi(val);
+        }
+        else if (!strcmp(arg, "--physics-rate")) {
+            options.physicsRate = atof(val);
+        }
+        else if (!strcmp(arg, "--controller-period")) {
+            options.controllerPeriod = (uint32_t)atoi(val);
+        }
+        else if (!strcmp(arg, "--time-scale")) {
+            options.timeScale = atof(val);
+        }
+        else if (!strcmp(arg, "--wake-rate")) {
+            options.wakeRate = atof(val);
+        }
+        else if (!strcmp(arg, "--duration")) {
+            options.duration = atof(val);
+        }
+        else if (!strcmp(arg, "--timeout")) {
+            options.timeoutMsec = (uint32_t)atoi(val);
+        }
+        else if (!strcmp(arg, "--cores")) {
+            if (!ThreadPlacement::parseCores(
+                        val, options.placement.physics.cores)) {
+                usage(argv[0]);
+            }
+        }
+        else if (!strcmp(arg, "--priority")) {
+            options.placement.physics.priority = atoi(val);
+        }
+        else if (!strcmp(arg, "--io-cores")) {
+            if (!ThreadPlacement::parseCores(
+                        val, options.placement.io.cores)) {
+                usage(argv[0]);
+            }
+        }
+        else if (!strcmp(arg, "--io-priority")) {
+            options.placement.io.priority = atoi(val);
+        }
+        else if (!strcmp(arg, "--protocol")) {
+            if (!Telemetry::parseFormat(val, options.format)) {
+                usage(argv[0]);
+            }
+        }
+        else if (!strcmp(arg, "--trace")) {
+            options.traceFile = val;
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+
+    if (options.physicsRate <= 0 || options.controllerPeriod == 0 ||
+            options.timeScale < 0 || options.wakeRate <= 0 ||
+            options.duration < 0 ||
+            (options.decoupled && options.timeScale == 0) ||
+            (options.decoupled && options.lockstep)) {
+        usage(argv[0]);
+    }
+
+    if (options.lockstep) {
+        options.timeScale = 0;
+    }
+
+    if (options.traceFile && !Tracer::enabled()) {
+        fprintf(stderr, "--trace needs a build with MULTISIM_TRACE "
+                "(cmake -DMULTISIM_TRACE=ON)\n");
+        exit(1);
+    }
+
+    return options;
+}
+
+static double wallSeconds(
+        const std::chrono::steady_clock::time_point & start)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char ** argv)
+{
+    const auto options = parseOptions(argc, argv);
+
+    // Lock memory before anything else is allocated; place this thread,
+    // which runs the simulation
+    const auto lockError = options.placement.lockMemory ?
+        ThreadPlacement::lockMemory() : 0;
+
+    const auto physicsPlacement =
+        ThreadPlacement::apply(options.placement.physics);
+
+    TRACE_THREAD("physics");
+
+    // Create quadcopter dynamics model
+    QuadXBFDynamics dynamics(vparams, fparams);
+
+    const double rotation[3] = {0, 0, 0};
+    dynamics.init(rotation);
+
+    const auto actuatorCount = dynamics.actuatorCount();
+
+    // Telemetry out, motors in, either here or on an I/O thread; only
+    // waiting for each motor packet in turn can wait forever
+    const auto synchronous = !(options.decoupled || options.lockstep);
+
+    auto link = new ControllerLink(options.host,
+            options.motorPort, options.telemPort, actuatorCount,
+            synchronous || options.timeoutMsec > 0 ?
+                options.timeoutMsec : 100,
+            options.format);
+
+    if (*link->transportMessage()) {
+        fprintf(stderr, "%s\n", link->transportMessage());
+        return 1;
+    }
+
+    float actuatorValues[Dynamics::MAX_ROTORS] = {};
+
+    // No game controller; sticks stay centered, throttle down
+    const float joyvals[4] = {-1, 0, 0, 0};
+
+    const auto wire = options.format != Telemetry::FORMAT_RAW;
+
+    SimulationClock clock(options.physicsRate);
+
+    const auto dt = (float)clock.dt();
+
+    const auto realTime = options.timeScale > 0;
+
+    RateScheduler scheduler(options.wakeRate);
+
+    LatencyStage dynamicsLatency("dynamics");
+
+    if (!options.quiet) {
+        if (!strncmp(options.host, "shm:", 4)) {
+            printf("Talking to the controller over shared memory %s\n",
+                    options.host + 4);
+        }
+        else if (!strncmp(options.host, "unix:", 5)) {
+            printf("Sending telemetry to %s.telem, receiving motors on "
+                    "%s.motor\n", options.host + 5, options.host + 5);
+        }
+        else {
+            printf("Sending telemetry to %s:%d, receiving motors on port "
+                    "%d\n", options.host, options.telemPort,
+                    options.motorPort);
+        }
+        printf("Time scale: ");
+        if (realTime) {
+            printf("%gx\n", options.timeScale);
+        }
+        else {
+            printf("as fast as possible\n");
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    clock.start(0);
+
+    scheduler.start();
+
+    if (synchronous) {
+        link->startSynchronous();
+    }
+    else {
+        link->start(options.lockstep, options.placement.io);
+    }
+
+    if (!options.quiet) {
+
+        char line[500] = {};
+
+        ThreadPlacement::format("physics", options.placement.physics,
+                physicsPlacement, line, sizeof(line));
+        printf("Placement: %s\n", line);
+
+        link->formatPlacement(line, sizeof(line));
+        printf("Placement: %s\n", line);
+
+        if (options.placement.lockMemory) {
+            ThreadPlacement::formatLock(lockError, line, sizeof(line));
+            printf("Placement: %s\n", line);
+        }
+    }
+
+    uint32_t controllerClock = 0;
+
+    double nextReport = 1;
+
+    auto running = true;
+
+    while (running) {
+
+        uint32_t steps = options.controllerPeriod - controllerClock;
+
+        if (realTime) {
+
+            scheduler.wait();
+
+            steps = clock.advance(options.timeScale * wallSeconds(start));
+        }
+
+        else {
+            clock.step(steps);
+        }
+
+        for (uint32_t k=0; k<steps && running; ++k) {
+
+            // Newest motor values from the I/O thread, if any
+            if (options.decoupled) {
+
+                if (link->halted()) {
+                    running = false;
+                    break;
+                }
+
+                link->receive(actuatorValues);
+            }
+
+            const auto updateStart = LatencyStage::clock_t::now();
+
+            {
+                TRACE_SCOPE("dynamics");
+
+                dynamics.update(actuatorValues, dt);
+            }
+
+            dynamicsLatency.record(updateStart, LatencyStage::clock_t::now());
+
+            // Flat ground at zero altitude
+            dynamics.setAgl(dynamics.getStateZ());
+
+            // Same controller schedule as FVehicleThread
+            if (++controllerClock < options.controllerPeriod) {
+                continue;
+            }
+
+            controllerClock = 0;
+
+            // Time of this update, which may be behind the clock when
+            // catching up
+            const double time =
+                clock.time() - (steps - 1 - k) * clock.dt();
+
+            if (options.duration > 0 && time >= options.duration) {
+                running = false;
+            }
+
+            StateChannel::state_t state = {};
+            StateChannel::capture(time, clock.steps(), &dynamics,
+                    actuatorValues, state);
+
+            if (options.decoupled) {
+                link->post(state, joyvals);
+            }
+
+            else if (options.lockstep ?
+                    !link->exchange(state, joyvals, actuatorValues) :
+                    !link->update(state, joyvals, actuatorValues)) {
+                running = false;
+                break;
+            }
+        }
+
+        if (!options.quiet && clock.time() >= nextReport) {
+            printf("t=%7.1f  z=%+8.3f  %6.1fx real time\n",
+                    clock.time(),
+                    dynamics.getStateZ(),
+                    clock.time() / wallSeconds(start));
+            nextReport += 1;
+        }
+    }
+
+    const auto elapsed = wallSeconds(start);
+
+    // Tell the flight controller we're done
+    link->stop();
+
+    const auto counters = link->counters();
+
+    printf("Simulated %.3f s in %.3f s (%.1fx real time, %.3e steps/s); "
+            "%llu motor packets missed\n",
+            clock.time(),
+            elapsed,
+            clock.time() / elapsed,
+            clock.steps() / elapsed,
+            (unsigned long long)counters.missing);
+
+    if (realTime) {
+
+        const auto jitter = scheduler.jitter();
+
+        printf("Wakeups: %llu at %g Hz, late by %.1f +/- %.1f us "
+                "(max %.1f us), %llu overruns\n",
+                (unsigned long long)jitter.wakeups,
+                options.wakeRate,
+                jitter.mean,
+                jitter.stddev,
+                jitter.max,
+                (unsigned long long)jitter.overruns);
+    }
+
+    LatencyStage * stages[] = {
+        &dynamicsLatency,
+        &link->telemetryLatency(),
+        &link->motorLatency(),
+        &link->commandAge(),
+        wire ? &link->oneWayLatency() : NULL
+    };
+
+    for (auto stage : stages) {
+        if (stage) {
+            char line[200] = {};
+            stage->format(stage->total(), line, sizeof(line));
+            printf("%s\n", line);
+        }
+    }
+
+    printf("Controller link: %llu requests, %llu sent, %llu received, "
+            "%llu skipped, %llu late, %llu stale, %llu dropped, "
+            "%llu lost, %llu reordered\n",
+            (unsigned long long)counters.requests,
+            (unsigned long long)counters.sent,
+            (unsigned long long)counters.received,
+            (unsigned long long)counters.skipped,
+            (unsigned long long)counters.late,
+            (unsigned long long)counters.stale,
+            (unsigned long long)counters.dropped,
+            (unsigned long long)counters.lost,
+            (unsigned long long)counters.reordered);
+
+    delete link;
+
+    if (options.traceFile) {
+
+        const auto count = Tracer::writeChrome(options.traceFile);
+
+        if (count < 0) {
+            fprintf(stderr, "Couldn't write trace to %s\n",
+                    options.traceFile);
+            return 1;
+        }
+
+        printf("Trace: %lld events written to %s\n",
+                (long long)count, options.traceFile);
+    }
+
+    return 0;
+}
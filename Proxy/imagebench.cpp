@@ -0,0 +1,276 @@
+/*
+   Benchmark for ImageStream: streams camera-sized frames over loopback to
+   a receiving thread, first as Camera used to, with one unframed send()
+   per frame, then framed by ImageSender, over TCP and then over a
+   Unix-domain socket, and reports throughput and capture-to-receipt latency
+
+   Usage: imagebench [FRAMES [WIDTH HEIGHT]]
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../Source/MultiSim/Latency.hpp"
+#include "../Source/MultiSim/sockets/ImageStream.hpp"
+#include "../Source/MultiSim/sockets/TcpServerSocket.hpp"
+
+static const char * HOST = "127.0.0.1";
+
+static const uint16_t UNFRAMED_PORT = 5300;
+static const uint16_t FRAMED_PORT = 5301;
+
+static const char * UNIX_HOST = "unix:/tmp/multisim-imagebench";
+
+typedef struct {
+
+    uint32_t frames;
+    uint64_t mismatches;
+
+} received_t;
+
+static double now(void)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Capture time, given a latency measured on the wall clock
+static LatencyStage::clock_t::time_point taken(const uint64_t timestamp,
+        const LatencyStage::clock_t::time_point & received)
+{
+    return received - std::chrono::nanoseconds(
+            (int64_t)(ImageStream::wallNow() - timestamp));
+}
+
+// Each frame's pixels are its number, so the receiver can check them
+static void paint(uint8_t * pixels, const size_t size, const uint32_t frame)
+{
+    memset(pixels, (uint8_t)frame, size);
+}
+
+static bool painted(const uint8_t * pixels, const size_t size,
+        const uint32_t frame)
+{
+    return pixels[0] == (uint8_t)frame && pixels[size/2] == (uint8_t)frame &&
+        pixels[size-1] == (uint8_t)frame;
+}
+
+// Unframed: the receiver must know the size, and the timestamp rides in
+// the first pixels
+static void receiveUnframed(TcpServerSocket * server, const size_t size,
+        const uint32_t frames, LatencyStage * latency, received_t * received)
+{
+    std::vector<uint8_t> pixels(size);
+
+    server->acceptConnection();
+
+    for (uint32_t k=0; k<frames; ++k) {
+
+        if (!server->receiveData(&pixels[0], size)) {
+            break;
+        }
+
+        const auto end = LatencyStage::clock_t::now();
+
+        uint64_t timestamp = 0;
+        memcpy(&timestamp, &pixels[0], sizeof(timestamp));
+
+        latency->record(taken(timestamp, end), end);
+
+        received->frames++;
+
+        if (pixels[size-1] != (uint8_t)(k+1)) {
+            received->mismatches++;
+        }
+    }
+}
+
+static void receiveFramed(TcpServerSocket * server, const uint32_t frames,
+        LatencyStage * latency, received_t * received)
+{
+    std::vector<uint8_t> pixels;
+
+    server->acceptConnection();
+
+    for (uint32_t k=0; k<frames; ++k) {
+
+        ImageStream::header_t header = {};
+
+        if (!server->receiveData(&header, sizeof(header)) ||
+                !ImageStream::check(header)) {
+            break;
+        }
+
+        pixels.resize(header.size);
+
+        if (!server->receiveData(&pixels[0], header.size)) {
+            break;
+        }
+
+        const auto end = LatencyStage::clock_t::now();
+
+        latency->record(taken(header.timestamp, end), end);
+
+        received->frames++;
+
+        if (header.frame != k+1 ||
+                !painted(&pixels[0], header.size, header.frame)) {
+            received->mismatches++;
+        }
+    }
+}
+
+static void report(const char * label, const size_t frameBytes,
+        const double elapsed, LatencyStage & sending, LatencyStage & latency,
+        const received_t & received)
+{
+    const auto send = sending.total();
+    const auto summary = latency.total();
+
+    printf("%-9s %6.1f frames/s  %7.1f MB/s  send p50 %7.1f us  "
+            "latency p50 %7.1f p99 %7.1f us  %llu mismatched\n",
+            label,
+            received.frames / elapsed,
+            received.frames * frameBytes / elapsed / 1e6,
+            send.p50,
+            summary.p50,
+            summary.p99,
+            (unsigned long long)received.mismatches);
+}
+
+static void runUnframed(const uint32_t frames, const uint16_t width,
+        const uint16_t height)
+{
+    const size_t size = width * height * 4;
+
+    TcpServerSocket server(HOST, UNFRAMED_PORT);
+
+    LatencyStage latency("unframed");
+    received_t received = {};
+
+    std::thread receiver(receiveUnframed, &server, size, frames, &latency,
+            &received);
+
+    TcpClientSocket client(HOST, UNFRAMED_PORT);
+    client.openConnection();
+
+    std::vector<uint8_t> pixels(size);
+
+    // Time the camera's thread spends sending
+    LatencyStage sending("send");
+
+    const auto start = now();
+
+    for (uint32_t k=0; k<frames; ++k) {
+
+        paint(&pixels[0], size, k+1);
+
+        const auto timestamp = ImageStream::wallNow();
+        memcpy(&pixels[0], &timestamp, sizeof(timestamp));
+
+        const auto before = LatencyStage::clock_t::now();
+
+        client.sendData(&pixels[0], size);
+
+        sending.record(before, LatencyStage::clock_t::now());
+    }
+
+    receiver.join();
+
+    const auto elapsed = now() - start;
+
+    client.closeConnection();
+    server.closeConnection();
+
+    report("unframed", size, elapsed, sending, latency, received);
+}
+
+static void runFramed(const char * label, const char * host,
+        const uint32_t frames, const uint16_t width, const uint16_t height)
+{
+    const size_t size = width * height * 4;
+
+    TcpServerSocket server(host, FRAMED_PORT);
+
+    LatencyStage latency(label);
+    received_t received = {};
+
+    std::thread receiver(receiveFramed, &server, frames, &latency,
+            &received);
+
+    ImageSender sender(host, FRAMED_PORT);
+    sender.openConnection();
+
+    const auto zeroCopyAtStart = sender.isZeroCopy();
+
+    LatencyStage sending("send");
+
+    const auto start = now();
+
+    for (uint32_t k=0; k<frames; ++k) {
+
+        auto pixels = sender.acquire(size);
+
+        paint(pixels, size, k+1);
+
+        const auto before = LatencyStage::clock_t::now();
+
+        sender.sendFrame(pixels, width, height, ImageStream::PIXEL_BGRA8);
+
+        sending.record(before, LatencyStage::clock_t::now());
+    }
+
+    receiver.join();
+
+    const auto elapsed = now() - start;
+
+    const auto stats = sender.stats();
+
+    sender.closeConnection();
+    server.closeConnection();
+
+    report(label, size + sizeof(ImageStream::header_t), elapsed, sending,
+            latency, received);
+
+    // Unix-domain sockets don't support zero-copy sends
+    if (!zeroCopyAtStart) {
+        printf("          zero-copy unavailable\n");
+        return;
+    }
+
+    printf("          zero-copy on at connect, %s at end; "
+            "%llu frames zero-copy, %llu from the spare buffer\n",
+            sender.isZeroCopy() ? "on" : "off (kernel copied)",
+            (unsigned long long)stats.zeroCopied,
+            (unsigned long long)stats.spared);
+}
+
+int main(int argc, char ** argv)
+{
+    const uint32_t frames = argc > 1 ? atoi(argv[1]) : 500;
+    const uint16_t width = argc > 3 ? atoi(argv[2]) : 1280;
+    const uint16_t height = argc > 3 ? atoi(argv[3]) : 720;
+
+    printf("%u frames of %ux%u BGRA over loopback\n\n",
+            frames, width, height);
+
+    runUnframed(frames, width, height);
+
+    runFramed("framed", HOST, frames, width, height);
+
+    runFramed("unix", UNIX_HOST, frames, width, height);
+
+    // The listening socket leaves its file behind
+    unlink(UNIX_HOST + 5);
+
+    return 0;
+}
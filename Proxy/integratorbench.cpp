@@ -0,0 +1,243 @@
+/*
+   Benchmark for Dynamics integrators: flies the same aggressive command
+   sequence with each integrator and attitude representation at several
+   time steps, and reports position
+   error against a tiny-step RK4 reference along with the CPU cost per
+   simulated second.  Runs in double precision, so that the errors are those
+   of the integrators rather than of the state.
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+
+#include "../Source/MultiSim/dynamics/Coaxial.hpp"
+#include "../Source/MultiSim/dynamics/ThrustVector.hpp"
+#include "../Source/MultiSim/dynamics/fixedpitch/QuadXBF.hpp"
+
+typedef BasicDynamics<double> DoubleDynamics;
+
+// Simulated flight time
+static const double DURATION = 2.0;
+
+// Commands are held constant over each controller period; all time steps
+// below divide it evenly
+static const double CONTROLLER_PERIOD = 0.002;
+
+static const double REFERENCE_DT = 1e-5;
+
+static const double TIME_STEPS[] = {2e-3, 1e-3, 5e-4, 1e-4, 5e-5};
+
+// Best-of runs for timing
+static const uint8_t REPEATS = 5;
+
+static DoubleDynamics::vehicle_params_t vparams = {
+
+    // Estimated
+    2.E-06, // d torque constant [T=d*w^2]
+
+    // https://www.dji.com/phantom-4/info
+    1.380,  // m mass [kg]
+
+    // Estimated
+    2,      // Ix [kg*m^2]
+    2,      // Iy [kg*m^2]
+    3,      // Iz [kg*m^2]
+    38E-04, // Jr prop inertial [kg*m^2]
+
+    15000,  // maxrpm
+
+    20      // maxspeed [m/s]
+};
+
+static BasicFixedPitchDynamics<double>::fixed_pitch_params_t fparams = {
+
+    // Estimated
+    5.E-06, // b force constatnt [F=b*w^2]
+    0.350   // l arm length [m]
+};
+
+typedef struct {
+
+    const char * name;
+    DoubleDynamics::integrator_t integrator;
+    DoubleDynamics::attitude_t attitude;
+
+} integrator_info_t;
+
+static const integrator_info_t INTEGRATORS[] = {
+    {"Euler", DoubleDynamics::INTEGRATOR_EULER,
+        DoubleDynamics::ATTITUDE_EULER},
+    {"semi-implicit", DoubleDynamics::INTEGRATOR_SEMI_IMPLICIT_EULER,
+        DoubleDynamics::ATTITUDE_EULER},
+    {"RK4", DoubleDynamics::INTEGRATOR_RK4,
+        DoubleDynamics::ATTITUDE_EULER},
+    {"RK45", DoubleDynamics::INTEGRATOR_RK45,
+        DoubleDynamics::ATTITUDE_EULER},
+    {"Euler/quat", DoubleDynamics::INTEGRATOR_EULER,
+        DoubleDynamics::ATTITUDE_QUATERNION},
+    {"semi-imp/quat", DoubleDynamics::INTEGRATOR_SEMI_IMPLICIT_EULER,
+        DoubleDynamics::ATTITUDE_QUATERNION},
+    {"RK4/quat", DoubleDynamics::INTEGRATOR_RK4,
+        DoubleDynamics::ATTITUDE_QUATERNION},
+    {"RK45/quat", DoubleDynamics::INTEGRATOR_RK45,
+        DoubleDynamics::ATTITUDE_QUATERNION},
+};
+
+// Quadcopter: rolling and pitching around hover
+static void quadCommands(const double t, double * actuators)
+{
+    for (uint8_t i=0; i<4; ++i) {
+        actuators[i] = 0.5 + 0.05 * sin(2 * M_PI * (1 + 0.5 * i) * t + i);
+    }
+}
+
+// Coaxial: both rotors above hover, sweeping the cyclics
+static void coaxialCommands(const double t, double * actuators)
+{
+    actuators[0] = 0.72;
+    actuators[1] = 0.70;
+    actuators[2] = 0;
+    actuators[3] = 0.5 * sin(2 * M_PI * 1.5 * t);
+    actuators[4] = 0.5 * cos(2 * M_PI * 1.0 * t);
+}
+
+// Thrust vectoring: both rotors above hover, sweeping the nozzle
+static void thrustVectorCommands(const double t, double * actuators)
+{
+    actuators[0] = 0.42;
+    actuators[1] = 0.41;
+    actuators[2] = 0.3 * sin(2 * M_PI * 1.5 * t);
+    actuators[3] = 0.3 * cos(2 * M_PI * 1.0 * t);
+}
+
+static BasicQuadXBFDynamics<double> makeQuad(void)
+{
+    // No auto-land
+    return BasicQuadXBFDynamics<double>(vparams, fparams, false);
+}
+
+static BasicCoaxialDynamics<double> makeCoaxial(void)
+{
+    return BasicCoaxialDynamics<double>(vparams, false);
+}
+
+static BasicThrustVectorDynamics<double> makeThrustVector(void)
+{
+    return BasicThrustVectorDynamics<double>(vparams, 45, false);
+}
+
+// Flies the command sequence, returning CPU seconds; final position in xyz
+template <class T>
+static double fly(
+        T (*make)(void),
+        void (*commands)(const double, double *),
+        const DoubleDynamics::integrator_t integrator,
+        const DoubleDynamics::attitude_t attitude,
+        const double dt,
+        double xyz[3])
+{
+    auto dynamics = make();
+
+    dynamics.setIntegrator(integrator);
+    dynamics.setAttitudeRepresentation(attitude);
+
+    const double rotation[3] = {0, 0, 0};
+    dynamics.init(rotation, true); // start airborne
+
+    // Stay well above ground
+    dynamics.setAgl(1000);
+
+    const auto stepsPerCommand = (uint32_t)round(CONTROLLER_PERIOD / dt);
+    const auto commandCount = (uint32_t)round(DURATION / CONTROLLER_PERIOD);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t j=0; j<commandCount; ++j) {
+
+        double actuators[DoubleDynamics::MAX_ROTORS] = {};
+        commands(j * CONTROLLER_PERIOD, actuators);
+
+        for (uint32_t k=0; k<stepsPerCommand; ++k) {
+            dynamics.update(actuators, dt);
+        }
+    }
+
+    const auto elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    xyz[0] = dynamics.getStateX();
+    xyz[1] = dynamics.getStateY();
+    xyz[2] = dynamics.getStateZ();
+
+    return elapsed;
+}
+
+template <class T>
+static void benchmark(
+        const char * name,
+        T (*make)(void),
+        void (*commands)(const double, double *))
+{
+    // The quaternion path treats the angular rates as body rates rather
+    // than Euler-angle rates, so each representation gets its own reference
+    double references[2][3] = {};
+    fly(make, commands, DoubleDynamics::INTEGRATOR_RK4,
+            DoubleDynamics::ATTITUDE_EULER, REFERENCE_DT,
+            references[DoubleDynamics::ATTITUDE_EULER]);
+    fly(make, commands, DoubleDynamics::INTEGRATOR_RK4,
+            DoubleDynamics::ATTITUDE_QUATERNION, REFERENCE_DT,
+            references[DoubleDynamics::ATTITUDE_QUATERNION]);
+
+    printf("\n%s: reference position (%+.4f, %+.4f, %+.4f)"
+            "  quat (%+.4f, %+.4f, %+.4f)\n\n", name,
+            references[0][0], references[0][1], references[0][2],
+            references[1][0], references[1][1], references[1][2]);
+
+    // Errors that stop shrinking as the rate goes up (RK4 and RK45, near
+    // 1e-14 m) have reached the rounding floor of the double-precision
+    // state, summed over every step of both flights
+    printf("integrator     rate [Hz]  error [m]   cost [us/sim-sec]\n");
+
+    for (auto & info : INTEGRATORS) {
+
+        for (auto dt : TIME_STEPS) {
+
+            double xyz[3] = {};
+            double best = 1e9;
+
+            for (uint8_t r=0; r<REPEATS; ++r) {
+                const auto elapsed =
+                    fly(make, commands, info.integrator, info.attitude,
+                            dt, xyz);
+                best = elapsed < best ? elapsed : best;
+            }
+
+            const auto reference = references[info.attitude];
+
+            const auto error = sqrt(
+                    pow(xyz[0] - reference[0], 2) +
+                    pow(xyz[1] - reference[1], 2) +
+                    pow(xyz[2] - reference[2], 2));
+
+            printf("%-13s  %9.0f  %9.3e  %9.1f\n",
+                    info.name, 1 / dt, error, 1e6 * best / DURATION);
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    benchmark("QuadXBF", makeQuad, quadCommands);
+
+    benchmark("Coaxial", makeCoaxial, coaxialCommands);
+
+    benchmark("ThrustVector", makeThrustVector, thrustVectorCommands);
+
+    return 0;
+}
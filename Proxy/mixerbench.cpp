@@ -0,0 +1,189 @@
+/*
+   Benchmark for MixerDynamics: checks QuadXBFDynamics, which runs on the
+   quad-X mixing table, against a quad-X with a roll and pitch sign per
+   rotor on FixedPitchDynamics, and that every built-in layout hovers level
+   with equal motor values, then reports updates per second for each layout
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+
+#include "../Source/MultiSim/dynamics/Mixer.hpp"
+#include "../Source/MultiSim/dynamics/fixedpitch/QuadXBF.hpp"
+
+// Time constant
+static const double DELTA_T = 0.001;
+
+// Updates per timing run
+static const uint32_t STEPS = 10000000;
+
+static Dynamics::vehicle_params_t vparams = {
+
+    // Estimated
+    2.E-06, // d torque constant [T=d*w^2]
+
+    // https://www.dji.com/phantom-4/info
+    1.380,  // m mass [kg]
+
+    // Estimated
+    2,      // Ix [kg*m^2]
+    2,      // Iy [kg*m^2]
+    3,      // Iz [kg*m^2]
+    38E-04, // Jr prop inertial [kg*m^2]
+
+    15000,  // maxrpm
+
+    20      // maxspeed [m/s]
+};
+
+static FixedPitchDynamics::fixed_pitch_params_t fparams = {
+
+    // Estimated
+    5.E-06, // b force constatnt [F=b*w^2]
+    0.350   // l arm length [m]
+};
+
+// Betaflight quad-X the per-rotor way, as QuadXBFDynamics used to be
+class PerRotorQuadX : public FixedPitchDynamics {
+
+    protected:
+
+        virtual int8_t getRotorDirection(uint8_t i) override
+        {
+            static const int8_t d[4] = {-1, +1, +1, -1};
+            return d[i];
+        }
+
+        virtual int8_t getRotorRollContribution(uint8_t i) override
+        {
+            static const int8_t d[4] = {-1, -1, +1, +1};
+            return d[i];
+        }
+
+        virtual int8_t getRotorPitchContribution(uint8_t i) override
+        {
+            static const int8_t d[4] = {+1, -1, +1, -1};
+            return d[i];
+        }
+
+    public:
+
+        PerRotorQuadX(void)
+            : FixedPitchDynamics(4, vparams, fparams, false)
+        {
+        }
+
+        virtual Dynamics * fork(void) override
+        {
+            return new PerRotorQuadX(*this);
+        }
+};
+
+static void start(Dynamics & dynamics)
+{
+    const double rotation[3] = {0, 0, 0};
+    dynamics.init(rotation);
+
+    // Set AGL to arbitrary positive value to avoid kinematic trick
+    dynamics.setAgl(1);
+}
+
+// Largest difference between two vehicles flying the same varying commands
+static double compare(Dynamics & a, Dynamics & b)
+{
+    start(a);
+    start(b);
+
+    double maxError = 0;
+
+    for (uint32_t j=0; j<5000; ++j) {
+
+        float motors[4] = {};
+        for (uint8_t i=0; i<4; ++i) {
+            motors[i] = 0.6f + 0.05f * (float)sin(0.003 * j * (i + 1));
+        }
+
+        a.update(motors, DELTA_T);
+        b.update(motors, DELTA_T);
+
+        const double errors[] = {
+            a.getStateX() - b.getStateX(),
+            a.getStateY() - b.getStateY(),
+            a.getStateZ() - b.getStateZ(),
+            a.getStatePhi() - b.getStatePhi(),
+            a.getStateTheta() - b.getStateTheta(),
+            a.getStatePsi() - b.getStatePsi()
+        };
+
+        for (auto e : errors) {
+            maxError = fabs(e) > maxError ? fabs(e) : maxError;
+        }
+    }
+
+    return maxError;
+}
+
+// Flies with all motors equal, reporting tilt and updates per second
+static void hover(const char * name, Dynamics & dynamics)
+{
+    start(dynamics);
+
+    float motors[Dynamics::MAX_ROTORS] = {};
+    for (uint8_t i=0; i<dynamics.rotorCount(); ++i) {
+        motors[i] = 0.6f;
+    }
+
+    // Short flight for the level check
+    for (uint32_t j=0; j<2000; ++j) {
+        dynamics.update(motors, DELTA_T);
+    }
+
+    const auto tilt = fabs(dynamics.getStatePhi()) +
+        fabs(dynamics.getStateTheta()) + fabs(dynamics.getStatePsi());
+
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (uint32_t j=0; j<STEPS; ++j) {
+        dynamics.update(motors, DELTA_T);
+    }
+
+    const auto elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+
+    printf("%-10s  %6u  %9.2e  %12.3e\n",
+            name, dynamics.rotorCount(), tilt, STEPS / elapsed);
+}
+
+int main(int argc, char ** argv)
+{
+    QuadXBFDynamics quad(vparams, fparams, false);
+    PerRotorQuadX perRotor;
+
+    printf("QuadXBFDynamics vs. per-rotor quad-X: max difference %.3e\n\n",
+            compare(quad, perRotor));
+
+    printf("layout      rotors  tilt [rad]  updates/sec\n");
+
+    hover("per-rotor", perRotor);
+    hover("QuadXBF", quad);
+
+    MixerDynamics<6> hexa(vparams, fparams, RotorLayout::HEXA_X, false);
+    hover("Hexa-X", hexa);
+
+    MixerDynamics<8> octo(vparams, fparams, RotorLayout::OCTO_X, false);
+    hover("Octo-X", octo);
+
+    MixerDynamics<6> y6(vparams, fparams, RotorLayout::Y6, false);
+    hover("Y6", y6);
+
+    MixerDynamics<8> x8(vparams, fparams, RotorLayout::X8, false);
+    hover("X8", x8);
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+   Benchmark for SimulationExecutor: flies many vehicles at the full physics
+   rate, first on a fixed pool of worker threads, then with a thread per
+   vehicle, and reports how close each vehicle came to real time, CPU time
+   used, and wakeup jitter
+
+   Usage: poolbench [VEHICLES [WORKERS [SECONDS]]]
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../Source/MultiSim/Clock.hpp"
+#include "../Source/MultiSim/Executor.hpp"
+#include "../Source/MultiSim/Scheduler.hpp"
+#include "../Source/MultiSim/dynamics/fixedpitch/QuadXBF.hpp"
+
+static const double PHYSICS_RATE = 10000;
+
+static const double WAKE_RATE = 1000;
+
+static Dynamics::vehicle_params_t vparams = {
+
+    // Estimated
+    2.E-06, // d torque constant [T=d*w^2]
+
+    // https://www.dji.com/phantom-4/info
+    1.380,  // m mass [kg]
+
+    // Estimated
+    2,      // Ix [kg*m^2]
+    2,      // Iy [kg*m^2]
+    3,      // Iz [kg*m^2]
+    38E-04, // Jr prop inertial [kg*m^2]
+
+    15000,  // maxrpm
+
+    20      // maxspeed [m/s]
+};
+
+static FixedPitchDynamics::fixed_pitch_params_t fparams = {
+
+    // Estimated
+    5.E-06, // b force constatnt [F=b*w^2]
+    0.350   // l arm length [m]
+};
+
+static double now(void)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpuSeconds(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// One vehicle: dynamics on a fixed-step clock, as in FVehicleThread
+class Vehicle : public SimulationTask {
+
+    private:
+
+        QuadXBFDynamics _dynamics;
+
+        SimulationClock _clock;
+
+        double _startTime = 0;
+
+        float _motors[4] = {0.6f, 0.6f, 0.6f, 0.6f};
+
+    public:
+
+        Vehicle(void)
+            : _dynamics(vparams, fparams), _clock(PHYSICS_RATE)
+        {
+            const double rotation[3] = {0, 0, 0};
+            _dynamics.init(rotation);
+
+            // Set AGL to arbitrary positive value to avoid kinematic trick
+            _dynamics.setAgl(1);
+        }
+
+        void start(const double startTime)
+        {
+            _startTime = startTime;
+
+            _clock.start(0);
+        }
+
+        virtual void tick(void) override
+        {
+            const auto steps = _clock.advance(now() - _startTime);
+
+            for (uint32_t k=0; k<steps; ++k) {
+                _dynamics.update(_motors, (float)_clock.dt());
+            }
+        }
+
+        uint64_t steps(void)
+        {
+            return _clock.steps();
+        }
+
+}; // class Vehicle
+
+static void report(
+        const char * label,
+        std::vector<Vehicle> & vehicles,
+        const double elapsed,
+        const double cpu,
+        const RateScheduler::jitter_t & jitter)
+{
+    const auto expected = PHYSICS_RATE * elapsed;
+
+    double worst = 1;
+    double total = 0;
+
+    for (auto & vehicle : vehicles) {
+        const auto ratio = vehicle.steps() / expected;
+        worst = ratio < worst ? ratio : worst;
+        total += ratio;
+    }
+
+    printf("%-22s real time: mean=%5.1f%%  worst=%5.1f%%  "
+            "cpu=%6.2f s  jitter mean=%7.1f max=%8.1f us\n",
+            label,
+            100 * total / vehicles.size(),
+            100 * worst,
+            cpu,
+            jitter.mean,
+            jitter.max);
+}
+
+static void runPool(
+        const uint32_t vehicleCount,
+        const uint32_t workers,
+        const double seconds)
+{
+    std::vector<Vehicle> vehicles(vehicleCount);
+
+    SimulationExecutor executor(workers, WAKE_RATE);
+
+    const auto cpu = cpuSeconds();
+
+    const auto startTime = now();
+
+    for (auto & vehicle : vehicles) {
+        vehicle.start(startTime);
+        executor.add(&vehicle);
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    for (auto & vehicle : vehicles) {
+        executor.remove(&vehicle);
+    }
+
+    const auto elapsed = now() - startTime;
+
+    char label[100] = {};
+    snprintf(label, sizeof(label), "pool (%u threads)", executor.workerCount());
+
+    report(label, vehicles, elapsed, cpuSeconds() - cpu, executor.jitter());
+
+    printf("%-22s ticks=%llu  stolen=%llu\n", "",
+            (unsigned long long)executor.ticks(),
+            (unsigned long long)executor.steals());
+}
+
+static void runThreads(const uint32_t vehicleCount, const double seconds)
+{
+    std::vector<Vehicle> vehicles(vehicleCount);
+
+    std::vector<RateScheduler> schedulers(vehicleCount, RateScheduler(WAKE_RATE));
+
+    std::vector<std::thread> threads;
+
+    std::atomic<bool> running(true);
+
+    const auto cpu = cpuSeconds();
+
+    const auto startTime = now();
+
+    for (uint32_t k=0; k<vehicleCount; ++k) {
+
+        threads.emplace_back([&, k] {
+
+                vehicles[k].start(startTime);
+
+                schedulers[k].start();
+
+                while (running.load(std::memory_order_acquire)) {
+                    schedulers[k].wait();
+                    vehicles[k].tick();
+                }
+                });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    running.store(false, std::memory_order_release);
+
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    const auto elapsed = now() - startTime;
+
+    // Worst case over all the threads
+    RateScheduler::jitter_t jitter = {};
+
+    for (auto & scheduler : schedulers) {
+        const auto j = scheduler.jitter();
+        jitter.mean = j.mean > jitter.mean ? j.mean : jitter.mean;
+        jitter.max = j.max > jitter.max ? j.max : jitter.max;
+    }
+
+    char label[100] = {};
+    snprintf(label, sizeof(label), "thread per vehicle (%u)", vehicleCount);
+
+    report(label, vehicles, elapsed, cpuSeconds() - cpu, jitter);
+}
+
+int main(int argc, char ** argv)
+{
+    const uint32_t vehicles = argc > 1 ? atoi(argv[1]) : 50;
+    const uint32_t workers = argc > 2 ? atoi(argv[2]) : 0;
+    const double seconds = argc > 3 ? atof(argv[3]) : 3;
+
+    printf("%u vehicles at %.0f Hz for %.1f s, %u hardware threads\n\n",
+            vehicles, PHYSICS_RATE, seconds,
+            std::thread::hardware_concurrency());
+
+    runPool(vehicles, workers, seconds);
+
+    runThreads(vehicles, seconds);
+
+    return 0;
+}
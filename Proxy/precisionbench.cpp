@@ -0,0 +1,212 @@
+/*
+   Benchmark for scalar precision: flies the same command sequence with
+   float and double dynamics, reporting how far the float trajectory drifts
+   from the double one, then compares vehicle-steps per second for single
+   instances and for batches
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../Source/MultiSim/dynamics/Batch.hpp"
+#include "../Source/MultiSim/dynamics/fixedpitch/QuadXBF.hpp"
+
+// Time constant
+static const double DELTA_T = 0.001;
+
+// Simulated flight time for the accuracy check
+static const double DURATION = 10.0;
+
+// Total vehicle-steps per timing run
+static const uint32_t WORK = 20000000;
+
+template <typename real_t>
+static typename BasicDynamics<real_t>::vehicle_params_t vparams(void)
+{
+    return {
+
+        // Estimated
+        2.E-06, // d torque constant [T=d*w^2]
+
+        // https://www.dji.com/phantom-4/info
+        1.380,  // m mass [kg]
+
+        // Estimated
+        2,      // Ix [kg*m^2]
+        2,      // Iy [kg*m^2]
+        3,      // Iz [kg*m^2]
+        38E-04, // Jr prop inertial [kg*m^2]
+
+        15000,  // maxrpm
+
+        20      // maxspeed [m/s]
+    };
+}
+
+template <typename real_t>
+static typename BasicFixedPitchDynamics<real_t>::fixed_pitch_params_t
+fparams(void)
+{
+    return {
+
+        // Estimated
+        5.E-06, // b force constatnt [F=b*w^2]
+        0.350   // l arm length [m]
+    };
+}
+
+// Rolling and pitching around hover
+template <typename real_t>
+static void commands(const double t, real_t * actuators)
+{
+    for (uint8_t i=0; i<4; ++i) {
+        actuators[i] =
+            (real_t)(0.5 + 0.05 * sin(2 * M_PI * (1 + 0.5 * i) * t + i));
+    }
+}
+
+template <typename real_t>
+static void fly(double xyz[3])
+{
+    BasicQuadXBFDynamics<real_t> dynamics(
+            vparams<real_t>(), fparams<real_t>(), false); // no auto-land
+
+    const double rotation[3] = {0, 0, 0};
+    dynamics.init(rotation, true); // start airborne
+
+    // Stay well above ground
+    dynamics.setAgl(1000);
+
+    const auto steps = (uint32_t)round(DURATION / DELTA_T);
+
+    for (uint32_t j=0; j<steps; ++j) {
+
+        real_t actuators[4] = {};
+        commands(j * DELTA_T, actuators);
+
+        dynamics.update(actuators, (real_t)DELTA_T);
+    }
+
+    xyz[0] = dynamics.getStateX();
+    xyz[1] = dynamics.getStateY();
+    xyz[2] = dynamics.getStateZ();
+}
+
+static double seconds(
+        const std::chrono::steady_clock::time_point & start)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+// Returns vehicle-steps per second for separate instances
+template <typename real_t>
+static double benchmarkSingles(const uint32_t count)
+{
+    const uint32_t steps = WORK / count < 20 ? 20 : WORK / count;
+
+    std::vector<BasicQuadXBFDynamics<real_t>> singles;
+    singles.reserve(count);
+
+    const double rotation[3] = {0, 0, 0};
+
+    for (uint32_t k=0; k<count; ++k) {
+        singles.emplace_back(vparams<real_t>(), fparams<real_t>(), false);
+        singles[k].init(rotation);
+        singles[k].setAgl(1);
+    }
+
+    real_t actuators[4] = {};
+    commands(0, actuators);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t j=0; j<steps; ++j) {
+        for (auto & single : singles) {
+            single.update(actuators, (real_t)DELTA_T);
+        }
+    }
+
+    return (double)count * steps / seconds(start);
+}
+
+// Returns vehicle-steps per second for a batch
+template <typename real_t>
+static double benchmarkBatch(const uint32_t count)
+{
+    const uint32_t steps = WORK / count < 20 ? 20 : WORK / count;
+
+    BasicDynamicsBatch<real_t> batch(count, 4,
+            RotorLayout::QUAD_X_BF,
+            vparams<real_t>(), fparams<real_t>(), false);
+
+    const double rotation[3] = {0, 0, 0};
+    batch.init(rotation);
+
+    for (uint32_t k=0; k<count; ++k) {
+        batch.setAgl(k, 1);
+    }
+
+    real_t motors[4] = {};
+    commands(0, motors);
+
+    std::vector<real_t> actuators(4 * count);
+    for (uint8_t i=0; i<4; ++i) {
+        for (uint32_t k=0; k<count; ++k) {
+            actuators[i * count + k] = motors[i];
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t j=0; j<steps; ++j) {
+        batch.update(actuators.data(), (real_t)DELTA_T);
+    }
+
+    return (double)count * steps / seconds(start);
+}
+
+int main(int argc, char ** argv)
+{
+    double xyzFloat[3] = {};
+    fly<float>(xyzFloat);
+
+    double xyzDouble[3] = {};
+    fly<double>(xyzDouble);
+
+    printf("Accuracy over %.0f s at %.0f Hz:\n", DURATION, 1 / DELTA_T);
+    printf("  float  (%+.6f, %+.6f, %+.6f)\n",
+            xyzFloat[0], xyzFloat[1], xyzFloat[2]);
+    printf("  double (%+.6f, %+.6f, %+.6f)\n",
+            xyzDouble[0], xyzDouble[1], xyzDouble[2]);
+    printf("  float error %.3e m\n", sqrt(
+                pow(xyzFloat[0] - xyzDouble[0], 2) +
+                pow(xyzFloat[1] - xyzDouble[1], 2) +
+                pow(xyzFloat[2] - xyzDouble[2], 2)));
+
+    printf("\nvehicles  kind    float veh/sec  double veh/sec  speedup\n");
+
+    for (uint32_t count=1; count<=100000; count*=10) {
+
+        const auto singleFloat = benchmarkSingles<float>(count);
+        const auto singleDouble = benchmarkSingles<double>(count);
+
+        printf("%8u  single  %13.3e  %14.3e  %6.2fx\n",
+                count, singleFloat, singleDouble, singleFloat / singleDouble);
+
+        const auto batchFloat = benchmarkBatch<float>(count);
+        const auto batchDouble = benchmarkBatch<double>(count);
+
+        printf("%8u  batch   %13.3e  %14.3e  %6.2fx\n",
+                count, batchFloat, batchDouble, batchFloat / batchDouble);
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+   Benchmark for ThreadPlacement: runs the physics thread's wakeup loop
+   under a series of placements (default, pinned to a core, SCHED_FIFO,
+   both, both with memory locked) while other threads load every core, and
+   reports how late the wakeups came for each
+
+   Usage: rtbench [SECONDS [LOAD_THREADS [CORE [PRIORITY]]]]
+
+   Real-time priority and memory locking usually need root or
+   CAP_SYS_NICE / CAP_IPC_LOCK; a placement that is refused is reported as
+   such and run anyway, with whatever it got.
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../Source/MultiSim/Placement.hpp"
+#include "../Source/MultiSim/Scheduler.hpp"
+
+// Same wakeup rate as FVehicleThread
+static const double WAKE_RATE = 1000;
+
+typedef struct {
+
+    const char * name;
+
+    ThreadPlacement::config_t config;
+
+    bool lockMemory;
+
+} run_t;
+
+static void measure(
+        const run_t & run,
+        const double seconds,
+        int & lockError,
+        ThreadPlacement::report_t & report,
+        RateScheduler::jitter_t & jitter)
+{
+    if (run.lockMemory) {
+        lockError = ThreadPlacement::lockMemory();
+    }
+
+    // A fresh thread each time, so that no placement carries over
+    std::thread thread([&] {
+
+            report = ThreadPlacement::apply(run.config);
+
+            RateScheduler scheduler(WAKE_RATE);
+
+            const auto wakeups = (uint32_t)(seconds * WAKE_RATE);
+
+            scheduler.start();
+
+            for (uint32_t k=0; k<wakeups; ++k) {
+                scheduler.wait();
+            }
+
+            jitter = scheduler.jitter();
+            });
+
+    thread.join();
+}
+
+int main(int argc, char ** argv)
+{
+    const auto hardware = std::thread::hardware_concurrency();
+
+    const double seconds = argc > 1 ? atof(argv[1]) : 2;
+
+    const uint32_t loadCount = argc > 2 ? atoi(argv[2]) :
+        hardware > 0 ? hardware : 1;
+
+    const uint32_t core = argc > 3 ? atoi(argv[3]) :
+        hardware > 0 ? hardware - 1 : 0;
+
+    const int priority = argc > 4 ? atoi(argv[4]) : 80;
+
+    const auto pinned = (uint64_t)1 << core;
+
+    const run_t runs[] = {
+        {"default",          {0, 0},             false},
+        {"pinned",           {pinned, 0},        false},
+        {"fifo",             {0, priority},      false},
+        {"pinned+fifo",      {pinned, priority}, false},
+        {"pinned+fifo+mlock",{pinned, priority}, true},
+    };
+
+    printf("Wakeups at %.0f Hz for %.1f s per run, %u load threads, "
+            "core %u, priority %d\n\n",
+            WAKE_RATE, seconds, loadCount, core, priority);
+
+    // Busy threads at normal priority, free to run anywhere
+    std::atomic<bool> loading(true);
+
+    std::vector<std::thread> load;
+
+    for (uint32_t k=0; k<loadCount; ++k) {
+        load.emplace_back([&] {
+                volatile uint64_t count = 0;
+                while (loading.load(std::memory_order_relaxed)) {
+                    count = count + 1;
+                }
+                });
+    }
+
+    printf("%-18s %8s %9s %9s %10s %9s\n",
+            "placement", "wakeups", "mean us", "sdev us", "max us",
+            "overruns");
+
+    std::vector<ThreadPlacement::report_t> reports;
+
+    int lockError = 0;
+
+    for (auto & run : runs) {
+
+        ThreadPlacement::report_t report = {};
+
+        RateScheduler::jitter_t jitter = {};
+
+        measure(run, seconds, lockError, report, jitter);
+
+        reports.push_back(report);
+
+        printf("%-18s %8llu %9.1f %9.1f %10.1f %9llu\n",
+                run.name,
+                (unsigned long long)jitter.wakeups,
+                jitter.mean,
+                jitter.stddev,
+                jitter.max,
+                (unsigned long long)jitter.overruns);
+    }
+
+    loading.store(false);
+
+    for (auto & thread : load) {
+        thread.join();
+    }
+
+    // What each run actually got
+    printf("\n");
+
+    for (uint32_t k=0; k<reports.size(); ++k) {
+
+        char line[500] = {};
+
+        ThreadPlacement::format(runs[k].name, runs[k].config, reports[k],
+                line, sizeof(line));
+
+        printf("%s\n", line);
+    }
+
+    char line[500] = {};
+    ThreadPlacement::formatLock(lockError, line, sizeof(line));
+    printf("%s\n", line);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+   Benchmark for the controller transports: forks an echo controller, then
+   times telemetry/motor round trips over UDP, Unix-domain sockets and
+   shared memory
+
+   Usage: shmbench [EXCHANGES]
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+#include "../Source/MultiSim/Latency.hpp"
+#include "../Source/MultiSim/Telemetry.hpp"
+#include "../Source/MultiSim/Transport.hpp"
+
+static const short MOTOR_PORT = 5100;
+static const short TELEM_PORT = 5101;
+
+static const uint32_t TIMEOUT_MSEC = 100;
+
+static const uint32_t WARMUP = 1000;
+
+// Sends back four motor values for each telemetry message, until halted
+static void echo(const char * address)
+{
+    ControllerTransport * transport = NULL;
+
+    while (true) {
+
+        transport = ControllerTransport::open(address,
+                MOTOR_PORT, TELEM_PORT, TIMEOUT_MSEC,
+                ControllerTransport::SIDE_CONTROLLER);
+
+        if (!*transport->getMessage()) {
+            break;
+        }
+
+        delete transport;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    while (true) {
+
+        double telemetry[Telemetry::SIZE] = {};
+
+        if (!transport->receiveData(telemetry, sizeof(telemetry))) {
+            continue;
+        }
+
+        if (telemetry[0] < 0) {
+            break;
+        }
+
+        float motors[4] = {(float)telemetry[0], 0, 0, 0};
+
+        transport->sendData(motors, sizeof(motors));
+    }
+
+    transport->closeConnection();
+
+    delete transport;
+}
+
+static void run(const char * label, const char * address,
+        const uint32_t exchanges)
+{
+    ControllerTransport * transport = ControllerTransport::open(address,
+            MOTOR_PORT, TELEM_PORT, TIMEOUT_MSEC);
+
+    if (*transport->getMessage()) {
+        printf("%-14s %s\n", label, transport->getMessage());
+        delete transport;
+        return;
+    }
+
+    const auto pid = fork();
+
+    if (pid == 0) {
+        echo(address);
+        _exit(0);
+    }
+
+    LatencyHistogram histogram;
+
+    uint32_t lost = 0;
+
+    // Warm up, resending until the controller has come up
+    for (uint32_t k=0; k<WARMUP+exchanges; ) {
+
+        double telemetry[Telemetry::SIZE] = {(double)k};
+
+        float motors[4] = {};
+
+        const auto start = std::chrono::steady_clock::now();
+
+        transport->sendData(telemetry, sizeof(telemetry));
+
+        if (!transport->receiveData(motors, sizeof(motors)) ||
+                motors[0] != (float)k) {
+            lost += k >= WARMUP;
+            continue;
+        }
+
+        if (k >= WARMUP) {
+            histogram.record((uint64_t)std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+        }
+
+        k++;
+    }
+
+    double halt[Telemetry::SIZE] = {-1};
+    transport->sendData(halt, sizeof(halt));
+
+    waitpid(pid, NULL, 0);
+
+    transport->closeConnection();
+
+    delete transport;
+
+    printf("%-14s p50=%7.2f us  p99=%7.2f us  max=%8.2f us  lost=%u\n",
+            label,
+            histogram.percentile(0.50) / 1e3,
+            histogram.percentile(0.99) / 1e3,
+            histogram.max() / 1e3,
+            lost);
+}
+
+int main(int argc, char ** argv)
+{
+    const uint32_t exchanges = argc > 1 ? atoi(argv[1]) : 20000;
+
+    printf("%u round trips of %u bytes out, 16 bytes back, %u hardware "
+            "threads\n\n",
+            exchanges, (unsigned)(Telemetry::SIZE * sizeof(double)),
+            std::thread::hardware_concurrency());
+
+    run("UDP", "127.0.0.1", exchanges);
+
+    run("Unix socket", "unix:/tmp/multisim-shmbench", exchanges);
+
+    run("shared memory", "shm:multisim-shmbench", exchanges);
+
+    return 0;
+}
@@ -12,7 +12,7 @@
 
 #include "../Source/MultiSim/sockets/UdpClientSocket.hpp"
 #include "../Source/MultiSim/sockets/UdpServerSocket.hpp"
-#include "../Source/MultiSim/sockets/TcpClientSocket.hpp"
+#include "../Source/MultiSim/sockets/ImageStream.hpp"
 #include "../Source/MultiSim/dynamics/fixedpitch/QuadXBF.hpp"
 
 // Comms
@@ -42,7 +42,9 @@ static Dynamics::vehicle_params_t vparams = {
     3,      // Iz [kg*m^2] 
     38E-04, // Jr prop inertial [kg*m^2] 
 
-    15000 // maxrpm
+    15000,  // maxrpm
+
+    20      // maxspeed [m/s]
 };
 
 static FixedPitchDynamics::fixed_pitch_params_t fparams = {
@@ -74,7 +76,7 @@ int main(int argc, char ** argv)
         UdpServerSocket(MOTOR_PORT);
 
     // Create one-way server for images out
-    TcpClientSocket imageSocket = TcpClientSocket(HOST, IMAGE_PORT);
+    ImageSender imageSocket = ImageSender(HOST, IMAGE_PORT);
 
     // Create quadcopter dynamics model
     QuadXBFDynamics dynamics =
@@ -97,19 +99,20 @@ int main(int argc, char ** argv)
         // First value is time
         telemetry[0] = time;
 
-        // Next 12 values are 12D state vector
-        telemetry[1] = dynamics.vstate.x;
-        telemetry[2] = dynamics.vstate.dx;
-        telemetry[3] = dynamics.vstate.y;
-        telemetry[4] = dynamics.vstate.dy;
-        telemetry[5] = dynamics.vstate.z;
-        telemetry[6] = dynamics.vstate.dz;
-        telemetry[7] = dynamics.vstate.phi;
-        telemetry[8] = dynamics.vstate.dphi;
-        telemetry[9] = dynamics.vstate.theta;
-        telemetry[10] = dynamics.vstate.dtheta;
-        telemetry[11] = dynamics.vstate.psi;
-        telemetry[12] = dynamics.vstate.dpsi;
+        // Next 12 values are 12D state vector, z and dz NED (down positive)
+        // as simproxy has always sent them, unlike the simulator's ENU
+        telemetry[1] = dynamics.getStateX();
+        telemetry[2] = dynamics.getStateDx();
+        telemetry[3] = dynamics.getStateY();
+        telemetry[4] = dynamics.getStateDy();
+        telemetry[5] = -dynamics.getStateZ();
+        telemetry[6] = -dynamics.getStateDz();
+        telemetry[7] = dynamics.getStatePhi();
+        telemetry[8] = dynamics.getStateDphi();
+        telemetry[9] = dynamics.getStateTheta();
+        telemetry[10] = dynamics.getStateDtheta();
+        telemetry[11] = dynamics.getStatePsi();
+        telemetry[12] = dynamics.getStateDpsi();
 
         // Last four values are receiver demands
         telemetry[13] = 0.1;
@@ -121,7 +124,8 @@ int main(int argc, char ** argv)
         telemClient.sendData(telemetry, sizeof(telemetry));
 
         // Send image data
-        // imageSocket.sendData(image, sizeof(image));
+        // imageSocket.sendFrame(image, IMAGE_COLS, IMAGE_ROWS,
+        //         ImageStream::PIXEL_RGBA8);
 
         // Get incoming motor values
         float motorvals[4] = {};
@@ -133,7 +137,7 @@ int main(int argc, char ** argv)
                 motorvals[1],
                 motorvals[2],
                 motorvals[3],
-                dynamics.vstate.z);
+                -dynamics.getStateZ());
 
         // Update dynamics with motor values
         dynamics.update(motorvals, DELTA_T);
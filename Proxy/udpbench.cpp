@@ -0,0 +1,368 @@
+/*
+   Benchmark for UdpBatchSocket: exchanges telemetry and motor packets for
+   many vehicles between a simulator and a controller over loopback, first
+   with a pair of UDP sockets per vehicle on each side, as ControllerLink
+   does, then with one batched socket per side, and reports packets per
+   second and system calls per cycle.  Last, it flies the simulator side
+   as the simulator does, with a ControllerLink per vehicle on a
+   SimulationExecutor, their I/O batched by a ControllerBatch, and reports
+   system calls per frame and motor messages that never came.
+
+   Usage: udpbench [VEHICLES [CYCLES]]
+
+   Copyright(C) 2023 Simon D.Levy
+
+   MIT License
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../Source/MultiSim/ControllerBatch.hpp"
+#include "../Source/MultiSim/Telemetry.hpp"
+#include "../Source/MultiSim/sockets/UdpBatchSocket.hpp"
+#include "../Source/MultiSim/sockets/UdpClientSocket.hpp"
+#include "../Source/MultiSim/sockets/UdpServerSocket.hpp"
+
+static const char * HOST = "127.0.0.1";
+
+// Per-vehicle sockets use ports from here up
+static const short MOTOR_PORT = 6000;
+static const short TELEM_PORT = 7000;
+
+// Batched sockets
+static const short SIMULATOR_PORT = 5200;
+static const short CONTROLLER_PORT = 5201;
+
+// ControllerBatch on an executor
+static const short BATCH_MOTOR_PORT = 5202;
+static const short BATCH_TELEM_PORT = 5203;
+static const double FRAME_RATE = 1000;
+
+static const uint32_t TIMEOUT_MSEC = 100;
+
+static double now(void)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(
+        const char * label,
+        const uint32_t vehicles,
+        const uint32_t cycles,
+        const double elapsed,
+        const uint64_t syscalls,
+        const uint64_t mismatches)
+{
+    printf("%-18s %9.0f packets/sec  %7.1f syscalls/cycle  "
+            "%llu mismatched\n",
+            label,
+            2. * vehicles * cycles / elapsed,
+            (double)syscalls / cycles,
+            (unsigned long long)mismatches);
+}
+
+static void runSockets(const uint32_t vehicles, const uint32_t cycles)
+{
+    std::vector<UdpClientSocket *> simTelem, ctlMotors;
+    std::vector<UdpServerSocket *> simMotors, ctlTelem;
+
+    for (uint32_t k=0; k<vehicles; ++k) {
+        simTelem.push_back(new UdpClientSocket(HOST, TELEM_PORT + k));
+        simMotors.push_back(
+                new UdpServerSocket(MOTOR_PORT + k, TIMEOUT_MSEC));
+        ctlTelem.push_back(
+                new UdpServerSocket(TELEM_PORT + k, TIMEOUT_MSEC));
+        ctlMotors.push_back(new UdpClientSocket(HOST, MOTOR_PORT + k));
+    }
+
+    uint64_t mismatches = 0;
+
+    const auto start = now();
+
+    for (uint32_t c=0; c<cycles; ++c) {
+
+        // Simulator sends every vehicle's telemetry
+        for (uint32_t k=0; k<vehicles; ++k) {
+            double telemetry[Telemetry::SIZE] = {(double)c, (double)k};
+            simTelem[k]->sendData(telemetry, sizeof(telemetry));
+        }
+
+        // Controller answers each with motors
+        for (uint32_t k=0; k<vehicles; ++k) {
+            double telemetry[Telemetry::SIZE] = {};
+            ctlTelem[k]->receiveData(telemetry, sizeof(telemetry));
+            float motors[4] = {(float)telemetry[0], (float)telemetry[1]};
+            ctlMotors[k]->sendData(motors, sizeof(motors));
+        }
+
+        // Simulator collects the motors
+        for (uint32_t k=0; k<vehicles; ++k) {
+            float motors[4] = {};
+            if (!simMotors[k]->receiveData(motors, sizeof(motors)) ||
+                    motors[0] != (float)c || motors[1] != (float)k) {
+                mismatches++;
+            }
+        }
+    }
+
+    const auto elapsed = now() - start;
+
+    for (uint32_t k=0; k<vehicles; ++k) {
+        UdpClientSocket::free(simTelem[k]);
+        UdpServerSocket::free(simMotors[k]);
+        UdpServerSocket::free(ctlTelem[k]);
+        UdpClientSocket::free(ctlMotors[k]);
+    }
+
+    report("socket per vehicle", vehicles, cycles, elapsed,
+            4ull * vehicles * cycles, mismatches);
+}
+
+// Simulator side: keeps the latest motors for one vehicle
+class MotorReceiver : public UdpBatchSocket::Receiver {
+
+    public:
+
+        float motors[4] = {};
+
+        uint32_t count = 0;
+
+        virtual void receive(const void * payload, size_t len) override
+        {
+            memcpy(motors, payload, len < sizeof(motors) ?
+                    len : sizeof(motors));
+            count++;
+        }
+};
+
+// Controller side: answers each telemetry message with motors
+class TelemetryReceiver : public UdpBatchSocket::Receiver {
+
+    public:
+
+        UdpBatchSocket * socket = NULL;
+
+        uint32_t id = 0;
+
+        virtual void receive(const void * payload, size_t len) override
+        {
+            double telemetry[Telemetry::SIZE] = {};
+            memcpy(telemetry, payload, len < sizeof(telemetry) ?
+                    len : sizeof(telemetry));
+
+            float motors[4] = {(float)telemetry[0], (float)telemetry[1]};
+            socket->queue(id, motors, sizeof(motors));
+        }
+};
+
+static void runBatched(const uint32_t vehicles, const uint32_t cycles)
+{
+    UdpBatchSocket simulator(SIMULATOR_PORT);
+    UdpBatchSocket controller(CONTROLLER_PORT);
+
+    if (*simulator.getMessage() || *controller.getMessage()) {
+        printf("batched: %s%s\n",
+                simulator.getMessage(), controller.getMessage());
+        return;
+    }
+
+    std::vector<MotorReceiver> motorReceivers(vehicles);
+    std::vector<TelemetryReceiver> telemReceivers(vehicles);
+
+    for (uint32_t k=0; k<vehicles; ++k) {
+
+        simulator.addVehicle(k, HOST, CONTROLLER_PORT, &motorReceivers[k]);
+
+        telemReceivers[k].socket = &controller;
+        telemReceivers[k].id = k;
+        controller.addVehicle(k, HOST, SIMULATOR_PORT, &telemReceivers[k]);
+    }
+
+    uint64_t mismatches = 0;
+
+    const auto start = now();
+
+    for (uint32_t c=0; c<cycles; ++c) {
+
+        for (uint32_t k=0; k<vehicles; ++k) {
+            double telemetry[Telemetry::SIZE] = {(double)c, (double)k};
+            simulator.queue(k, telemetry, sizeof(telemetry));
+        }
+
+        simulator.flush();
+
+        controller.drain();
+        controller.flush();
+
+        simulator.drain();
+
+        for (uint32_t k=0; k<vehicles; ++k) {
+            auto & receiver = motorReceivers[k];
+            if (receiver.count != c + 1 ||
+                    receiver.motors[0] != (float)c ||
+                    receiver.motors[1] != (float)k) {
+                mismatches++;
+            }
+        }
+    }
+
+    const auto elapsed = now() - start;
+
+    const auto s = simulator.stats();
+    const auto t = controller.stats();
+
+    report("batched", vehicles, cycles, elapsed,
+            s.sendCalls + s.recvCalls + t.sendCalls + t.recvCalls,
+            mismatches + s.unrouted + t.unrouted);
+
+    if (s.dropped + t.dropped > 0) {
+        printf("%-18s %llu packets dropped with the socket buffer full\n",
+                "", (unsigned long long)(s.dropped + t.dropped));
+    }
+}
+
+// Simulator side of the executor run: posts telemetry every frame, and
+// takes whatever motors the batch has handed its link
+class LinkTask : public SimulationTask {
+
+    public:
+
+        ControllerLink * link = NULL;
+
+        uint32_t id = 0;
+
+        virtual void tick(void) override
+        {
+            float motors[4] = {};
+            link->receive(motors);
+
+            StateChannel::state_t state = {};
+            state.x = id;
+
+            const float joyvals[4] = {};
+            link->post(state, joyvals);
+        }
+};
+
+static void runExecutor(const uint32_t vehicles, const uint32_t cycles)
+{
+    UdpBatchSocket controller(BATCH_TELEM_PORT);
+
+    if (*controller.getMessage()) {
+        printf("executor: %s\n", controller.getMessage());
+        return;
+    }
+
+    std::vector<TelemetryReceiver> telemReceivers(vehicles);
+
+    for (uint32_t k=0; k<vehicles; ++k) {
+        telemReceivers[k].socket = &controller;
+        telemReceivers[k].id = k;
+        controller.addVehicle(
+                k, HOST, BATCH_MOTOR_PORT, &telemReceivers[k]);
+    }
+
+    // Answers as it goes, like a flight controller would
+    std::atomic<bool> running(true);
+
+    std::thread answering([&] {
+            while (running.load()) {
+                controller.drain();
+                controller.flush();
+                std::this_thread::yield();
+            }
+        });
+
+    SimulationExecutor executor(1, FRAME_RATE);
+
+    std::vector<LinkTask> tasks(vehicles);
+
+    ControllerBatch * batch = NULL;
+
+    for (uint32_t k=0; k<vehicles; ++k) {
+
+        auto & task = tasks[k];
+
+        task.link = new ControllerLink(4, Telemetry::FORMAT_RAW);
+        task.id = k;
+
+        uint32_t id = 0;
+        batch = ControllerBatch::join(executor, task.link, HOST,
+                BATCH_MOTOR_PORT, BATCH_TELEM_PORT, id);
+
+        task.link->start();
+    }
+
+    if (*batch->getMessage()) {
+        printf("executor: %s\n", batch->getMessage());
+    }
+
+    const auto start = now();
+
+    for (auto & task : tasks) {
+        executor.add(&task);
+    }
+
+    std::this_thread::sleep_for(
+            std::chrono::duration<double>(cycles / FRAME_RATE));
+
+    for (auto & task : tasks) {
+        executor.remove(&task);
+    }
+
+    const auto elapsed = now() - start;
+
+    const auto frames = batch->frames();
+    const auto s = batch->stats();
+
+    uint64_t packets = 0;
+    uint64_t missing = 0;
+
+    for (uint32_t k=0; k<vehicles; ++k) {
+
+        const auto counters = tasks[k].link->counters();
+
+        packets += counters.sent + counters.received;
+        missing += counters.missing;
+
+        ControllerBatch::leave(batch, k);
+
+        delete tasks[k].link;
+    }
+
+    running.store(false);
+    answering.join();
+
+    printf("%-18s %9.0f packets/sec  %7.1f syscalls/frame  "
+            "%llu missing over %llu frames\n",
+            "executor",
+            packets / elapsed,
+            (double)(s.sendCalls + s.recvCalls) / frames,
+            (unsigned long long)missing,
+            (unsigned long long)frames);
+}
+
+int main(int argc, char ** argv)
+{
+    const uint32_t vehicles = argc > 1 ? atoi(argv[1]) : 50;
+    const uint32_t cycles = argc > 2 ? atoi(argv[2]) : 2000;
+
+    printf("%u vehicles, %u cycles of telemetry out and motors back\n\n",
+            vehicles, cycles);
+
+    runSockets(vehicles, cycles);
+
+    runBatched(vehicles, cycles);
+
+    runExecutor(vehicles, cycles);
+
+    return 0;
+}
@@ -1,6 +1,9 @@
 /*
  * Camera class for MultiSim
  *
+ * Streams each frame it grabs over TCP, framed as described in
+ * sockets/ImageStream.hpp
+ *
  * Copyright (C) 2019 Simon D. Levy
  *
  * MIT License
@@ -10,8 +13,11 @@
 
 #define WIN32_LEAN_AND_MEAN
 
+#include <stdlib.h>
+
+#include "Trace.hpp"
 #include "Utils.hpp"
-#include "sockets/TcpClientSocket.hpp"
+#include "sockets/ImageStream.hpp"
 
 class Camera {
 
@@ -35,8 +41,17 @@ class Camera {
         static constexpr char * HOST = "127.0.0.1"; // localhost
         static constexpr uint16_t PORT = 5002;
 
+        // MULTISIM_IMAGE_HOST can name another host, or a Unix-domain
+        // socket with unix:PATH
+        static const char * imageHost(void)
+        {
+            const char * host = getenv("MULTISIM_IMAGE_HOST");
+
+            return host && *host ? host : HOST;
+        }
+
         // Create one-way TCP socket server for images out
-        TcpClientSocket imageSocket = TcpClientSocket(HOST, PORT);
+        ImageSender imageSocket = ImageSender(imageHost(), PORT);
 
         // Default position w.r.t vehicle
         static constexpr float X = 0.2;
@@ -49,8 +64,8 @@ class Camera {
 
         Resolution_t _res;
 
-        // Byte array for RGBA image
-        uint8_t * _imageBytes = NULL;
+        // Set in addToVehicle(), and sent with each frame
+        uint8_t _id = 0;
 
         // Image size and field of view, set in constructor
         uint16_t _rows = 0;
@@ -145,6 +160,8 @@ class Camera {
                 }
             };
 
+            _id = id;
+
             UTextureRenderTarget2D * textureRenderTarget2D =
                 cameraTextureObjects[_res][id].Object;
 
@@ -167,15 +184,27 @@ class Camera {
         // Called on main thread
         void grabImage(void)
         {
+            TRACE_SCOPE("grabImage");
+
+            // Reading pixels stalls for the render thread, so skip it
+            // when nobody is listening
+            if (!imageSocket.isConnected()) {
+                return;
+            }
+
             // Read the pixels from the RenderTarget
             TArray<FColor> renderTargetPixels;
             _renderTarget->ReadPixels(renderTargetPixels);
 
-            // Copy the RBGA pixels to the private image
-            FMemory::Memcpy(_imageBytes, renderTargetPixels.GetData(), _rows*_cols*4);
+            // Copy the BGRA pixels to a buffer the kernel can send from
+            // after we return
+            const auto size = _rows*_cols*4;
+            auto pixels = imageSocket.acquire(size);
+            FMemory::Memcpy(pixels, renderTargetPixels.GetData(), size);
 
             // Send image data
-            imageSocket.sendData(_imageBytes, _rows*_cols*4);
+            imageSocket.sendFrame(pixels, _cols, _rows,
+                    ImageStream::PIXEL_BGRA8, _id);
         }
 
     public:
@@ -200,9 +229,6 @@ class Camera {
             _y = y;
             _z = z;
 
-            // Create a byte array sufficient to hold the RGBA image
-            _imageBytes = new uint8_t [_rows*_cols*4]();
-
             // These will be set in Vehicle::addCamera()
             _captureComponent = NULL;
             _renderTarget = NULL;
@@ -211,11 +237,6 @@ class Camera {
             imageSocket.openConnection();
         }
 
-        ~Camera()
-        {
-            delete _imageBytes;
-        }
-
         // Sets current FOV
         void setFov(float fov)
         {
@@ -0,0 +1,169 @@
+/*
+ * Fixed-timestep simulation clock
+ *
+ * Converts jittery wall-clock time into a whole number of fixed-size physics
+ * steps, carrying the fractional remainder over to the next wakeup.  The
+ * number of steps per wakeup is capped, so the cost of a wakeup is bounded;
+ * the policy decides whether time beyond the cap is made up later or
+ * dropped.
+ *
+ * Platform-independent; wall-clock time is supplied by the caller.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+class SimulationClock {
+
+    public:
+
+        /**
+         * What to do with time beyond the substep cap
+         */
+        typedef enum {
+
+            POLICY_CATCH_UP, // keep it, and run extra steps on later wakeups
+            POLICY_DROP      // discard it, letting simulated time fall behind
+
+        } policy_t;
+
+    private:
+
+        double _dt = 0;
+
+        uint32_t _maxSubsteps = 0;
+
+        policy_t _policy = POLICY_CATCH_UP;
+
+        // Wall-clock time of previous wakeup
+        double _previousTime = 0;
+
+        // Wall-clock time not yet simulated
+        double _accumulator = 0;
+
+        uint64_t _steps = 0;
+
+        // Wall-clock time discarded under POLICY_DROP
+        double _droppedTime = 0;
+
+    public:
+
+        /**
+         * @param rate physics rate in Hz
+         * @param maxSubsteps maximum steps per wakeup
+         * @param policy what to do with time beyond maxSubsteps
+         */
+        SimulationClock(
+                const double rate=10000,
+                const uint32_t maxSubsteps=50,
+                const policy_t policy=POLICY_CATCH_UP)
+        {
+            _dt = 1 / rate;
+            _maxSubsteps = maxSubsteps;
+            _policy = policy;
+        }
+
+        /**
+         * Starts simulated time at zero.
+         *
+         * @param wallTime current wall-clock time in seconds
+         */
+        void start(const double wallTime)
+        {
+            _previousTime = wallTime;
+            _accumulator = 0;
+            _steps = 0;
+            _droppedTime = 0;
+        }
+
+        /**
+         * Accumulates the wall-clock time since the previous call.
+         *
+         * @param wallTime current wall-clock time in seconds
+         * @return number of fixed steps to run now
+         */
+        uint32_t advance(const double wallTime)
+        {
+            const auto elapsed = wallTime - _previousTime;
+
+            _previousTime = wallTime;
+
+            // Guard against clocks going backward
+            _accumulator += elapsed > 0 ? elapsed : 0;
+
+            const auto due = floor(_accumulator / _dt);
+
+            auto steps = (uint32_t)(due < _maxSubsteps ? due : _maxSubsteps);
+
+            _accumulator -= steps * _dt;
+
+            // Keep only the fractional step under POLICY_DROP
+            if (_policy == POLICY_DROP && _accumulator >= _dt) {
+                const auto remainder = fmod(_accumulator, _dt);
+                _droppedTime += _accumulator - remainder;
+                _accumulator = remainder;
+            }
+
+            _steps += steps;
+
+            return steps;
+        }
+
+        /**
+         * Takes fixed steps without reference to wall-clock time, for
+         * running faster than real time.
+         *
+         * @param steps number of fixed steps taken
+         */
+        void step(const uint32_t steps=1)
+        {
+            _steps += steps;
+        }
+
+        /**
+         * @return fixed time step in seconds
+         */
+        double dt(void)
+        {
+            return _dt;
+        }
+
+        /**
+         * @return simulated time in seconds
+         */
+        double time(void)
+        {
+            return _steps * _dt;
+        }
+
+        /**
+         * @return total fixed steps taken
+         */
+        uint64_t steps(void)
+        {
+            return _steps;
+        }
+
+        /**
+         * @return wall-clock time in seconds still waiting to be simulated
+         */
+        double backlog(void)
+        {
+            return _accumulator;
+        }
+
+        /**
+         * @return wall-clock time in seconds discarded under POLICY_DROP
+         */
+        double droppedTime(void)
+        {
+            return _droppedTime;
+        }
+
+}; // class SimulationClock
@@ -0,0 +1,301 @@
+/*
+ * Controller I/O batched for every vehicle on a SimulationExecutor
+ *
+ * Instead of each vehicle having a pair of UDP sockets and an I/O thread,
+ * vehicles on the same executor share one UdpBatchSocket.  At the start of
+ * each frame, before the vehicles are ticked, the executor's leading
+ * worker takes every motor packet waiting with recvmmsg(), hands each
+ * vehicle its newest, and sends every vehicle's pending telemetry with one
+ * sendmmsg().  So a frame costs a few system calls however many vehicles
+ * there are.
+ *
+ * Every packet starts with the UdpBatchSocket header naming its vehicle;
+ * vehicles are numbered from zero in the order they join.  Motors for all
+ * of them come in on the motor port of the first to join, and each
+ * vehicle's telemetry goes to its own host and telemetry port.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <mutex>
+#include <vector>
+
+#include "ControllerLink.hpp"
+#include "Executor.hpp"
+#include "Telemetry.hpp"
+#include "sockets/UdpBatchSocket.hpp"
+
+class ControllerBatch : public SimulationTask {
+
+    private:
+
+        // Newest motor message for one vehicle, from this frame's drain
+        class Inbox final : public UdpBatchSocket::Receiver {
+
+            public:
+
+                uint8_t message[UdpBatchSocket::PAYLOAD_BYTES] = {};
+
+                size_t len = 0;
+
+                // Messages received this frame
+                uint32_t count = 0;
+
+                virtual void receive(const void * payload, size_t len)
+                    override
+                {
+                    memcpy(message, payload, len);
+
+                    this->len = len;
+
+                    count++;
+                }
+
+        }; // class Inbox
+
+        typedef struct {
+
+            // NULL once the vehicle has left
+            ControllerLink * link;
+
+            Inbox * inbox;
+
+        } member_t;
+
+        SimulationExecutor * _executor = NULL;
+
+        UdpBatchSocket _socket;
+
+        // Guards the socket and members against join() and leave() during
+        // a frame
+        std::mutex _mutex;
+
+        // Indexed by vehicle id
+        std::vector<member_t> _members;
+
+        uint32_t _active = 0;
+
+        uint64_t _frames = 0;
+
+        // One batch per executor
+        static std::mutex & registryMutex(void)
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static std::vector<ControllerBatch *> & registry(void)
+        {
+            static std::vector<ControllerBatch *> batches;
+            return batches;
+        }
+
+        ControllerBatch(SimulationExecutor & executor, const short motorPort)
+            : _socket(motorPort)
+        {
+            _executor = &executor;
+        }
+
+        ~ControllerBatch(void)
+        {
+            for (auto & member : _members) {
+                delete member.inbox;
+            }
+
+            _socket.closeConnection();
+        }
+
+    public:
+
+        ControllerBatch(const ControllerBatch &) = delete;
+
+        ControllerBatch & operator=(const ControllerBatch &) = delete;
+
+        /**
+         * Adds a batched link to its executor's batch, creating the batch
+         * (bound to motorPort) for the executor's first vehicle.  Call
+         * before registering the vehicle with the executor.
+         *
+         * @param executor executor the vehicle runs on
+         * @param link link made without a transport
+         * @param host flight controller host
+         * @param motorPort port for motors in, if the batch is new
+         * @param telemPort port for this vehicle's telemetry out
+         * @param id output: the vehicle's id in packet headers
+         * @return the batch
+         */
+        static ControllerBatch * join(
+                SimulationExecutor & executor,
+                ControllerLink * link,
+                const char * host,
+                const short motorPort,
+                const short telemPort,
+                uint32_t & id)
+        {
+            std::lock_guard<std::mutex> registryLock(registryMutex());
+
+            ControllerBatch * batch = NULL;
+
+            for (auto candidate : registry()) {
+                if (candidate->_executor == &executor) {
+                    batch = candidate;
+                }
+            }
+
+            if (!batch) {
+
+                batch = new ControllerBatch(executor, motorPort);
+
+                registry().push_back(batch);
+
+                executor.setFrameHook(batch);
+            }
+
+            std::lock_guard<std::mutex> lock(batch->_mutex);
+
+            id = (uint32_t)batch->_members.size();
+
+            auto inbox = new Inbox();
+
+            batch->_members.push_back(member_t {link, inbox});
+
+            batch->_socket.addVehicle(id, host, telemPort, inbox);
+
+            batch->_active++;
+
+            return batch;
+        }
+
+        /**
+         * Takes a vehicle out of its batch, telling its flight controller
+         * we're done, and deletes the batch once no vehicle is left.  Call
+         * after taking the vehicle off the executor.
+         */
+        static void leave(ControllerBatch * batch, const uint32_t id)
+        {
+            std::lock_guard<std::mutex> registryLock(registryMutex());
+
+            bool empty = false;
+
+            {
+                std::lock_guard<std::mutex> lock(batch->_mutex);
+
+                auto & member = batch->_members[id];
+
+                uint8_t telemetry[Telemetry::MAX_BYTES] = {};
+
+                const auto size = member.link->haltTelemetry(telemetry);
+
+                batch->_socket.queue(id, telemetry, size);
+                batch->_socket.flush();
+
+                // Ids stay put; this one's packets are dropped from now on
+                batch->_socket.addVehicle(id, "0.0.0.0", 0, NULL);
+
+                member.link = NULL;
+
+                empty = --batch->_active == 0;
+            }
+
+            if (!empty) {
+                return;
+            }
+
+            // Returns once no frame is ticking the batch
+            batch->_executor->setFrameHook(NULL);
+
+            auto & batches = registry();
+
+            for (size_t k=0; k<batches.size(); ++k) {
+                if (batches[k] == batch) {
+                    batches.erase(batches.begin() + k);
+                    break;
+                }
+            }
+
+            delete batch;
+        }
+
+        // SimulationTask interface: called by the executor's leader at the
+        // start of each frame
+        virtual void tick(void) override
+        {
+            TRACE_SCOPE("controller batch");
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _frames++;
+
+            // Motors first, so that they're there for this frame's
+            // dynamics
+            _socket.drain();
+
+            for (auto & member : _members) {
+
+                auto inbox = member.inbox;
+
+                if (inbox->count == 0) {
+                    continue;
+                }
+
+                if (member.link) {
+                    member.link->deliverMotors(
+                            inbox->message, inbox->len, inbox->count - 1);
+                }
+
+                inbox->count = 0;
+            }
+
+            for (uint32_t id=0; id<_members.size(); ++id) {
+
+                auto link = _members[id].link;
+
+                if (!link) {
+                    continue;
+                }
+
+                uint8_t telemetry[Telemetry::MAX_BYTES] = {};
+
+                const auto size = link->nextTelemetry(telemetry);
+
+                if (size) {
+                    _socket.queue(id, telemetry, size);
+                }
+            }
+
+            _socket.flush();
+        }
+
+        /**
+         * @return why the socket failed to open, or an empty string
+         */
+        const char * getMessage(void)
+        {
+            return _socket.getMessage();
+        }
+
+        /**
+         * @return frames ticked so far
+         */
+        uint64_t frames(void)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            return _frames;
+        }
+
+        UdpBatchSocket::stats_t stats(void)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            return _socket.stats();
+        }
+
+}; // class ControllerBatch
@@ -0,0 +1,968 @@
+/*
+ * Network I/O thread for talking to the flight controller
+ *
+ * The dynamics thread posts a telemetry request whenever a controller update
+ * is due, and picks up the newest motor values whenever they arrive; both
+ * hand-offs are lock-free, so dynamics keep their rate however slow (or
+ * dead) the flight controller is.  Sending telemetry and waiting for motors
+ * happen here, on a thread of their own.  Having got motor values, the I/O
+ * thread takes any others already queued behind them and keeps only the
+ * newest, so a controller that sends faster than we ask can't leave the
+ * dynamics flying on ever older commands.
+ *
+ * Alternatively, in lockstep mode, there is no I/O thread: the dynamics
+ * thread calls exchange() every K steps, and waits for the motor packet
+ * that echoes the sequence number of its telemetry.  Given the same flight
+ * controller, every run is then the same, and runs as fast as the flight
+ * controller answers.
+ *
+ * Or, in synchronous mode, there is again no I/O thread: the dynamics thread
+ * calls update() at each controller update, which sends telemetry and waits
+ * for motors just as the I/O thread would, then applies them at once.
+ *
+ * Or, for vehicles sharing a SimulationExecutor, there is no I/O thread or
+ * transport of our own either: a ControllerBatch sends the telemetry and
+ * hands over the motors for all of them at once, between frames.
+ *
+ * Messages go over UDP, or over shared memory to a controller on the same
+ * host (see Transport.hpp), either as raw arrays or framed with sequence
+ * numbers and timestamps (see Telemetry.hpp).
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "Latency.hpp"
+#include "Placement.hpp"
+#include "StateChannel.hpp"
+#include "Telemetry.hpp"
+#include "Trace.hpp"
+#include "Transport.hpp"
+#include "TripleBuffer.hpp"
+
+class ControllerLink {
+
+    public:
+
+        /**
+         * Packet counters, updated by the I/O thread
+         */
+        typedef struct {
+
+            uint64_t requests; // telemetry requests posted by dynamics
+            uint64_t sent;     // telemetry messages sent
+            uint64_t received; // motor packets received
+            uint64_t skipped;  // requests overwritten before they were sent
+            uint64_t missing;  // motor packets that never came (timeout)
+            uint64_t late;     // motor packets that came after the next
+                               // request was already waiting (lockstep:
+                               // with an old sequence number)
+            uint64_t stale;    // motor packets superseded by a newer one
+                               // already queued behind them
+            uint64_t dropped;  // queued packets of the wrong size, or
+                               // (framed) not motor messages
+            uint64_t lost;     // framed motor messages that never came,
+                               // from gaps in their sequence numbers
+            uint64_t reordered;// framed motor messages older than one
+                               // already received
+
+        } counters_t;
+
+    private:
+
+        // Sent to the flight controller
+        typedef struct {
+
+            StateChannel::state_t state;
+
+            float joyvals[4];
+
+            uint64_t sequence;
+
+        } request_t;
+
+        // Big enough for a motor message of any format
+        typedef uint8_t motor_message_t[sizeof(WireProtocol::header_t) +
+            sizeof(float) * (Dynamics::MAX_ROTORS + 1)];
+
+        typedef struct {
+
+            float values[Dynamics::MAX_ROTORS];
+
+            // When the telemetry they answer went out
+            LatencyStage::clock_t::time_point sent;
+
+        } motors_t;
+
+        // Dynamics => I/O
+        TripleBuffer<request_t> _requests;
+
+        // I/O => dynamics
+        TripleBuffer<motors_t> _motors;
+
+        // Wakes the I/O thread when a request is posted
+        std::mutex _mutex;
+        std::condition_variable _posted;
+
+        // Also bounds how long a lost wakeup can delay a request
+        static const uint32_t WAIT_MSEC = 1;
+
+        // Telemetry out, motors in: UDP or shared memory; NULL when a
+        // ControllerBatch carries our messages
+        ControllerTransport * _transport = NULL;
+
+        uint8_t _actuatorCount = 0;
+
+        std::thread _thread;
+
+        std::atomic<bool> _running;
+        std::atomic<bool> _halted;
+
+        // Lockstep mode: an exchange() is in progress on the dynamics thread
+        std::atomic<bool> _exchanging;
+
+        bool _lockstep = false;
+
+        bool _synchronous = false;
+
+        Telemetry::format_t _format = Telemetry::FORMAT_RAW;
+
+        // Written by the dynamics thread only
+        uint64_t _sequence = 0;
+
+        // Newest request taken for sending
+        uint64_t _lastSequence = 0;
+
+        // Batched: when the newest telemetry went out, and whether motors
+        // have answered it yet
+        LatencyStage::clock_t::time_point _batchSent = {};
+        bool _awaiting = false;
+
+        // Framed messages: ours, and the newest of the controller's;
+        // written by whichever thread is talking to the controller
+        uint32_t _wireSequence = 0;
+        uint32_t _wireAck = 0;
+        WireProtocol::SequenceTracker _wireTracker;
+
+        std::atomic<uint64_t> _requestCount;
+        std::atomic<uint64_t> _sentCount;
+        std::atomic<uint64_t> _receivedCount;
+        std::atomic<uint64_t> _skippedCount;
+        std::atomic<uint64_t> _missingCount;
+        std::atomic<uint64_t> _lateCount;
+        std::atomic<uint64_t> _staleCount;
+        std::atomic<uint64_t> _droppedCount;
+        std::atomic<uint64_t> _lostCount;
+        std::atomic<uint64_t> _reorderedCount;
+
+        // Packing and sending telemetry; waiting for motors
+        LatencyStage _telemetryLatency;
+        LatencyStage _motorLatency;
+
+        // From sending telemetry to the dynamics applying the motor values
+        // that answer it; recorded by the dynamics thread
+        LatencyStage _commandAge;
+
+        // Framed motor messages, from their wall-clock timestamps
+        LatencyStage _oneWayLatency;
+
+        // What the I/O thread got of the placement asked for
+        ThreadPlacement::config_t _placement = {};
+        ThreadPlacement::report_t _placementReport = {};
+
+        static void bump(std::atomic<uint64_t> & counter, uint64_t n=1)
+        {
+            counter.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        // Fills a telemetry message in our format, returning its size
+        size_t packTelemetry(
+                const StateChannel::state_t & state,
+                const float * joyvals,
+                const uint32_t sequence,
+                uint8_t message[Telemetry::MAX_BYTES],
+                const bool halt=false)
+        {
+            if (_format != Telemetry::FORMAT_RAW) {
+                return Telemetry::packWire(state, joyvals, sequence,
+                        _wireAck, _format, message, halt);
+            }
+
+            double telemetry[Telemetry::SEQUENCED_SIZE] = {};
+
+            Telemetry::pack(state, joyvals, telemetry);
+
+            if (halt) {
+                Telemetry::packHalt(telemetry);
+            }
+
+            if (_lockstep) {
+                Telemetry::packSequence(sequence, telemetry);
+            }
+
+            const auto size = _lockstep ?
+                sizeof(telemetry) : Telemetry::SIZE * sizeof(double);
+
+            memcpy(message, telemetry, size);
+
+            return size;
+        }
+
+        // Lockstep exchange proper, for exchange()
+        bool sendAndWait(
+                const StateChannel::state_t & state,
+                const float * joyvals,
+                float * actuators)
+        {
+            const auto sequence = (uint32_t)++_sequence;
+
+            const auto packStart = LatencyStage::clock_t::now();
+
+            uint8_t telemetry[Telemetry::MAX_BYTES] = {};
+
+            const auto telemetrySize =
+                packTelemetry(state, joyvals, sequence, telemetry);
+
+            _wireSequence = sequence;
+
+            bump(_requestCount);
+
+            // Framed replies carry the sequence number in their header
+            const auto size = _format == Telemetry::FORMAT_RAW ?
+                Telemetry::sequencedMotorSize(_actuatorCount) :
+                Telemetry::motorSize(_format, _actuatorCount);
+
+            // Waiting includes any resends
+            LatencyStage::clock_t::time_point waitStart = {};
+
+            while (_running.load(std::memory_order_acquire)) {
+
+                _transport->sendData(telemetry, telemetrySize);
+
+                if (waitStart == LatencyStage::clock_t::time_point()) {
+                    waitStart = LatencyStage::clock_t::now();
+                    _telemetryLatency.record(packStart, waitStart);
+                }
+
+                bump(_sentCount);
+
+                motor_message_t message = {};
+
+                float values[Dynamics::MAX_ROTORS] = {};
+
+                while (_transport->receiveData(message, size)) {
+
+                    bool halt = false;
+
+                    uint32_t answered = 0;
+
+                    if (_format == Telemetry::FORMAT_RAW) {
+
+                        memcpy(values, message,
+                                sizeof(float) * _actuatorCount);
+
+                        // Server sends a -1 to halt
+                        halt = Telemetry::isHalt(values);
+
+                        answered = Telemetry::unpackSequence(
+                                message, _actuatorCount);
+                    }
+
+                    else {
+
+                        WireProtocol::header_t header = {};
+
+                        if (!unpackWire(message, 0, values, header)) {
+                            continue;
+                        }
+
+                        halt = header.flags & WireProtocol::FLAG_HALT;
+
+                        answered = header.ack;
+                    }
+
+                    if (halt) {
+                        _halted.store(true, std::memory_order_release);
+                        return false;
+                    }
+
+                    if (answered != sequence) {
+                        bump(_lateCount);
+                        continue;
+                    }
+
+                    bump(_receivedCount);
+
+                    const auto now = LatencyStage::clock_t::now();
+
+                    _motorLatency.record(waitStart, now);
+
+                    // Applied as soon as they come
+                    _commandAge.record(waitStart, now);
+
+                    memcpy(actuators, values,
+                            sizeof(float) * _actuatorCount);
+
+                    return true;
+                }
+
+                bump(_missingCount);
+            }
+
+            return false;
+        }
+
+        // Reads a framed motor message, counting any lost before it and
+        // timing its trip; false if it isn't a usable motor message
+        bool unpackWire(
+                const motor_message_t message,
+                const uint32_t stale,
+                float * values,
+                WireProtocol::header_t & header)
+        {
+            if (!Telemetry::unpackWireMotors(message,
+                        Telemetry::motorSize(_format, _actuatorCount),
+                        _actuatorCount, values, header)) {
+                bump(_droppedCount);
+                return false;
+            }
+
+            const auto end = LatencyStage::clock_t::now();
+
+            const auto trip = (int64_t)(WireProtocol::wallNow() -
+                    header.wallTime);
+
+            _oneWayLatency.record(end - std::chrono::nanoseconds(trip), end);
+
+            const auto lost = _wireTracker.observe(header.sequence, stale);
+
+            if (lost < 0) {
+                bump(_reorderedCount);
+                return false;
+            }
+
+            bump(_lostCount, lost);
+
+            _wireAck = header.sequence;
+
+            return true;
+        }
+
+        // Takes the newest request, if there is one, counting any it
+        // replaced, and packs its telemetry; zero with no request waiting
+        size_t takeRequest(uint8_t telemetry[Telemetry::MAX_BYTES])
+        {
+            request_t request = {};
+
+            if (!_requests.read(request)) {
+                return 0;
+            }
+
+            bump(_skippedCount, request.sequence - _lastSequence - 1);
+            _lastSequence = request.sequence;
+
+            return packTelemetry(request.state, request.joyvals,
+                    ++_wireSequence, telemetry);
+        }
+
+        // Hands the dynamics the motor values from a message answering
+        // telemetry sent at the given time; false if it tells us to halt
+        bool accept(
+                const motor_message_t message,
+                const uint32_t stale,
+                const LatencyStage::clock_t::time_point & sent)
+        {
+            motors_t motors = {};
+
+            motors.sent = sent;
+
+            bool halt = false;
+
+            if (_format == Telemetry::FORMAT_RAW) {
+
+                memcpy(motors.values, message,
+                        sizeof(float) * _actuatorCount);
+
+                // Server sends a -1 to halt
+                halt = Telemetry::isHalt(motors.values);
+            }
+
+            else {
+
+                WireProtocol::header_t header = {};
+
+                if (!unpackWire(message, stale, motors.values, header)) {
+                    return true;
+                }
+
+                halt = header.flags & WireProtocol::FLAG_HALT;
+            }
+
+            if (halt) {
+                _halted.store(true, std::memory_order_release);
+                return false;
+            }
+
+            // Dynamics already wanted a newer update by the time these came
+            if (_requests.hasFresh()) {
+                bump(_lateCount);
+            }
+
+            _motors.write(motors);
+
+            return true;
+        }
+
+        void run(std::promise<void> * placed)
+        {
+            TRACE_THREAD("controller io");
+
+            _placementReport = ThreadPlacement::apply(_placement);
+
+            placed->set_value();
+
+            uint8_t telemetry[Telemetry::MAX_BYTES] = {};
+
+            while (_running.load(std::memory_order_acquire)) {
+
+                const auto packStart = LatencyStage::clock_t::now();
+
+                const auto size = takeRequest(telemetry);
+
+                if (!size) {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _posted.wait_for(lock,
+                            std::chrono::milliseconds(WAIT_MSEC));
+                    continue;
+                }
+
+                if (!trade(telemetry, size, packStart)) {
+                    break;
+                }
+            }
+        }
+
+        // Sends telemetry packed at the given time and waits at most one
+        // receive timeout for motors, keeping the newest; false if they
+        // tell us to halt.  For run() and update().
+        bool trade(
+                uint8_t telemetry[Telemetry::MAX_BYTES],
+                const size_t size,
+                const LatencyStage::clock_t::time_point & packStart)
+        {
+            {
+                TRACE_SCOPE("send telemetry");
+
+                _transport->sendData(telemetry, size);
+            }
+
+            const auto sent = LatencyStage::clock_t::now();
+
+            _telemetryLatency.record(packStart, sent);
+
+            bump(_sentCount);
+
+            motor_message_t message = {};
+
+            bool received = false;
+
+            uint32_t stale = 0;
+            uint32_t dropped = 0;
+
+            {
+                TRACE_SCOPE("wait for motors");
+
+                received = _transport->receiveLatest(message,
+                        Telemetry::motorSize(_format, _actuatorCount),
+                        stale, dropped);
+            }
+
+            _motorLatency.record(sent, LatencyStage::clock_t::now());
+
+            bump(_droppedCount, dropped);
+
+            if (!received) {
+                bump(_missingCount);
+                return true;
+            }
+
+            bump(_receivedCount, 1 + stale);
+            bump(_staleCount, stale);
+
+            return accept(message, stale, sent);
+        }
+
+        void initialize(
+                const uint8_t actuatorCount,
+                const Telemetry::format_t format)
+        {
+            _format = format;
+
+            _actuatorCount = actuatorCount;
+
+            _running.store(false);
+            _halted.store(false);
+            _exchanging.store(false);
+
+            _requestCount.store(0);
+            _sentCount.store(0);
+            _receivedCount.store(0);
+            _skippedCount.store(0);
+            _missingCount.store(0);
+            _lateCount.store(0);
+            _staleCount.store(0);
+            _droppedCount.store(0);
+            _lostCount.store(0);
+            _reorderedCount.store(0);
+        }
+
+    public:
+
+        /**
+         * @param host flight controller host, "shm:NAME" for shared
+         *        memory, or "unix:PATH" for Unix-domain sockets
+         * @param motorPort port for motors in
+         * @param telemPort port for telemetry out
+         * @param actuatorCount motor values per packet
+         * @param timeoutMsec how long to wait for motors before counting
+         *        them missing
+         * @param format message format; by default from $MULTISIM_PROTOCOL
+         */
+        ControllerLink(
+                const char * host,
+                const short motorPort,
+                const short telemPort,
+                const uint8_t actuatorCount,
+                const uint32_t timeoutMsec=100,
+                const Telemetry::format_t format=
+                    Telemetry::formatFromEnvironment())
+            : _telemetryLatency("telemetry"),
+              _motorLatency("motors"),
+              _commandAge("cmd age"),
+              _oneWayLatency("one-way")
+        {
+            initialize(actuatorCount, format);
+
+            _transport = ControllerTransport::open(
+                    host, motorPort, telemPort, timeoutMsec);
+        }
+
+        /**
+         * For a link whose messages a ControllerBatch carries, along with
+         * other vehicles'.  There is no transport or I/O thread, and no
+         * lockstep mode.
+         *
+         * @param actuatorCount motor values per packet
+         * @param format message format; by default from $MULTISIM_PROTOCOL
+         */
+        ControllerLink(
+                const uint8_t actuatorCount,
+                const Telemetry::format_t format=
+                    Telemetry::formatFromEnvironment())
+            : _telemetryLatency("telemetry"),
+              _motorLatency("motors"),
+              _commandAge("cmd age"),
+              _oneWayLatency("one-way")
+        {
+            initialize(actuatorCount, format);
+        }
+
+        ControllerLink(const ControllerLink &) = delete;
+
+        ControllerLink & operator=(const ControllerLink &) = delete;
+
+        ~ControllerLink(void)
+        {
+            stop();
+
+            if (_transport) {
+
+                _transport->closeConnection();
+
+                delete _transport;
+            }
+        }
+
+        /**
+         * Starts the I/O thread, or readies the link for exchange().
+         *
+         * @param lockstep true for lockstep mode
+         * @param placement cores and priority for the I/O thread; returns
+         *        once the thread has applied them
+         */
+        void start(
+                const bool lockstep=false,
+                const ThreadPlacement::config_t & placement={})
+        {
+            _lockstep = lockstep;
+
+            _placement = placement;
+
+            _running.store(true, std::memory_order_release);
+
+            if (!lockstep && _transport) {
+
+                std::promise<void> placed;
+
+                _thread = std::thread(&ControllerLink::run, this, &placed);
+
+                placed.get_future().wait();
+            }
+        }
+
+        /**
+         * Readies the link for update(), with no I/O thread.
+         */
+        void startSynchronous(void)
+        {
+            _synchronous = true;
+
+            _running.store(true, std::memory_order_release);
+        }
+
+        /**
+         * Stops the I/O thread, or any exchange() in progress, waiting at
+         * most one receive timeout, and tells the flight controller we're
+         * done (batched, ControllerBatch tells it instead).
+         */
+        void stop(void)
+        {
+            if (!_running.exchange(false, std::memory_order_acq_rel)) {
+                return;
+            }
+
+            _posted.notify_one();
+
+            if (_thread.joinable()) {
+                _thread.join();
+            }
+
+            // In lockstep mode, the dynamics thread may be resending
+            // telemetry; the halt must not race it onto the transport
+            while (_exchanging.load()) {
+                std::this_thread::yield();
+            }
+
+            if (!_transport) {
+                return;
+            }
+
+            uint8_t telemetry[Telemetry::MAX_BYTES] = {};
+
+            const auto size = haltTelemetry(telemetry);
+
+            _transport->sendData(telemetry, size);
+        }
+
+        /**
+         * Packs a telemetry message telling the flight controller we're
+         * done, the same size as the others.
+         *
+         * @return message size in bytes
+         */
+        size_t haltTelemetry(uint8_t telemetry[Telemetry::MAX_BYTES])
+        {
+            const StateChannel::state_t state = {};
+            const float joyvals[4] = {};
+
+            return packTelemetry(
+                    state, joyvals, ++_wireSequence, telemetry, true);
+        }
+
+        /**
+         * Batched: takes the newest telemetry request, if one has come
+         * since the last call.  Called by ControllerBatch, which sends it.
+         *
+         * @param telemetry output
+         * @return message size in bytes, or zero with nothing to send
+         */
+        size_t nextTelemetry(uint8_t telemetry[Telemetry::MAX_BYTES])
+        {
+            if (!_running.load(std::memory_order_acquire)) {
+                return 0;
+            }
+
+            const auto packStart = LatencyStage::clock_t::now();
+
+            const auto size = takeRequest(telemetry);
+
+            if (!size) {
+                return 0;
+            }
+
+            // Nothing answered the previous one before this replaced it
+            if (_awaiting) {
+                bump(_missingCount);
+            }
+
+            _awaiting = true;
+
+            _batchSent = LatencyStage::clock_t::now();
+
+            _telemetryLatency.record(packStart, _batchSent);
+
+            bump(_sentCount);
+
+            return size;
+        }
+
+        /**
+         * Batched: hands over the newest motor message received for this
+         * vehicle.  Called by ControllerBatch.
+         *
+         * @param message motor message
+         * @param len its size in bytes
+         * @param stale older messages for this vehicle that it superseded
+         */
+        void deliverMotors(
+                const void * message,
+                const size_t len,
+                const uint32_t stale)
+        {
+            if (!_running.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            if (len != Telemetry::motorSize(_format, _actuatorCount)) {
+                bump(_droppedCount);
+                return;
+            }
+
+            bump(_receivedCount, 1 + stale);
+            bump(_staleCount, stale);
+
+            _motorLatency.record(_batchSent, LatencyStage::clock_t::now());
+
+            _awaiting = false;
+
+            motor_message_t copy = {};
+            memcpy(copy, message, len);
+
+            if (!accept(copy, stale, _batchSent)) {
+                _running.store(false, std::memory_order_release);
+            }
+        }
+
+        /**
+         * Asks for a controller update from the given state.  Called from
+         * the dynamics thread; never blocks.  A request not yet sent when
+         * the next is posted is replaced by it.
+         */
+        void post(const StateChannel::state_t & state, const float * joyvals)
+        {
+            request_t request = {};
+
+            request.state = state;
+            memcpy(request.joyvals, joyvals, sizeof(request.joyvals));
+            request.sequence = ++_sequence;
+
+            _requests.write(request);
+
+            bump(_requestCount);
+
+            // No lock: a wakeup lost to the race is made up by the timed
+            // wait in run()
+            _posted.notify_one();
+        }
+
+        /**
+         * Lockstep mode: sends telemetry for the given state and waits for
+         * the motor values answering it.  Motor packets answering earlier
+         * requests are discarded; on timeout the telemetry is sent again.
+         *
+         * @param state state to send
+         * @param joyvals stick demands
+         * @param actuators output
+         * @return true with new actuators; false if the flight controller
+         *         has halted or the link has been stopped
+         */
+        bool exchange(
+                const StateChannel::state_t & state,
+                const float * joyvals,
+                float * actuators)
+        {
+            // Tells stop() to wait for us before it sends the halt; checking
+            // _running only afterwards means either we see it cleared or
+            // stop() sees us here
+            _exchanging.store(true);
+
+            const auto result = _running.load() &&
+                sendAndWait(state, joyvals, actuators);
+
+            _exchanging.store(false);
+
+            return result;
+        }
+
+        /**
+         * Synchronous mode: sends telemetry for the given state and waits at
+         * most one receive timeout for motors, keeping the newest of any
+         * queued.  Called from the dynamics thread.
+         *
+         * @param state state to send
+         * @param joyvals stick demands
+         * @param actuators output, untouched when no motors came
+         * @return false once the flight controller has halted
+         */
+        bool update(
+                const StateChannel::state_t & state,
+                const float * joyvals,
+                float * actuators)
+        {
+            if (!_running.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            post(state, joyvals);
+
+            uint8_t telemetry[Telemetry::MAX_BYTES] = {};
+
+            const auto packStart = LatencyStage::clock_t::now();
+
+            const auto size = takeRequest(telemetry);
+
+            if (!trade(telemetry, size, packStart)) {
+                return false;
+            }
+
+            receive(actuators);
+
+            return true;
+        }
+
+        /**
+         * Picks up the newest motor values, if any have come since the last
+         * call.  Called from the dynamics thread; never blocks.
+         *
+         * @param actuators output, untouched when nothing new has come
+         * @return true if actuators were updated
+         */
+        bool receive(float * actuators)
+        {
+            motors_t motors = {};
+
+            if (!_motors.read(motors)) {
+                return false;
+            }
+
+            memcpy(actuators, motors.values, sizeof(float) * _actuatorCount);
+
+            _commandAge.record(motors.sent, LatencyStage::clock_t::now());
+
+            return true;
+        }
+
+        /**
+         * @return why the transport failed to open, or an empty string
+         */
+        const char * transportMessage(void)
+        {
+            return _transport ? _transport->getMessage() : "";
+        }
+
+        /**
+         * @return true once the flight controller has asked us to halt
+         */
+        bool halted(void)
+        {
+            return _halted.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @return latency of packing and sending telemetry, recorded by the
+         *         I/O thread (or the caller of exchange() or update())
+         */
+        LatencyStage & telemetryLatency(void)
+        {
+            return _telemetryLatency;
+        }
+
+        /**
+         * @return time from sending telemetry to getting motors back
+         */
+        LatencyStage & motorLatency(void)
+        {
+            return _motorLatency;
+        }
+
+        /**
+         * @return time from the flight controller sending motor values to
+         *         our receiving them, for framed messages
+         */
+        LatencyStage & oneWayLatency(void)
+        {
+            return _oneWayLatency;
+        }
+
+        /**
+         * @return message format in use
+         */
+        Telemetry::format_t format(void)
+        {
+            return _format;
+        }
+
+        /**
+         * @return how old motor values were when the dynamics first applied
+         *         them, from sending the telemetry they answer
+         */
+        LatencyStage & commandAge(void)
+        {
+            return _commandAge;
+        }
+
+        /**
+         * Formats what the I/O thread got of its placement, as one line of
+         * text.  Call after start().
+         */
+        void formatPlacement(char * buf, const size_t len)
+        {
+            if (_lockstep || _synchronous) {
+                snprintf(buf, len, "%-8s no I/O thread in %s mode", "io",
+                        _lockstep ? "lockstep" : "synchronous");
+                return;
+            }
+
+            if (!_transport) {
+                snprintf(buf, len, "%-8s batched with other vehicles",
+                        "io");
+                return;
+            }
+
+            ThreadPlacement::format(
+                    "io", _placement, _placementReport, buf, len);
+        }
+
+        counters_t counters(void)
+        {
+            counters_t counters = {};
+
+            counters.requests = _requestCount.load(std::memory_order_relaxed);
+            counters.sent = _sentCount.load(std::memory_order_relaxed);
+            counters.received = _receivedCount.load(std::memory_order_relaxed);
+            counters.skipped = _skippedCount.load(std::memory_order_relaxed);
+            counters.missing = _missingCount.load(std::memory_order_relaxed);
+            counters.late = _lateCount.load(std::memory_order_relaxed);
+            counters.stale = _staleCount.load(std::memory_order_relaxed);
+            counters.dropped = _droppedCount.load(std::memory_order_relaxed);
+            counters.lost = _lostCount.load(std::memory_order_relaxed);
+            counters.reordered =
+                _reorderedCount.load(std::memory_order_relaxed);
+
+            return counters;
+        }
+
+}; // class ControllerLink
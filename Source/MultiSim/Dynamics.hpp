@@ -3,6 +3,10 @@
  *
  * Should work for any simulator, vehicle, or operating system
  *
+ * Templated on the scalar type used for both state and arithmetic:
+ * Dynamics (float) for simulation, BasicDynamics<double> for high-precision
+ * reference runs.
+ *
  * Based on:
  *
  *   @inproceedings{DBLP:conf/icra/BouabdallahMS04,
@@ -39,7 +43,8 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
-class Dynamics {
+template <typename real_t>
+class BasicDynamics {
 
     public:
 
@@ -51,18 +56,18 @@ class Dynamics {
         // state vector (see Eqn. 11)
         typedef struct {
 
-            float x;
-            float dx;
-            float y;
-            float dy;
-            float z;
-            float dz;
-            float phi;
-            float dphi;
-            float theta;
-            float dtheta;
-            float psi;
-            float dpsi;
+            real_t x;
+            real_t dx;
+            real_t y;
+            real_t dy;
+            real_t z;
+            real_t dz;
+            real_t phi;
+            real_t dphi;
+            real_t theta;
+            real_t dtheta;
+            real_t psi;
+            real_t dpsi;
 
         } vehicle_state_t;
 
@@ -70,8 +75,8 @@ class Dynamics {
 
         typedef struct {
 
-            double g;  // gravitational constant
-            double rho;  // air density
+            real_t g;  // gravitational constant
+            real_t rho;  // air density
 
         } world_params_t; 
 
@@ -82,7 +87,7 @@ class Dynamics {
 
         bool _autoland; // support fly-to-zero-AGL
 
-        double _capSpeed(const double speed)
+        real_t _capSpeed(const real_t speed)
         {
             const auto cap = _vparams.maxspeed;
 
@@ -96,14 +101,14 @@ class Dynamics {
          */
         typedef struct {
 
-            double d;  // drag coefficient [T=d*w^2]
-            double m;  // mass [kg]
-            double Ix; // [kg*m^2] 
-            double Iy; // [kg*m^2] 
-            double Iz; // [kg*m^2] 
-            double Jr; // rotor inertial [kg*m^2] 
+            real_t d;  // drag coefficient [T=d*w^2]
+            real_t m;  // mass [kg]
+            real_t Ix; // [kg*m^2] 
+            real_t Iy; // [kg*m^2] 
+            real_t Iz; // [kg*m^2] 
+            real_t Jr; // rotor inertial [kg*m^2] 
             uint16_t maxrpm; // maxrpm
-            double maxspeed; // [m/s]
+            real_t maxspeed; // [m/s]
 
         } vehicle_params_t; 
 
@@ -126,14 +131,418 @@ class Dynamics {
             STATE_SIZE
         };
 
+        /**
+         * Integration methods for update()
+         */
+        typedef enum {
+
+            INTEGRATOR_EULER,               // explicit (forward) Euler
+            INTEGRATOR_SEMI_IMPLICIT_EULER, // velocities first, then positions
+            INTEGRATOR_RK4,                 // classical Runge-Kutta
+            INTEGRATOR_RK45                 // Dormand-Prince, error-controlled
+
+        } integrator_t;
+
+        /**
+         * Attitude representations for update().  With a quaternion, the
+         * angular-rate states are treated as body rates and integrated
+         * directly into the attitude, avoiding per-step trigonometry and
+         * gimbal lock; Euler angles are computed only when requested.
+         */
+        typedef enum {
+
+            ATTITUDE_EULER,
+            ATTITUDE_QUATERNION
+
+        } attitude_t;
+
+        /**
+         * First-order motor/ESC response: each rotor's speed approaches its
+         * actuator value with the given time constant, at no more than the
+         * given rates.  Speeds are fractions of maxrpm.
+         */
+        typedef struct {
+
+            real_t timeConstant; // seconds to 63% of a step; 0 for none
+            real_t maxRise;      // spin-up per second; 0 for no limit
+            real_t maxFall;      // spin-down per second; 0 for no limit
+
+        } motor_params_t;
+
+        /**
+         * Everything that changes during flight, as plain old data: can be
+         * copied with memcpy, stored in arrays, and restored any number of
+         * times.  Parameters and integrator settings are not included.
+         */
+        typedef struct {
+
+            vehicle_state_t vstate; // Euler angles valid in either attitude
+            real_t quaternion[4];
+            attitude_t attitude;
+            bool airborne;
+            real_t agl;
+            real_t inertialAccel[3];
+            real_t rk45Step;
+            real_t motorSpeeds[MAX_ROTORS];
+
+        } snapshot_t;
+
+    private:
+
+        // Attitude quaternion, appended to the state vector when enabled
+        enum {
+            STATE_QW = STATE_SIZE,
+            STATE_QX,
+            STATE_QY,
+            STATE_QZ,
+            EXTENDED_STATE_SIZE
+        };
+
+        // Limits work done by RK45 in a single update
+        static const uint16_t RK45_MAX_SUBSTEPS = 100;
+
+        integrator_t _integrator = INTEGRATOR_EULER;
+
+        // Error tolerance for RK45
+        real_t _tolerance = 1e-6;
+
+        // Last RK45 substep size, carried over to the next update
+        real_t _rk45Step = 0;
+
+        attitude_t _attitude = ATTITUDE_EULER;
+
+        // Unit quaternion (w, x, y, z), used with ATTITUDE_QUATERNION
+        real_t _quaternion[4] = {1, 0, 0, 0};
+
+        bool _motorModel = false;
+
+        motor_params_t _mparams = {};
+
+        // Rotor speeds under the motor model, as fractions of maxrpm
+        real_t _motorSpeeds[MAX_ROTORS] = {};
+
+        // Actuator values with motor speeds substituted for the rotors
+        real_t _motorActuators[MAX_ROTORS] = {};
+
+        // Per-step motor coefficients, cached for the last time step
+        real_t _motorDt = 0;
+        real_t _motorAlpha = 1;
+        real_t _motorRise = 0;
+        real_t _motorFall = 0;
+
+
+        // Rotor forces, held constant over an update
+        typedef struct {
+
+            real_t u1;    // thrust
+            real_t u2;    // roll
+            real_t u3;    // pitch
+            real_t u4;    // yaw
+            real_t omega; // net rotor speed
+
+        } forces_t;
+
+        uint8_t stateSize(void)
+        {
+            return _attitude == ATTITUDE_QUATERNION ?
+                (uint8_t)EXTENDED_STATE_SIZE :
+                (uint8_t)STATE_SIZE;
+        }
+
+        void getStateVector(real_t x[EXTENDED_STATE_SIZE])
+        {
+            x[STATE_X] = _vstate.x;
+            x[STATE_DX] = _vstate.dx;
+            x[STATE_Y] = _vstate.y;
+            x[STATE_DY] = _vstate.dy;
+            x[STATE_Z] = _vstate.z;
+            x[STATE_DZ] = _vstate.dz;
+            x[STATE_PHI] = _vstate.phi;
+            x[STATE_DPHI] = _vstate.dphi;
+            x[STATE_THETA] = _vstate.theta;
+            x[STATE_DTHETA] = _vstate.dtheta;
+            x[STATE_PSI] = _vstate.psi;
+            x[STATE_DPSI] = _vstate.dpsi;
+
+            for (uint8_t i=0; i<4; ++i) {
+                x[STATE_QW+i] = _quaternion[i];
+            }
+        }
+
+        void setStateVector(const real_t x[EXTENDED_STATE_SIZE])
+        {
+            _vstate.x = x[STATE_X];
+            _vstate.dx = x[STATE_DX];
+            _vstate.y = x[STATE_Y];
+            _vstate.dy = x[STATE_DY];
+            _vstate.z = x[STATE_Z];
+            _vstate.dz = x[STATE_DZ];
+            _vstate.phi = x[STATE_PHI];
+            _vstate.dphi = x[STATE_DPHI];
+            _vstate.theta = x[STATE_THETA];
+            _vstate.dtheta = x[STATE_DTHETA];
+            _vstate.psi = x[STATE_PSI];
+            _vstate.dpsi = x[STATE_DPSI];
+
+            if (_attitude == ATTITUDE_QUATERNION) {
+
+                // Renormalize to undo integration drift
+                const real_t * q = &x[STATE_QW];
+                const real_t n =
+                    1 / sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+
+                for (uint8_t i=0; i<4; ++i) {
+                    _quaternion[i] = q[i] * n;
+                }
+            }
+        }
+
+        // Rotates body-frame thrust into the inertial frame, using whichever
+        // attitude representation is in use
+        void thrustToInertial(
+                const real_t bodyZ,
+                const real_t x[EXTENDED_STATE_SIZE],
+                real_t inertial[3])
+        {
+            if (_attitude == ATTITUDE_QUATERNION) {
+                quaternionBodyZToInertial(bodyZ, &x[STATE_QW], inertial);
+            }
+
+            else {
+                const real_t euler[3] = {
+                    x[STATE_PHI], x[STATE_THETA], x[STATE_PSI]
+                };
+                bodyZToInertial(bodyZ, euler, inertial);
+            }
+        }
+
+        // Quaternion kinematics: attitude follows the body rates directly,
+        // so the Euler angles are left alone
+        static void computeQuaternionDerivative(
+                const real_t x[EXTENDED_STATE_SIZE],
+                real_t dxdt[EXTENDED_STATE_SIZE])
+        {
+            const real_t p = x[STATE_DPHI];
+            const real_t q = x[STATE_DTHETA];
+            const real_t r = x[STATE_DPSI];
+
+            const real_t qw = x[STATE_QW];
+            const real_t qx = x[STATE_QX];
+            const real_t qy = x[STATE_QY];
+            const real_t qz = x[STATE_QZ];
+
+            dxdt[STATE_PHI] = 0;
+            dxdt[STATE_THETA] = 0;
+            dxdt[STATE_PSI] = 0;
+
+            dxdt[STATE_QW] = (-qx * p - qy * q - qz * r) / 2;
+            dxdt[STATE_QX] = (qw * p + qy * r - qz * q) / 2;
+            dxdt[STATE_QY] = (qw * q - qx * r + qz * p) / 2;
+            dxdt[STATE_QZ] = (qw * r + qx * q - qy * p) / 2;
+        }
+
+        // Equation 12, plus quaternion kinematics if enabled
+        void computeDerivative(
+                const real_t x[EXTENDED_STATE_SIZE],
+                const real_t accelNED[3],
+                const forces_t & f,
+                real_t dxdt[EXTENDED_STATE_SIZE])
+        {
+            computeStateDerivative(x, accelNED, accelNED[2] + _wparams.g,
+                    f.omega, f.u2, f.u3, f.u4, dxdt);
+
+            if (_attitude == ATTITUDE_QUATERNION) {
+                computeQuaternionDerivative(x, dxdt);
+            }
+        }
+
+        // Evaluates the derivative at an intermediate state, re-rotating the
+        // thrust vector by that state's attitude
+        void computeStageDerivative(
+                const real_t x[EXTENDED_STATE_SIZE],
+                const forces_t & f,
+                real_t dxdt[EXTENDED_STATE_SIZE])
+        {
+            real_t accelNED[3] = {};
+            thrustToInertial(-f.u1 / _vparams.m, x, accelNED);
+
+            computeDerivative(x, accelNED, f, dxdt);
+        }
+
+        void integrateEuler(
+                real_t x[EXTENDED_STATE_SIZE],
+                const real_t dxdt[EXTENDED_STATE_SIZE],
+                const real_t dt)
+        {
+            for (uint8_t i=0; i<stateSize(); ++i) {
+                x[i] += dt * dxdt[i];
+            }
+        }
+
+        void integrateSemiImplicitEuler(
+                real_t x[EXTENDED_STATE_SIZE],
+                const real_t dxdt[EXTENDED_STATE_SIZE],
+                const real_t dt)
+        {
+            const auto quaternion = _attitude == ATTITUDE_QUATERNION;
+
+            // Each position is followed by its velocity in the state
+            // vector; update the velocity first, then use it to update the
+            // position
+            for (uint8_t i=0; i<STATE_SIZE; i+=2) {
+                x[i+1] += dt * dxdt[i+1];
+                if (!(quaternion && i >= STATE_PHI)) {
+                    x[i] += dt * x[i+1];
+                }
+            }
+
+            // Likewise, rotate the quaternion by the updated body rates
+            if (quaternion) {
+                real_t dqdt[EXTENDED_STATE_SIZE] = {};
+                computeQuaternionDerivative(x, dqdt);
+                for (uint8_t i=STATE_QW; i<EXTENDED_STATE_SIZE; ++i) {
+                    x[i] += dt * dqdt[i];
+                }
+            }
+        }
+
+        void integrateRK4(
+                real_t x[EXTENDED_STATE_SIZE],
+                const real_t k1[EXTENDED_STATE_SIZE],
+                const forces_t & f,
+                const real_t dt)
+        {
+            const auto n = stateSize();
+
+            real_t k2[EXTENDED_STATE_SIZE] = {};
+            real_t k3[EXTENDED_STATE_SIZE] = {};
+            real_t k4[EXTENDED_STATE_SIZE] = {};
+            real_t xt[EXTENDED_STATE_SIZE] = {};
+
+            for (uint8_t i=0; i<n; ++i) {
+                xt[i] = x[i] + dt / 2 * k1[i];
+            }
+            computeStageDerivative(xt, f, k2);
+
+            for (uint8_t i=0; i<n; ++i) {
+                xt[i] = x[i] + dt / 2 * k2[i];
+            }
+            computeStageDerivative(xt, f, k3);
+
+            for (uint8_t i=0; i<n; ++i) {
+                xt[i] = x[i] + dt * k3[i];
+            }
+            computeStageDerivative(xt, f, k4);
+
+            for (uint8_t i=0; i<n; ++i) {
+                x[i] += dt / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+            }
+        }
+
+        // Dormand-Prince 5(4) with first-same-as-last, taking as many
+        // substeps as needed to keep the local error within tolerance
+        void integrateRK45(
+                real_t x[EXTENDED_STATE_SIZE],
+                const real_t k1[EXTENDED_STATE_SIZE],
+                const forces_t & f,
+                const real_t dt)
+        {
+            static constexpr real_t A[6][6] = {
+                { 1./5 },
+                { 3./40, 9./40 },
+                { 44./45, -56./15, 32./9 },
+                { 19372./6561, -25360./2187, 64448./6561, -212./729 },
+                { 9017./3168, -355./33, 46732./5247, 49./176,
+                    -5103./18656 },
+                { 35./384, 0, 500./1113, 125./192, -2187./6784, 11./84 }
+            };
+
+            // Difference between fifth- and fourth-order weights
+            static constexpr real_t E[7] = {
+                71./57600, 0, -71./16695, 71./1920, -17253./339200,
+                22./525, -1./40
+            };
+
+            const auto n = stateSize();
+
+            real_t k[7][EXTENDED_STATE_SIZE] = {};
+            memcpy(k[0], k1, sizeof(k[0]));
+
+            real_t xt[EXTENDED_STATE_SIZE] = {};
+
+            real_t h = _rk45Step > 0 && _rk45Step < dt ? _rk45Step : dt;
+
+            real_t t = 0;
+
+            for (uint16_t m=0; t<dt; ++m) {
+
+                // Take whatever is left as the final substep, accepted
+                // unconditionally if we've run out of substeps
+                const auto last = m >= RK45_MAX_SUBSTEPS - 1;
+                const auto proposed = h;
+
+                const auto remaining = dt - t;
+
+                const auto ends = last || h >= remaining;
+
+                const auto step = ends ? remaining : h;
+
+                // Stages 2-7; the seventh is evaluated at the new state
+                for (uint8_t s=0; s<6; ++s) {
+                    for (uint8_t i=0; i<n; ++i) {
+                        real_t sum = 0;
+                        for (uint8_t j=0; j<=s; ++j) {
+                            sum += A[s][j] * k[j][i];
+                        }
+                        xt[i] = x[i] + step * sum;
+                    }
+                    computeStageDerivative(xt, f, k[s+1]);
+                }
+
+                // Scaled maximum of the local error estimate
+                real_t error = 0;
+                for (uint8_t i=0; i<n; ++i) {
+                    real_t e = 0;
+                    for (uint8_t j=0; j<7; ++j) {
+                        e += E[j] * k[j][i];
+                    }
+                    const real_t scale = _tolerance *
+                        (1 + fmax(fabs(x[i]), fabs(xt[i])));
+                    error = fmax(error, fabs(step * e) / scale);
+                }
+
+                if (error <= 1 || last) {
+
+                    // Exactly, since t + (dt - t) can round to just below
+                    // dt and leave the loop running
+                    t = ends ? dt : t + step;
+
+                    memcpy(x, xt, sizeof(xt));
+                    memcpy(k[0], k[6], sizeof(k[0]));
+                }
+
+                // Standard step-size controller, growing at most fivefold
+                h = step * (error == 0 ? 5 :
+                        fmin((real_t)5, fmax((real_t)0.2,
+                                (real_t)0.9 * pow(error, (real_t)-0.2))));
+
+                // A step cut short to end the interval says nothing about
+                // how large a step the error allows, so don't let a tiny
+                // remainder shrink the next update's first step
+                if (step < proposed && error <= 1) {
+                    h = fmax(h, proposed);
+                }
+            }
+
+            _rk45Step = h;
+        }
+
     protected:
 
         vehicle_params_t _vparams;
         world_params_t _wparams;
 
-        vehicle_state_t _vstate_deriv;
-
-        Dynamics(
+        BasicDynamics(
                 const uint8_t actuatorCount,
                 const vehicle_params_t & vparams,
                 const bool autoland=true)
@@ -157,10 +566,10 @@ class Dynamics {
         bool _airborne = false;
 
         // Inertial-frame acceleration
-        double _inertialAccel[3] = {};
+        real_t _inertialAccel[3] = {};
 
         // y = Ax + b helper for frame-of-reference conversion methods
-        static void dot(double A[3][3], double x[3], double y[3])
+        static void dot(real_t A[3][3], real_t x[3], real_t y[3])
         {
             for (uint8_t j = 0; j < 3; ++j) {
                 y[j] = 0;
@@ -172,24 +581,24 @@ class Dynamics {
 
         // bodyToInertial method optimized for body X=Y=0
         static void bodyZToInertial(
-                const double bodyZ,
-                const double rotation[3],
-                double inertial[3])
+                const real_t bodyZ,
+                const real_t rotation[3],
+                real_t inertial[3])
         {
-            double phi = rotation[0];
-            double theta = rotation[1];
-            double psi = rotation[2];
+            real_t phi = rotation[0];
+            real_t theta = rotation[1];
+            real_t psi = rotation[2];
 
-            double cph = cos(phi);
-            double sph = sin(phi);
-            double cth = cos(theta);
-            double sth = sin(theta);
-            double cps = cos(psi);
-            double sps = sin(psi);
+            real_t cph = cos(phi);
+            real_t sph = sin(phi);
+            real_t cth = cos(theta);
+            real_t sth = sin(theta);
+            real_t cps = cos(psi);
+            real_t sps = sin(psi);
 
             // This is the rightmost column of the body-to-inertial rotation
             // matrix
-            double R[3] = { sph * sps + cph * cps * sth,
+            real_t R[3] = { sph * sps + cph * cps * sth,
                 cph * sps * sth - cps * sph,
                 cph * cth };
 
@@ -198,8 +607,42 @@ class Dynamics {
             }
         }
 
+        // bodyZToInertial for a unit quaternion (w, x, y, z); needs no
+        // trigonometry
+        static void quaternionBodyZToInertial(
+                const real_t bodyZ,
+                const real_t q[4],
+                real_t inertial[3])
+        {
+            const real_t w = q[0];
+            const real_t x = q[1];
+            const real_t y = q[2];
+            const real_t z = q[3];
+
+            // Rightmost column of the rotation matrix
+            inertial[0] = bodyZ * 2 * (x * z + w * y);
+            inertial[1] = bodyZ * 2 * (y * z - w * x);
+            inertial[2] = bodyZ * (1 - 2 * (x * x + y * y));
+        }
+
+        // Converts Euler angles (roll, pitch, yaw) to a unit quaternion
+        static void eulerToQuaternion(const real_t rotation[3], real_t q[4])
+        {
+            const real_t cph = cos(rotation[0] / 2);
+            const real_t sph = sin(rotation[0] / 2);
+            const real_t cth = cos(rotation[1] / 2);
+            const real_t sth = sin(rotation[1] / 2);
+            const real_t cps = cos(rotation[2] / 2);
+            const real_t sps = sin(rotation[2] / 2);
+
+            q[0] = cph * cth * cps + sph * sth * sps;
+            q[1] = sph * cth * cps - cph * sth * sps;
+            q[2] = cph * sth * cps + sph * cth * sps;
+            q[3] = cph * cth * sps - sph * sth * cps;
+        }
+
         // Height above ground, set by kinematics
-        double _agl = 0;
+        real_t _agl = 0;
 
 
         // quad, hexa, octo, etc.
@@ -214,72 +657,223 @@ class Dynamics {
 
         /**
          * Implements Equation 12 computing temporal first derivative of state.
-         * Should fill _dxdx[0..11] with appropriate values.
+         * @param x state vector
          * @param accelNED acceleration in NED inertial frame
          * @param netz accelNED[2] with gravitational constant added in
          * @param omega net torque from rotors
          * @param u2 roll force
          * @param u3 pitch force
          * @param u4 yaw force
+         * @param dxdt filled with first derivative of state
          */
-        void computeStateDerivative(double accelNED[3],
-                                    double netz,
-                                    double omega,
-                                    double u2,
-                                    double u3,
-                                    double u4)
-        {
-            double phidot = _vstate.dphi;
-            double thedot = _vstate.dtheta;
-            double psidot = _vstate.dpsi;
-
-            double Ix = _vparams.Ix;
-            double Iy = _vparams.Iy;
-            double Iz = _vparams.Iz;
-            double Jr = _vparams.Jr;
+        void computeStateDerivative(const real_t x[STATE_SIZE],
+                                    const real_t accelNED[3],
+                                    const real_t netz,
+                                    const real_t omega,
+                                    const real_t u2,
+                                    const real_t u3,
+                                    const real_t u4,
+                                    real_t dxdt[STATE_SIZE])
+        {
+            real_t phidot = x[STATE_DPHI];
+            real_t thedot = x[STATE_DTHETA];
+            real_t psidot = x[STATE_DPSI];
+
+            real_t Ix = _vparams.Ix;
+            real_t Iy = _vparams.Iy;
+            real_t Iz = _vparams.Iz;
+            real_t Jr = _vparams.Jr;
 
             // x'
-            _vstate_deriv.x = _vstate.dx;
+            dxdt[STATE_X] = x[STATE_DX];
             
             // x''
-            _vstate_deriv.dx = accelNED[0];
+            dxdt[STATE_DX] = accelNED[0];
 
             // y'
-            _vstate_deriv.y = _vstate.dy;
+            dxdt[STATE_Y] = x[STATE_DY];
 
             // y''
-            _vstate_deriv.dy = accelNED[1];
+            dxdt[STATE_DY] = accelNED[1];
 
             // z'
-            _vstate_deriv.z = _vstate.dz;
+            dxdt[STATE_Z] = x[STATE_DZ];
 
             // z''
-            _vstate_deriv.dz = netz;
+            dxdt[STATE_DZ] = netz;
 
             // phi'
-            _vstate_deriv.phi = phidot;
+            dxdt[STATE_PHI] = phidot;
 
             // phi''
-            _vstate_deriv.dphi = psidot * thedot * (Iy - Iz) / Ix - Jr / 
+            dxdt[STATE_DPHI] = psidot * thedot * (Iy - Iz) / Ix - Jr / 
                 Ix * thedot * omega + u2 / Ix;
 
             // theta'
-            _vstate_deriv.theta = thedot;
+            dxdt[STATE_THETA] = thedot;
 
             // theta''
-            _vstate_deriv.dtheta = -(psidot * phidot * (Iz - Ix) / Iy + Jr / 
+            dxdt[STATE_DTHETA] = -(psidot * phidot * (Iz - Ix) / Iy + Jr / 
                     Iy * phidot * omega + u3 / Iy);
 
             // psi'
-            _vstate_deriv.psi = psidot;
+            dxdt[STATE_PSI] = psidot;
 
             // psi''
-            _vstate_deriv.dpsi = thedot * phidot * (Ix - Iy) / Iz + u4 / Iz;
+            dxdt[STATE_DPSI] = thedot * phidot * (Ix - Iy) / Iz + u4 / Iz;
         }
 
+        /**
+         * Runs the motor model, if any, for one time step.  Shared by all
+         * update() implementations.
+         *
+         * @param actuators demanded actuator values
+         * @param dt time in seconds since previous update
+         * @return actuators with the rotors replaced by their speeds, or
+         *         actuators itself without a motor model
+         */
+        const real_t * applyMotorModel(
+                const real_t * actuators, const real_t dt)
+        {
+            if (!_motorModel) {
+                return actuators;
+            }
+
+            if (dt != _motorDt) {
+                _motorDt = dt;
+                motorCoefficients(_mparams, dt,
+                        _motorAlpha, _motorRise, _motorFall);
+            }
+
+            filterMotors(actuators, _motorSpeeds, _rotorCount,
+                    _motorAlpha, _motorRise, _motorFall);
+
+            memcpy(_motorActuators, actuators,
+                    _actuatorCount * sizeof(real_t));
+            memcpy(_motorActuators, _motorSpeeds,
+                    _rotorCount * sizeof(real_t));
+
+            return _motorActuators;
+        }
+
+        /**
+         * Applies rotor forces to the state: handles takeoff and landing,
+         * then integrates Equation 12 over dt.  Shared by all update()
+         * implementations.
+         *
+         * @param u1 thrust force
+         * @param u2 roll force
+         * @param u3 pitch force
+         * @param u4 yaw force
+         * @param omega net torque from rotors
+         * @param dt time in seconds since previous update
+         */
+        void updateState(
+                const real_t u1,
+                const real_t u2,
+                const real_t u3,
+                const real_t u4,
+                const real_t omega,
+                const real_t dt)
+        {
+            real_t x[EXTENDED_STATE_SIZE] = {};
+            getStateVector(x);
+
+            // Use the current attitude to rotate the orthogonal thrust
+            // vector into the inertial frame.  Negate to use NED.
+            real_t accelNED[3] = {};
+            thrustToInertial(-u1 / _vparams.m, x, accelNED);
+
+            // We're airborne once net downward acceleration goes below zero
+            real_t netz = accelNED[2] + _wparams.g;
+
+            // If we're airborne, check for low AGL on descent
+            if (_airborne) {
+
+                if (_agl <= 0 && netz >= 0) {
+
+                    _airborne = false;
+
+                    _vstate.dx = 0;
+                    _vstate.dy = 0;
+                    _vstate.dz = 0;
+                    _vstate.phi = 0;
+                    _vstate.dphi = 0;
+                    _vstate.theta = 0;
+                    _vstate.dtheta = 0;
+                    _vstate.dpsi = 0;
+
+                    if (_attitude == ATTITUDE_QUATERNION) {
+                        const real_t rotation[3] = {0, 0, getStatePsi()};
+                        eulerToQuaternion(rotation, _quaternion);
+                    }
+
+                    _vstate.z += _agl;
+                }
+            }
+
+            // If we're not airborne, we become airborne when downward
+            // acceleration has become negative
+            else {
+                _airborne = netz < 0;
+            }
+
+            // Once airborne, we can update dynamics
+            if (_airborne) {
+
+                const forces_t forces = {u1, u2, u3, u4, omega};
+
+                // Compute the state derivatives using Equation 12
+                real_t dxdt[EXTENDED_STATE_SIZE] = {};
+                computeDerivative(x, accelNED, forces, dxdt);
+
+                // Compute state as first temporal integral of first temporal
+                // derivative
+                switch (_integrator) {
+
+                    case INTEGRATOR_SEMI_IMPLICIT_EULER:
+                        integrateSemiImplicitEuler(x, dxdt, dt);
+                        break;
+
+                    case INTEGRATOR_RK4:
+                        integrateRK4(x, dxdt, forces, dt);
+                        break;
+
+                    case INTEGRATOR_RK45:
+                        integrateRK45(x, dxdt, forces, dt);
+                        break;
+
+                    default:
+                        integrateEuler(x, dxdt, dt);
+                }
+
+                setStateVector(x);
+
+                // Cap dx, dy by maximum speed
+                _vstate.dx = _capSpeed(_vstate.dx);
+                _vstate.dy = _capSpeed(_vstate.dy);
+
+                // Once airborne, inertial-frame acceleration is same as NED
+                // acceleration
+                _inertialAccel[0] = accelNED[0];
+                _inertialAccel[1] = accelNED[1];
+                _inertialAccel[2] = accelNED[2];
+            }
+            else if (_autoland) {
+                //"fly" to agl=0
+                _vstate.z += 5 * _agl * dt;
+            }
+
+            // XXX
+            //vstate.z = -1;
+        }
 
     public:
 
+        virtual ~BasicDynamics(void)
+        {
+        }
+
         /**
          * Initializes kinematic pose, with flag for whether we're airbone
          * (helps with testing gravity).
@@ -290,17 +884,27 @@ class Dynamics {
          */
         void init(const double rotation[3], const bool airborne = false)
         {
+            const real_t euler[3] = {
+                (real_t)rotation[0], (real_t)rotation[1], (real_t)rotation[2]
+            };
+
             // Always start at location (0,0,0)
             memset(&_vstate, 0, sizeof(_vstate));
 
-            _vstate.phi   = rotation[0];
-            _vstate.theta = rotation[1];
-            _vstate.psi   = rotation[2];
+            _vstate.phi   = euler[0];
+            _vstate.theta = euler[1];
+            _vstate.psi   = euler[2];
 
             _airborne = airborne;
 
+            _rk45Step = 0;
+
+            memset(_motorSpeeds, 0, sizeof(_motorSpeeds));
+
+            eulerToQuaternion(euler, _quaternion);
+
             // Initialize inertial frame acceleration in NED coordinates
-            bodyZToInertial(-_wparams.g, rotation, _inertialAccel);
+            bodyZToInertial(-_wparams.g, euler, _inertialAccel);
 
             // We usuall start on ground, but can start in air for testing
             _airborne = airborne;
@@ -311,7 +915,7 @@ class Dynamics {
          * Sets height above ground level (AGL).
          * This method can be called by the kinematic visualization.
          */
-        void setAgl(const double agl)
+        void setAgl(const real_t agl)
         {
             _agl = agl;
         }
@@ -320,12 +924,12 @@ class Dynamics {
 
         virtual int8_t getRotorDirection(const uint8_t i) = 0;
 
-        virtual double getThrustCoefficient(double * actuators) = 0;
+        virtual real_t getThrustCoefficient(const real_t * actuators) = 0;
 
-        virtual void computeRollAndPitch(double * actuators,
-                                         double * omegas2,
-                                         double & roll,
-                                         double & pitch) = 0;
+        virtual void computeRollAndPitch(const real_t * actuators,
+                                         const real_t * omegas2,
+                                         real_t & roll,
+                                         real_t & pitch) = 0;
 
         /**
          * Gets actuator count set by constructor.
@@ -349,38 +953,223 @@ class Dynamics {
         /**
           * Sets world parameters (currently just gravity and air density)
           */
-        void setWorldParams(const double g, const double rho)
+        void setWorldParams(const real_t g, const real_t rho)
         {
             _wparams.g = g;
             _wparams.rho = rho;
         }
 
+        /**
+         * Selects the integration method used by update().  Higher-order
+         * methods allow larger time steps for the same trajectory error.
+         *
+         * @param integrator integration method
+         * @param tolerance error tolerance per update (RK45 only)
+         */
+        void setIntegrator(
+                const integrator_t integrator,
+                const real_t tolerance=1e-6)
+        {
+            _integrator = integrator;
+            _tolerance = tolerance;
+            _rk45Step = 0;
+        }
+
+        /**
+         * Selects the attitude representation used by update(), carrying
+         * the current attitude over.
+         */
+        void setAttitudeRepresentation(const attitude_t attitude)
+        {
+            if (attitude == _attitude) {
+                return;
+            }
+
+            if (attitude == ATTITUDE_QUATERNION) {
+                const real_t rotation[3] = {
+                    _vstate.phi, _vstate.theta, _vstate.psi
+                };
+                eulerToQuaternion(rotation, _quaternion);
+            }
+
+            else {
+                _vstate.phi = getStatePhi();
+                _vstate.theta = getStateTheta();
+                _vstate.psi = getStatePsi();
+            }
+
+            _attitude = attitude;
+        }
+
+        /**
+         * Adds a first-order lag, with optional slew limits, between each
+         * rotor's actuator value and its speed.
+         *
+         * @param mparams motor parameters
+         */
+        void setMotorModel(const motor_params_t & mparams)
+        {
+            _mparams = mparams;
+            _motorModel = true;
+
+            // Recompute coefficients on next update
+            _motorDt = 0;
+        }
+
+        /**
+         * Returns to rotor speeds following actuator values instantly.
+         */
+        void disableMotorModel(void)
+        {
+            _motorModel = false;
+        }
+
+        /**
+         * @return speed of rotor i as a fraction of maxrpm (motor model
+         *         only)
+         */
+        real_t getMotorSpeed(const uint8_t i)
+        {
+            return _motorSpeeds[i];
+        }
+
+        /**
+         * Converts motor parameters into per-step coefficients for
+         * filterMotors().
+         *
+         * @param mparams motor parameters
+         * @param dt time step in seconds
+         * @param alpha output fraction of the remaining error closed per step
+         * @param rise output largest speed increase per step
+         * @param fall output largest speed decrease per step
+         */
+        static void motorCoefficients(
+                const motor_params_t & mparams,
+                const real_t dt,
+                real_t & alpha,
+                real_t & rise,
+                real_t & fall)
+        {
+            // Exact discretization of the first-order lag
+            alpha = mparams.timeConstant > 0 ?
+                1 - exp(-dt / mparams.timeConstant) :
+                1;
+
+            rise = mparams.maxRise > 0 ?
+                mparams.maxRise * dt : (real_t)INFINITY;
+
+            fall = mparams.maxFall > 0 ?
+                mparams.maxFall * dt : (real_t)INFINITY;
+        }
+
+        /**
+         * Motor model step for n rotors: moves each speed a fraction alpha
+         * toward its demand, by at most rise up or fall down.  Branch-free,
+         * so that it vectorizes over rotors (or over a whole batch of them).
+         */
+        static void filterMotors(
+                const real_t * demands,
+                real_t * speeds,
+                const uint32_t n,
+                const real_t alpha,
+                const real_t rise,
+                const real_t fall)
+        {
+            for (uint32_t i=0; i<n; ++i) {
+                const real_t delta = alpha * (demands[i] - speeds[i]);
+                speeds[i] += fmin(fmax(delta, -fall), rise);
+            }
+        }
+
+        /**
+         * Captures the current flight state.
+         *
+         * @return snapshot for restore()
+         */
+        snapshot_t snapshot(void)
+        {
+            snapshot_t snapshot = {};
+
+            snapshot.vstate = _vstate;
+
+            // Keep Euler angles current, so snapshots from quaternion mode
+            // can be used without one
+            snapshot.vstate.phi = getStatePhi();
+            snapshot.vstate.theta = getStateTheta();
+            snapshot.vstate.psi = getStatePsi();
+
+            memcpy(snapshot.quaternion, _quaternion, sizeof(_quaternion));
+
+            snapshot.attitude = _attitude;
+            snapshot.airborne = _airborne;
+            snapshot.agl = _agl;
+
+            memcpy(snapshot.inertialAccel, _inertialAccel,
+                    sizeof(_inertialAccel));
+
+            snapshot.rk45Step = _rk45Step;
+
+            memcpy(snapshot.motorSpeeds, _motorSpeeds, sizeof(_motorSpeeds));
+
+            return snapshot;
+        }
+
+        /**
+         * Returns to a previously captured flight state, which may come
+         * from another vehicle with the same parameters.
+         *
+         * @param snapshot from snapshot()
+         */
+        void restore(const snapshot_t & snapshot)
+        {
+            _vstate = snapshot.vstate;
+
+            memcpy(_quaternion, snapshot.quaternion, sizeof(_quaternion));
+
+            _attitude = snapshot.attitude;
+            _airborne = snapshot.airborne;
+            _agl = snapshot.agl;
+
+            memcpy(_inertialAccel, snapshot.inertialAccel,
+                    sizeof(_inertialAccel));
+
+            _rk45Step = snapshot.rk45Step;
+
+            memcpy(_motorSpeeds, snapshot.motorSpeeds, sizeof(_motorSpeeds));
+        }
+
+        /**
+         * Clones this vehicle mid-flight, including parameters and settings.
+         * For many rollouts from the same state, restore() a snapshot into
+         * a few reusable instances, or into a DynamicsBatch, instead of
+         * allocating a fork for each.
+         *
+         * @return new instance, to be deleted by the caller
+         */
+        virtual BasicDynamics * fork(void) = 0;
+
         /**
          * Updates state.
          *
-         * @param actuators values in interval [0,1] (rotors) or [-0.5,+0.5]
+         * @param demands values in interval [0,1] (rotors) or [-0.5,+0.5]
                   (servos)
          * @param dt time in seconds since previous update
          */
-        void update(const float * factuators, const double dt) 
+        virtual void update(const real_t * demands, const real_t dt) 
         {
-            // Convert actuator values to double-precision for consistency
-            double actuators[10];
-            for (auto k=0; k<_rotorCount; ++k) {
-                actuators[k] = factuators[k];
-            }
+            const real_t * actuators = applyMotorModel(demands, dt);
 
             // Implement Equation 6 -------------------------------------------
 
             // Radians per second of rotors, and squared radians per second
-            double omegas[MAX_ROTORS] = {};
-            double omegas2[MAX_ROTORS] = {};
+            real_t omegas[MAX_ROTORS] = {};
+            real_t omegas2[MAX_ROTORS] = {};
 
-            double u1 = 0, u4 = 0, omega = 0;
+            real_t u1 = 0, u4 = 0, omega = 0;
             for (unsigned int i = 0; i < _rotorCount; ++i) {
 
                 // Convert fractional speed to radians per second
-                omegas[i] = actuators[i] * _vparams.maxrpm * M_PI / 30;  
+                omegas[i] = actuators[i] * _vparams.maxrpm * (real_t)M_PI / 30;  
 
                 // Thrust is squared rad/sec scaled by air density
                 omegas2[i] = _wparams.rho * omegas[i] * omegas[i]; 
@@ -397,145 +1186,94 @@ class Dynamics {
             
             // Compute roll, pitch, yaw forces (different method for
             // fixed-pitch blades vs. variable-pitch)
-            double u2 = 0, u3 = 0;
+            real_t u2 = 0, u3 = 0;
             computeRollAndPitch(actuators, omegas2, u2, u3);
 
             // ----------------------------------------------------------------
 
-            // Use the current Euler angles to rotate the orthogonal thrust
-            // vector into the inertial frame.  Negate to use NED.
-            double euler[3] = {_vstate.phi, _vstate.theta, _vstate.psi};
-            double accelNED[3] = {};
-            bodyZToInertial(-u1 / _vparams.m, euler, accelNED);
-
-            // We're airborne once net downward acceleration goes below zero
-            double netz = accelNED[2] + _wparams.g;
-
-            // If we're airborne, check for low AGL on descent
-            if (_airborne) {
-
-                if (_agl <= 0 && netz >= 0) {
-
-                    _airborne = false;
-
-                    _vstate.dx = 0;
-                    _vstate.dy = 0;
-                    _vstate.dz = 0;
-                    _vstate.phi = 0;
-                    _vstate.dphi = 0;
-                    _vstate.theta = 0;
-                    _vstate.dtheta = 0;
-                    _vstate.dpsi = 0;
-
-                    _vstate.z += _agl;
-                }
-            }
-
-            // If we're not airborne, we become airborne when downward
-            // acceleration has become negative
-            else {
-                _airborne = netz < 0;
-            }
-
-            // Once airborne, we can update dynamics
-            if (_airborne) {
-
-                // Compute the state derivatives using Equation 12
-                computeStateDerivative(accelNED, netz, omega, u2, u3, u4);
-
-                // Compute state as first temporal integral of first temporal
-                // derivative
-                _vstate.x += dt * _vstate_deriv.x;
-                _vstate.dx += dt * _vstate_deriv.dx;
-                _vstate.y += dt * _vstate_deriv.y;
-                _vstate.dy += dt * _vstate_deriv.dy;
-                _vstate.z += dt * _vstate_deriv.z;
-                _vstate.dz += dt * _vstate_deriv.dz;
-                _vstate.phi += dt * _vstate_deriv.phi;
-                _vstate.dphi += dt * _vstate_deriv.dphi;
-                _vstate.theta += dt * _vstate_deriv.theta;
-                _vstate.dtheta += dt * _vstate_deriv.dtheta;
-                _vstate.psi += dt * _vstate_deriv.psi;
-                _vstate.dpsi += dt * _vstate_deriv.dpsi;
-
-                // Cap dx, dy by maximum speed
-                _vstate.dx = _capSpeed(_vstate.dx);
-                _vstate.dy = _capSpeed(_vstate.dy);
-
-                // Once airborne, inertial-frame acceleration is same as NED
-                // acceleration
-                _inertialAccel[0] = accelNED[0];
-                _inertialAccel[1] = accelNED[1];
-                _inertialAccel[2] = accelNED[2];
-            }
-            else if (_autoland) {
-                //"fly" to agl=0
-                _vstate.z += 5 * _agl * dt;
-            }
-
-            // XXX
-            //vstate.z = -1;
+            updateState(u1, u2, u3, u4, omega, dt);
 
         } // update
 
-        double getStateX(void)
+
+        real_t getStateX(void)
         {
             return _vstate.x;
         }
 
-        double getStateDx(void)
+        real_t getStateDx(void)
         {
             return _vstate.dx;
         }
 
-        double getStateY(void)
+        real_t getStateY(void)
         {
             return _vstate.y;
         }
 
-        double getStateDy(void)
+        real_t getStateDy(void)
         {
             return _vstate.dy;
         }
 
-        double getStateZ(void)
+        real_t getStateZ(void)
         {
             return -_vstate.z; // NED => ENU
         }
 
-        double getStateDz(void)
+        real_t getStateDz(void)
         {
             return -_vstate.dz; // NED => ENU
         }
 
-        double getStatePhi(void)
+        real_t getStatePhi(void)
         {
+            if (_attitude == ATTITUDE_QUATERNION) {
+                const auto q = _quaternion;
+                return atan2(2 * (q[0] * q[1] + q[2] * q[3]),
+                        1 - 2 * (q[1] * q[1] + q[2] * q[2]));
+            }
+
             return _vstate.phi;
         }
 
-        double getStateDphi(void)
+        real_t getStateDphi(void)
         {
             return _vstate.dphi;
         }
 
-        double getStateTheta(void)
+        real_t getStateTheta(void)
         {
+            if (_attitude == ATTITUDE_QUATERNION) {
+                const auto q = _quaternion;
+                const real_t sth = 2 * (q[0] * q[2] - q[3] * q[1]);
+                return asin(sth < -1 ? -1 : sth > 1 ? 1 : sth);
+            }
+
             return _vstate.theta;
         }
 
-        double getStateDtheta(void)
+        real_t getStateDtheta(void)
         {
             return _vstate.dtheta;
         }
 
-        double getStatePsi(void)
+        real_t getStatePsi(void)
         {
+            if (_attitude == ATTITUDE_QUATERNION) {
+                const auto q = _quaternion;
+                return atan2(2 * (q[0] * q[3] + q[1] * q[2]),
+                        1 - 2 * (q[2] * q[2] + q[3] * q[3]));
+            }
+
             return _vstate.psi;
         }
 
-        double getStateDpsi(void)
+        real_t getStateDpsi(void)
         {
             return _vstate.dpsi;
         }
 
-}; // class Dynamics
+}; // class BasicDynamics
+
+typedef BasicDynamics<float> Dynamics;
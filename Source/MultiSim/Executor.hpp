@@ -0,0 +1,474 @@
+/*
+ * Shared executor for stepping many vehicles on a fixed pool of threads
+ *
+ * Instead of a thread per vehicle, registered tasks are ticked in frames at
+ * a fixed rate by a pool of worker threads.  At the start of each frame the
+ * tasks are dealt out evenly to the workers; a worker that finishes its
+ * share takes tasks from the others' shares, so one slow vehicle doesn't
+ * hold up the rest.  Every task is ticked exactly once per frame, and never
+ * on two threads at once.  Each task keeps its own clock and timing state.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Placement.hpp"
+#include "Scheduler.hpp"
+#include "Trace.hpp"
+
+class SimulationTask {
+
+    public:
+
+        virtual ~SimulationTask(void) {}
+
+        /**
+         * Runs whatever work is due, e.g. the fixed steps covered by the
+         * time since the last tick.  Called once per executor frame.
+         */
+        virtual void tick(void) = 0;
+
+}; // class SimulationTask
+
+class SimulationExecutor {
+
+    public:
+
+        static const uint32_t MAX_WORKERS = 64;
+
+    private:
+
+        // One worker's share of the frame's tasks, taken from the front by
+        // the owner and by thieves alike
+        typedef struct {
+
+            alignas(64) std::atomic<uint32_t> next;
+
+            uint32_t end;
+
+        } share_t;
+
+        uint32_t _workerCount = 1;
+
+        RateScheduler _scheduler;
+
+        std::vector<std::thread> _threads;
+
+        // Serializes add(), remove() and shutdown; never taken by workers
+        std::mutex _controlMutex;
+
+        // Registered tasks, and the leader's copy for the current frame
+        std::mutex _tasksMutex;
+        std::vector<SimulationTask *> _tasks;
+        std::vector<SimulationTask *> _frameTasks;
+
+        // Ticked alone by the leader at the start of every frame
+        SimulationTask * _frameHook = NULL;
+
+        share_t _shares[MAX_WORKERS];
+
+        // Frame start: the leader bumps _frame and wakes the other workers;
+        // once it has stopped, it sets _frame to STOP_FRAME instead
+        static const uint64_t STOP_FRAME = UINT64_MAX;
+        std::mutex _frameMutex;
+        std::condition_variable _frameStart;
+        uint64_t _frame = 0;
+
+        std::atomic<uint64_t> _startedFrames;
+        std::atomic<uint64_t> _finishedFrames;
+
+        // Workers still busy with the current frame
+        std::atomic<uint32_t> _busy;
+
+        std::atomic<bool> _running;
+
+        std::atomic<uint64_t> _ticks;
+        std::atomic<uint64_t> _steals;
+
+        // Cores and priority for every worker, and what each one got
+        ThreadPlacement::config_t _placement = {};
+        ThreadPlacement::report_t _placementReports[MAX_WORKERS] = {};
+        std::atomic<uint32_t> _placed;
+
+        void place(const uint32_t worker)
+        {
+#ifdef MULTISIM_TRACE
+            char name[50] = {};
+            snprintf(name, sizeof(name), "worker %u", worker);
+            TRACE_THREAD(name);
+#endif
+
+            _placementReports[worker] = ThreadPlacement::apply(_placement);
+
+            _placed.fetch_add(1, std::memory_order_release);
+        }
+
+        // Ticks tasks from our own share, then from everyone else's
+        void work(const uint32_t worker)
+        {
+            TRACE_SCOPE("frame");
+
+            uint64_t ticks = 0;
+            uint64_t steals = 0;
+
+            for (uint32_t k=0; k<_workerCount; ++k) {
+
+                auto & share = _shares[(worker + k) % _workerCount];
+
+                while (true) {
+
+                    const auto index =
+                        share.next.fetch_add(1, std::memory_order_relaxed);
+
+                    if (index >= share.end) {
+                        break;
+                    }
+
+                    _frameTasks[index]->tick();
+
+                    ticks++;
+                    steals += k > 0;
+                }
+            }
+
+            _ticks.fetch_add(ticks, std::memory_order_relaxed);
+            _steals.fetch_add(steals, std::memory_order_relaxed);
+        }
+
+        // Worker 0: paces the frames and works on them too
+        void lead(void)
+        {
+            place(0);
+
+            _scheduler.start();
+
+            while (_running.load(std::memory_order_acquire)) {
+
+                _scheduler.wait();
+
+                uint64_t frame = 0;
+
+                SimulationTask * hook = NULL;
+
+                // Numbering the frame along with its snapshot means a
+                // remove() that misses the snapshot also sees the frame
+                {
+                    std::lock_guard<std::mutex> lock(_tasksMutex);
+
+                    _frameTasks.assign(_tasks.begin(), _tasks.end());
+
+                    hook = _frameHook;
+
+                    frame = _startedFrames.load(std::memory_order_relaxed) + 1;
+
+                    _startedFrames.store(frame, std::memory_order_release);
+                }
+
+                // Before the other workers have anything to do
+                if (hook) {
+                    hook->tick();
+                }
+
+                const auto count = (uint32_t)_frameTasks.size();
+
+                for (uint32_t w=0; w<_workerCount; ++w) {
+                    _shares[w].next.store(
+                            count * w / _workerCount,
+                            std::memory_order_relaxed);
+                    _shares[w].end = count * (w + 1) / _workerCount;
+                }
+
+                _busy.store(_workerCount, std::memory_order_relaxed);
+
+                {
+                    std::lock_guard<std::mutex> lock(_frameMutex);
+                    _frame = frame;
+                }
+
+                _frameStart.notify_all();
+
+                work(0);
+
+                _busy.fetch_sub(1, std::memory_order_acq_rel);
+
+                while (_busy.load(std::memory_order_acquire) > 0) {
+                    std::this_thread::yield();
+                }
+
+                _finishedFrames.store(frame, std::memory_order_release);
+            }
+
+            // Only now can the other workers safely go
+            {
+                std::lock_guard<std::mutex> lock(_frameMutex);
+                _frame = STOP_FRAME;
+            }
+
+            _frameStart.notify_all();
+        }
+
+        void follow(const uint32_t worker)
+        {
+            place(worker);
+
+            uint64_t seen = 0;
+
+            while (true) {
+
+                {
+                    std::unique_lock<std::mutex> lock(_frameMutex);
+
+                    _frameStart.wait(lock, [&] { return _frame != seen; });
+
+                    if (_frame == STOP_FRAME) {
+                        return;
+                    }
+
+                    seen = _frame;
+                }
+
+                work(worker);
+
+                _busy.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+
+        void start(void)
+        {
+            _frame = 0;
+
+            _placed.store(0);
+
+            _running.store(true, std::memory_order_release);
+
+            _threads.emplace_back(&SimulationExecutor::lead, this);
+
+            for (uint32_t w=1; w<_workerCount; ++w) {
+                _threads.emplace_back(&SimulationExecutor::follow, this, w);
+            }
+
+            // So that placement reports are ready when add() returns
+            while (_placed.load(std::memory_order_acquire) < _workerCount) {
+                std::this_thread::yield();
+            }
+        }
+
+        void stop(void)
+        {
+            _running.store(false, std::memory_order_release);
+
+            for (auto & thread : _threads) {
+                thread.join();
+            }
+
+            _threads.clear();
+        }
+
+    public:
+
+        /**
+         * @param workers number of worker threads; 0 for one per hardware
+         *        thread
+         * @param rate frames per second
+         * @param placement cores and priority for every worker thread
+         */
+        SimulationExecutor(
+                const uint32_t workers=0,
+                const double rate=1000,
+                const ThreadPlacement::config_t & placement={})
+            : _scheduler(rate)
+        {
+            _placement = placement;
+
+            const auto hardware = std::thread::hardware_concurrency();
+
+            const auto count = workers > 0 ? workers :
+                hardware > 0 ? hardware : 1;
+
+            _workerCount = count < MAX_WORKERS ? count : MAX_WORKERS;
+
+            for (uint32_t w=0; w<MAX_WORKERS; ++w) {
+                _shares[w].next.store(0, std::memory_order_relaxed);
+                _shares[w].end = 0;
+            }
+
+            _startedFrames.store(0);
+            _finishedFrames.store(0);
+            _busy.store(0);
+            _running.store(false);
+            _ticks.store(0);
+            _steals.store(0);
+            _placed.store(0);
+        }
+
+        SimulationExecutor(const SimulationExecutor &) = delete;
+
+        SimulationExecutor & operator=(const SimulationExecutor &) = delete;
+
+        ~SimulationExecutor(void)
+        {
+            std::lock_guard<std::mutex> lock(_controlMutex);
+
+            if (_running.load()) {
+                stop();
+            }
+        }
+
+        /**
+         * @return executor shared by every vehicle in the process
+         */
+        static SimulationExecutor & shared(void)
+        {
+            static SimulationExecutor executor(0, 1000,
+                    ThreadPlacement::fromEnvironment().physics);
+
+            return executor;
+        }
+
+        /**
+         * Registers a task to be ticked from the next frame on, starting
+         * the workers if need be.
+         */
+        void add(SimulationTask * task)
+        {
+            std::lock_guard<std::mutex> lock(_controlMutex);
+
+            {
+                std::lock_guard<std::mutex> tasksLock(_tasksMutex);
+                _tasks.push_back(task);
+            }
+
+            if (!_running.load(std::memory_order_acquire)) {
+                start();
+            }
+        }
+
+        /**
+         * Unregisters a task, returning only once no worker is ticking it;
+         * stops the workers when no tasks are left.  Don't call from a
+         * task's tick().
+         */
+        void remove(SimulationTask * task)
+        {
+            std::lock_guard<std::mutex> lock(_controlMutex);
+
+            bool empty = false;
+
+            // Frames started before the task left may still include it
+            uint64_t started = 0;
+
+            {
+                std::lock_guard<std::mutex> tasksLock(_tasksMutex);
+
+                _tasks.erase(std::remove(_tasks.begin(), _tasks.end(), task),
+                        _tasks.end());
+
+                empty = _tasks.empty();
+
+                started = _startedFrames.load(std::memory_order_acquire);
+            }
+
+            if (!_running.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            if (empty) {
+                stop();
+                return;
+            }
+
+            while (_finishedFrames.load(std::memory_order_acquire) <
+                    started) {
+                std::this_thread::yield();
+            }
+        }
+
+        /**
+         * Sets a task to be ticked once at the start of every frame, alone,
+         * before any registered task; e.g. to do I/O for all of them at
+         * once.  Returns only once no frame is still using the previous
+         * one.  Don't call from a task's tick().
+         *
+         * @param hook task to tick, or NULL for none
+         */
+        void setFrameHook(SimulationTask * hook)
+        {
+            std::lock_guard<std::mutex> lock(_controlMutex);
+
+            uint64_t started = 0;
+
+            {
+                std::lock_guard<std::mutex> tasksLock(_tasksMutex);
+
+                _frameHook = hook;
+
+                started = _startedFrames.load(std::memory_order_acquire);
+            }
+
+            if (!_running.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            while (_finishedFrames.load(std::memory_order_acquire) <
+                    started) {
+                std::this_thread::yield();
+            }
+        }
+
+        /**
+         * Formats what a worker got of its placement, as one line of text.
+         * Call while workers are running, e.g. after add().
+         */
+        void formatPlacement(
+                const uint32_t worker, char * buf, const size_t len)
+        {
+            char name[50] = {};
+            snprintf(name, sizeof(name), "worker%u", worker);
+
+            ThreadPlacement::format(name, _placement,
+                    _placementReports[worker], buf, len);
+        }
+
+        uint32_t workerCount(void)
+        {
+            return _workerCount;
+        }
+
+        /**
+         * @return total task ticks so far
+         */
+        uint64_t ticks(void)
+        {
+            return _ticks.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @return ticks done by a worker other than the one first dealt
+         *         the task
+         */
+        uint64_t steals(void)
+        {
+            return _steals.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @return frame jitter; read only while no frames are running
+         */
+        RateScheduler::jitter_t jitter(void)
+        {
+            return _scheduler.jitter();
+        }
+
+}; // class SimulationExecutor
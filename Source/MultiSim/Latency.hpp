@@ -0,0 +1,302 @@
+/*
+ * Latency histograms for timing the stages of the simulation loop
+ *
+ * Each histogram has log-linear buckets, in the style of HdrHistogram:
+ * exact below 64 ns, then 32 buckets per power of two, so any recorded
+ * value is known to within about 3% at any scale.  Recording is a few
+ * integer operations with no allocation, so it can sit inside the 10 kHz
+ * dynamics loop.
+ *
+ * A LatencyStage keeps one histogram per time window and one for the whole
+ * run.  At the end of each window the recording thread publishes a summary
+ * (p50, p99, max) that any thread can read; the whole-run histogram is for
+ * reading once the recording thread has stopped.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "StateChannel.hpp"
+
+class LatencyHistogram {
+
+    private:
+
+        // Values below 2^SUB_BITS get a bucket each
+        static const uint8_t SUB_BITS = 6;
+        static const uint32_t SUB_COUNT = 1 << SUB_BITS;
+        static const uint32_t HALF_COUNT = SUB_COUNT / 2;
+
+        // Largest power of two covered (2^47 ns is over a day)
+        static const uint8_t MAX_BITS = 47;
+
+        static const uint32_t BUCKETS =
+            SUB_COUNT + (MAX_BITS - SUB_BITS + 1) * HALF_COUNT;
+
+        uint64_t _counts[BUCKETS] = {};
+
+        uint64_t _count = 0;
+        uint64_t _sum = 0;
+        uint64_t _max = 0;
+
+        static uint8_t highestBit(const uint64_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index = 0;
+            _BitScanReverse64(&index, value);
+            return (uint8_t)index;
+#else
+            return (uint8_t)(63 - __builtin_clzll(value));
+#endif
+        }
+
+        static uint32_t bucketOf(const uint64_t value)
+        {
+            if (value < SUB_COUNT) {
+                return (uint32_t)value;
+            }
+
+            const auto bits = highestBit(value);
+
+            if (bits > MAX_BITS) {
+                return BUCKETS - 1;
+            }
+
+            // Keep the top SUB_BITS bits
+            const uint8_t shift = bits - SUB_BITS + 1;
+
+            return SUB_COUNT + (shift - 1) * HALF_COUNT +
+                (uint32_t)(value >> shift) - HALF_COUNT;
+        }
+
+        // Largest value that falls in a bucket
+        static uint64_t bucketTop(const uint32_t bucket)
+        {
+            if (bucket < SUB_COUNT) {
+                return bucket;
+            }
+
+            const uint32_t shift = (bucket - SUB_COUNT) / HALF_COUNT + 1;
+
+            const uint64_t mantissa =
+                (bucket - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+    public:
+
+        /**
+         * @param nsec a latency in nanoseconds
+         */
+        void record(const uint64_t nsec)
+        {
+            _counts[bucketOf(nsec)]++;
+
+            _count++;
+            _sum += nsec;
+            _max = nsec > _max ? nsec : _max;
+        }
+
+        /**
+         * @param fraction e.g. 0.99 for the 99th percentile
+         * @return latency in nanoseconds that the given fraction of samples
+         *         did not exceed, to within bucket precision
+         */
+        uint64_t percentile(const double fraction)
+        {
+            if (_count == 0) {
+                return 0;
+            }
+
+            // Rank of the sample we want, counting from one
+            auto rank = (uint64_t)(fraction * _count + 0.5);
+            rank = rank < 1 ? 1 : rank > _count ? _count : rank;
+
+            uint64_t seen = 0;
+
+            for (uint32_t k=0; k<BUCKETS; ++k) {
+
+                seen += _counts[k];
+
+                if (seen >= rank) {
+                    const auto top = bucketTop(k);
+                    return top < _max ? top : _max;
+                }
+            }
+
+            return _max;
+        }
+
+        uint64_t count(void)
+        {
+            return _count;
+        }
+
+        uint64_t max(void)
+        {
+            return _max;
+        }
+
+        double mean(void)
+        {
+            return _count > 0 ? (double)_sum / _count : 0;
+        }
+
+        void reset(void)
+        {
+            memset(_counts, 0, sizeof(_counts));
+
+            _count = 0;
+            _sum = 0;
+            _max = 0;
+        }
+
+}; // class LatencyHistogram
+
+class LatencyStage {
+
+    public:
+
+        typedef std::chrono::steady_clock clock_t;
+
+        /**
+         * Latency summary, in microseconds
+         */
+        typedef struct {
+
+            uint64_t count;
+
+            double mean;
+            double p50;
+            double p99;
+            double max;
+
+        } summary_t;
+
+    private:
+
+        const char * _name = "";
+
+        clock_t::duration _window = {};
+
+        clock_t::time_point _windowEnd = {};
+
+        LatencyHistogram _current;
+        LatencyHistogram _total;
+
+        // Summary of the last complete window
+        SeqLock<summary_t> _published;
+
+        static summary_t summarize(LatencyHistogram & histogram)
+        {
+            summary_t summary = {};
+
+            summary.count = histogram.count();
+            summary.mean = histogram.mean() / 1000;
+            summary.p50 = histogram.percentile(0.50) / 1000.;
+            summary.p99 = histogram.percentile(0.99) / 1000.;
+            summary.max = histogram.max() / 1000.;
+
+            return summary;
+        }
+
+    public:
+
+        /**
+         * @param name name for reports
+         * @param windowSec seconds per window
+         */
+        LatencyStage(const char * name, const double windowSec=1)
+        {
+            _name = name;
+
+            _window = std::chrono::duration_cast<clock_t::duration>(
+                    std::chrono::duration<double>(windowSec));
+        }
+
+        /**
+         * Records one latency.  Call from a single thread.
+         *
+         * @param start when the stage began
+         * @param end when it finished
+         */
+        void record(
+                const clock_t::time_point & start,
+                const clock_t::time_point & end)
+        {
+            const auto nsec = std::chrono::duration_cast<
+                std::chrono::nanoseconds>(end - start).count();
+
+            const uint64_t value = nsec > 0 ? (uint64_t)nsec : 0;
+
+            // Close the window before recording, so that the sample goes
+            // into the one it starts; the first sample starts the first
+            if (end >= _windowEnd) {
+
+                if (_windowEnd != clock_t::time_point()) {
+                    _published.write(summarize(_current));
+                }
+
+                _current.reset();
+
+                _windowEnd = end + _window;
+            }
+
+            _current.record(value);
+            _total.record(value);
+        }
+
+        /**
+         * @return summary of the latest complete window; safe from any
+         *         thread
+         */
+        summary_t window(void) const
+        {
+            return _published.read();
+        }
+
+        /**
+         * @return summary of every sample so far; call only once recording
+         *         has stopped
+         */
+        summary_t total(void)
+        {
+            return summarize(_total);
+        }
+
+        const char * name(void)
+        {
+            return _name;
+        }
+
+        /**
+         * Formats a summary as one line of text.
+         */
+        void format(const summary_t & summary, char * buf, const size_t len)
+        {
+            snprintf(buf, len,
+                    "%-10s n=%-9llu mean=%8.2f  p50=%8.2f  p99=%8.2f  "
+                    "max=%9.2f us",
+                    _name,
+                    (unsigned long long)summary.count,
+                    summary.mean,
+                    summary.p50,
+                    summary.p99,
+                    summary.max);
+        }
+
+}; // class LatencyStage
@@ -20,6 +20,12 @@ public class MultiSim : ModuleRules
         PublicDependencyModuleNames.AddRange(new string[] 
                 { "Core", "CoreUObject", "Engine", "InputCore", "Landscape" });
 
+        // Timeline tracing of the hot paths (see Trace.hpp), when built
+        // with MULTISIM_TRACE=1 in the environment
+        if (Environment.GetEnvironmentVariable("MULTISIM_TRACE") == "1") {
+            PublicDefinitions.Add("MULTISIM_TRACE");
+        }
+
         // Supports using Hackflight core code in local thread
         PrivateIncludePaths.Add(
                 "../../../../Arduino/libraries/Hackflight/src");
@@ -0,0 +1,349 @@
+/*
+ * Thread placement: CPU affinity, real-time priority and memory locking
+ *
+ * On Linux, a simulation thread can be pinned to a set of cores and given
+ * SCHED_FIFO priority, so that rendering and logging can't preempt it, and
+ * the process's memory can be locked so that it never waits on a page
+ * fault.  Each setting is applied by the thread it is for, and reports
+ * what it actually got: real-time priority and locking usually need root
+ * or CAP_SYS_NICE / CAP_IPC_LOCK, and are refused otherwise.  Elsewhere,
+ * nothing is applied and the report says so.
+ *
+ * Settings can also come from the environment, for builds (like the Unreal
+ * Engine one) with no command line of their own:
+ *
+ *   MULTISIM_PHYSICS_CORES=2-3 MULTISIM_PHYSICS_PRIORITY=80
+ *   MULTISIM_IO_CORES=4        MULTISIM_IO_PRIORITY=70
+ *   MULTISIM_CAMERA_CORES=5    MULTISIM_CAMERA_PRIORITY=60
+ *   MULTISIM_MLOCK=1
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+class ThreadPlacement {
+
+    public:
+
+        static const uint8_t MAX_CORES = 64;
+
+        typedef struct {
+
+            uint64_t cores; // bit k allows CPU k; 0 for any
+            int priority;   // SCHED_FIFO priority, 1-99; 0 for normal
+
+        } config_t;
+
+        typedef struct {
+
+            config_t physics;
+            config_t io;
+            config_t camera;
+
+            bool lockMemory; // mlockall() current and future pages
+
+        } placement_t;
+
+        typedef struct {
+
+            bool supported; // false where placement isn't implemented
+
+            // errno from each setting; zero if applied or not asked for
+            int affinityError;
+            int priorityError;
+
+            uint64_t cores; // CPUs the thread may now run on (first 64)
+            int priority;   // SCHED_FIFO priority in effect; 0 for normal
+
+        } report_t;
+
+    private:
+
+        static void formatCores(
+                const uint64_t cores, char * buf, const size_t len)
+        {
+            buf[0] = 0;
+
+            if (cores == 0) {
+                snprintf(buf, len, "any");
+                return;
+            }
+
+            size_t used = 0;
+
+            for (uint8_t k=0; k<MAX_CORES && used<len; ++k) {
+
+                if (!(cores >> k & 1)) {
+                    continue;
+                }
+
+                // Extend to the end of the run of set bits
+                uint8_t last = k;
+                while (last + 1 < MAX_CORES && (cores >> (last + 1) & 1)) {
+                    last++;
+                }
+
+                used += snprintf(buf + used, len - used,
+                        last > k ? "%s%d-%d" : "%s%d",
+                        used ? "," : "", k, last);
+
+                k = last;
+            }
+        }
+
+        static void getConfig(const char * prefix, config_t & config)
+        {
+            char name[100] = {};
+
+            snprintf(name, sizeof(name), "MULTISIM_%s_CORES", prefix);
+
+            const char * cores = getenv(name);
+
+            if (cores && !parseCores(cores, config.cores)) {
+                fprintf(stderr, "Bad core list in %s: %s\n", name, cores);
+            }
+
+            snprintf(name, sizeof(name), "MULTISIM_%s_PRIORITY", prefix);
+
+            const char * priority = getenv(name);
+
+            if (priority) {
+                config.priority = atoi(priority);
+            }
+        }
+
+    public:
+
+        /**
+         * Applies a configuration to the calling thread.
+         *
+         * @return what the thread ended up with
+         */
+        static report_t apply(const config_t & config)
+        {
+            report_t report = {};
+
+#ifdef __linux__
+            report.supported = true;
+
+            if (config.cores) {
+
+                cpu_set_t set;
+                CPU_ZERO(&set);
+
+                for (uint8_t k=0; k<MAX_CORES; ++k) {
+                    if (config.cores >> k & 1) {
+                        CPU_SET(k, &set);
+                    }
+                }
+
+                report.affinityError =
+                    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            }
+
+            if (config.priority > 0) {
+
+                sched_param param = {};
+                param.sched_priority = config.priority;
+
+                report.priorityError =
+                    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            }
+
+            // Read back what we got
+            cpu_set_t set;
+            CPU_ZERO(&set);
+
+            if (!pthread_getaffinity_np(pthread_self(), sizeof(set), &set)) {
+                for (uint8_t k=0; k<MAX_CORES; ++k) {
+                    if (CPU_ISSET(k, &set)) {
+                        report.cores |= (uint64_t)1 << k;
+                    }
+                }
+            }
+
+            int policy = 0;
+            sched_param param = {};
+
+            if (!pthread_getschedparam(pthread_self(), &policy, &param) &&
+                    (policy == SCHED_FIFO || policy == SCHED_RR)) {
+                report.priority = param.sched_priority;
+            }
+#else
+            (void)config;
+#endif
+
+            return report;
+        }
+
+        /**
+         * Locks the process's current and future pages into memory.
+         *
+         * @return zero on success, else an errno value
+         */
+        static int lockMemory(void)
+        {
+#ifdef __linux__
+            return mlockall(MCL_CURRENT | MCL_FUTURE) ? errno : 0;
+#else
+            return -1;
+#endif
+        }
+
+        /**
+         * Parses a core list like "2-3,6".
+         *
+         * @param list the list
+         * @param cores output, bit k set for CPU k
+         * @return false if the list is malformed or names a core past
+         *         MAX_CORES
+         */
+        static bool parseCores(const char * list, uint64_t & cores)
+        {
+            uint64_t result = 0;
+
+            const char * p = list;
+
+            while (*p) {
+
+                char * end = NULL;
+
+                const auto first = strtol(p, &end, 10);
+
+                if (end == p) {
+                    return false;
+                }
+
+                auto last = first;
+
+                p = end;
+
+                if (*p == '-') {
+
+                    last = strtol(++p, &end, 10);
+
+                    if (end == p) {
+                        return false;
+                    }
+
+                    p = end;
+                }
+
+                if (first < 0 || last < first || last >= MAX_CORES) {
+                    return false;
+                }
+
+                for (auto k=first; k<=last; ++k) {
+                    result |= (uint64_t)1 << k;
+                }
+
+                if (*p == ',') {
+                    p++;
+                }
+                else if (*p) {
+                    return false;
+                }
+            }
+
+            cores = result;
+
+            return true;
+        }
+
+        /**
+         * Reads a placement from the MULTISIM_* environment variables;
+         * anything unset is left at its default.
+         */
+        static placement_t fromEnvironment(void)
+        {
+            placement_t placement = {};
+
+            getConfig("PHYSICS", placement.physics);
+            getConfig("IO", placement.io);
+            getConfig("CAMERA", placement.camera);
+
+            const char * lock = getenv("MULTISIM_MLOCK");
+
+            placement.lockMemory = lock && *lock && strcmp(lock, "0");
+
+            return placement;
+        }
+
+        /**
+         * Formats a report as one line of text, noting any setting that
+         * was asked for but not applied.
+         */
+        static void format(
+                const char * name,
+                const config_t & config,
+                const report_t & report,
+                char * buf,
+                const size_t len)
+        {
+            if (!report.supported) {
+                snprintf(buf, len, "%-8s placement not supported here", name);
+                return;
+            }
+
+            char cores[200] = {};
+            formatCores(report.cores, cores, sizeof(cores));
+
+            char affinity[300] = {};
+
+            if (report.affinityError) {
+                char asked[200] = {};
+                formatCores(config.cores, asked, sizeof(asked));
+                snprintf(affinity, sizeof(affinity), " (asked %s: %s)",
+                        asked, strerror(report.affinityError));
+            }
+
+            char priority[200] = {};
+
+            if (report.priorityError) {
+                snprintf(priority, sizeof(priority), " (asked FIFO %d: %s)",
+                        config.priority, strerror(report.priorityError));
+            }
+
+            char policy[50] = {};
+            snprintf(policy, sizeof(policy),
+                    report.priority > 0 ? "FIFO %d" : "normal",
+                    report.priority);
+
+            snprintf(buf, len, "%-8s cores %s%s, %s%s",
+                    name, cores, affinity, policy, priority);
+        }
+
+        /**
+         * Formats the result of lockMemory() as one line of text.
+         */
+        static void formatLock(const int error, char * buf, const size_t len)
+        {
+            if (error < 0) {
+                snprintf(buf, len, "%-8s locking not supported here",
+                        "memory");
+            }
+            else if (error) {
+                snprintf(buf, len, "%-8s not locked: %s", "memory",
+                        strerror(error));
+            }
+            else {
+                snprintf(buf, len, "%-8s locked", "memory");
+            }
+        }
+
+}; // class ThreadPlacement
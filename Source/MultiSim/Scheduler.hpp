@@ -0,0 +1,155 @@
+/*
+ * Fixed-rate wakeup scheduler
+ *
+ * Wakes a loop at a fixed rate against absolute deadlines, so that timing
+ * errors don't accumulate.  Each wait sleeps until shortly before the
+ * deadline, then spins the rest of the way: sleeping keeps the core free
+ * for other work, spinning hides the operating system's wakeup latency.
+ * Lateness of every wakeup is recorded as jitter statistics.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#include <chrono>
+#include <thread>
+
+class RateScheduler {
+
+    public:
+
+        /**
+         * Wakeup lateness, in microseconds
+         */
+        typedef struct {
+
+            uint64_t wakeups;
+            uint64_t overruns; // deadlines missed by a whole period or more
+
+            double mean;
+            double stddev;
+            double max;
+
+        } jitter_t;
+
+    private:
+
+        typedef std::chrono::steady_clock clock_t;
+
+        clock_t::duration _period = {};
+
+        // How far ahead of the deadline to stop sleeping and start spinning
+        clock_t::duration _spin = {};
+
+        clock_t::time_point _deadline = {};
+
+        // Running lateness statistics (Welford)
+        uint64_t _wakeups = 0;
+        uint64_t _overruns = 0;
+        double _mean = 0;
+        double _m2 = 0;
+        double _max = 0;
+
+        void record(const double lateUsec)
+        {
+            _wakeups++;
+
+            const auto delta = lateUsec - _mean;
+            _mean += delta / _wakeups;
+            _m2 += delta * (lateUsec - _mean);
+
+            _max = lateUsec > _max ? lateUsec : _max;
+        }
+
+    public:
+
+        /**
+         * @param rate wakeups per second
+         * @param spinUsec microseconds before each deadline to spin instead
+         *        of sleep; zero to sleep all the way
+         */
+        RateScheduler(const double rate=1000, const uint32_t spinUsec=200)
+        {
+            _period = std::chrono::duration_cast<clock_t::duration>(
+                    std::chrono::duration<double>(1 / rate));
+
+            _spin = std::chrono::microseconds(spinUsec);
+        }
+
+        /**
+         * Sets the first deadline one period from now, and clears the
+         * statistics.
+         */
+        void start(void)
+        {
+            _deadline = clock_t::now() + _period;
+
+            resetJitter();
+        }
+
+        /**
+         * Waits for the next deadline.
+         */
+        void wait(void)
+        {
+            const auto wake = _deadline - _spin;
+
+            if (clock_t::now() < wake) {
+                std::this_thread::sleep_until(wake);
+            }
+
+            while (clock_t::now() < _deadline) {
+            }
+
+            const auto now = clock_t::now();
+
+            record(std::chrono::duration<double, std::micro>(
+                        now - _deadline).count());
+
+            _deadline += _period;
+
+            // A stall of a period or more: skip the missed deadlines rather
+            // than waking back-to-back to make them up
+            if (_deadline <= now) {
+                _overruns++;
+                _deadline = now + _period;
+            }
+        }
+
+        /**
+         * @return seconds between wakeups
+         */
+        double period(void)
+        {
+            return std::chrono::duration<double>(_period).count();
+        }
+
+        jitter_t jitter(void)
+        {
+            jitter_t jitter = {};
+
+            jitter.wakeups = _wakeups;
+            jitter.overruns = _overruns;
+            jitter.mean = _mean;
+            jitter.stddev = _wakeups > 1 ? sqrt(_m2 / (_wakeups - 1)) : 0;
+            jitter.max = _max;
+
+            return jitter;
+        }
+
+        void resetJitter(void)
+        {
+            _wakeups = 0;
+            _overruns = 0;
+            _mean = 0;
+            _m2 = 0;
+            _max = 0;
+        }
+
+}; // class RateScheduler
@@ -0,0 +1,230 @@
+/*
+ * Lock-free publication of vehicle state from the dynamics thread
+ *
+ * The dynamics thread publishes a timestamped copy of the state after every
+ * update; the game thread (pose, animation, cameras) reads the latest copy
+ * whenever it likes.  Publication is a sequence lock: the writer never
+ * waits, and a reader that overlaps a write simply tries again, so readers
+ * always see a state from a single update, never a mix of two.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+#include "Dynamics.hpp"
+
+/**
+ * Single-writer, multiple-reader sequence lock for plain-old-data values.
+ * The value is stored as relaxed atomic words, so concurrent reads and
+ * writes are well-defined; the sequence number tells readers whether what
+ * they copied was coherent.
+ */
+template <typename T>
+class SeqLock {
+
+    static_assert(std::is_trivially_copyable<T>::value,
+            "SeqLock values must be trivially copyable");
+
+    private:
+
+        static const uint32_t WORDS = (sizeof(T) + 7) / 8;
+
+        // Odd while a write is in progress
+        alignas(64) std::atomic<uint32_t> _sequence;
+
+        std::atomic<uint64_t> _words[WORDS];
+
+    public:
+
+        SeqLock(void)
+        {
+            _sequence.store(0, std::memory_order_relaxed);
+
+            for (uint32_t k=0; k<WORDS; ++k) {
+                _words[k].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        SeqLock(const SeqLock &) = delete;
+
+        SeqLock & operator=(const SeqLock &) = delete;
+
+        /**
+         * Publishes a new value.  Call from one thread only.  Wait-free.
+         */
+        void write(const T & value)
+        {
+            uint64_t words[WORDS] = {};
+            memcpy(words, &value, sizeof(T));
+
+            const auto sequence =
+                _sequence.load(std::memory_order_relaxed);
+
+            _sequence.store(sequence + 1, std::memory_order_relaxed);
+
+            // Keep the word stores below from moving above the odd sequence
+            std::atomic_thread_fence(std::memory_order_release);
+
+            for (uint32_t k=0; k<WORDS; ++k) {
+                _words[k].store(words[k], std::memory_order_relaxed);
+            }
+
+            _sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        /**
+         * Copies the latest value, if no write overlapped the copy.
+         *
+         * @param value output
+         * @return true on success, false to try again
+         */
+        bool tryRead(T & value) const
+        {
+            const auto before = _sequence.load(std::memory_order_acquire);
+
+            if (before & 1) {
+                return false;
+            }
+
+            uint64_t words[WORDS] = {};
+
+            for (uint32_t k=0; k<WORDS; ++k) {
+                words[k] = _words[k].load(std::memory_order_relaxed);
+            }
+
+            // Keep the word loads above from moving below the check
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (_sequence.load(std::memory_order_relaxed) != before) {
+                return false;
+            }
+
+            memcpy(&value, words, sizeof(T));
+
+            return true;
+        }
+
+        /**
+         * Copies the latest value, retrying until no write overlaps the
+         * copy.  The writer holds the lock for a few dozen stores, so
+         * retries are rare and short.
+         */
+        T read(void) const
+        {
+            T value;
+
+            while (!tryRead(value)) {
+            }
+
+            return value;
+        }
+
+        /**
+         * @return number of values written so far
+         */
+        uint32_t writes(void) const
+        {
+            return _sequence.load(std::memory_order_acquire) / 2;
+        }
+
+}; // class SeqLock
+
+class StateChannel {
+
+    public:
+
+        /**
+         * Everything the game thread needs from one dynamics update.  State
+         * is in the same frame as the Dynamics getters (ENU Z, radians).
+         */
+        typedef struct {
+
+            double time;    // simulated seconds
+            uint64_t steps; // dynamics updates so far
+
+            float x;
+            float dx;
+            float y;
+            float dy;
+            float z;
+            float dz;
+            float phi;
+            float dphi;
+            float theta;
+            float dtheta;
+            float psi;
+            float dpsi;
+
+            float actuators[Dynamics::MAX_ROTORS];
+
+        } state_t;
+
+    private:
+
+        SeqLock<state_t> _lock;
+
+    public:
+
+        /**
+         * Fills a state record from the dynamics.
+         *
+         * @param time simulated time in seconds
+         * @param steps dynamics updates so far
+         * @param dynamics vehicle dynamics
+         * @param actuators actuator values the dynamics are flying
+         * @param state record to fill
+         */
+        static void capture(
+                const double time,
+                const uint64_t steps,
+                Dynamics * dynamics,
+                const float * actuators,
+                state_t & state)
+        {
+            state.time = time;
+            state.steps = steps;
+
+            state.x = dynamics->getStateX();
+            state.dx = dynamics->getStateDx();
+            state.y = dynamics->getStateY();
+            state.dy = dynamics->getStateDy();
+            state.z = dynamics->getStateZ();
+            state.dz = dynamics->getStateDz();
+            state.phi = dynamics->getStatePhi();
+            state.dphi = dynamics->getStateDphi();
+            state.theta = dynamics->getStateTheta();
+            state.dtheta = dynamics->getStateDtheta();
+            state.psi = dynamics->getStatePsi();
+            state.dpsi = dynamics->getStateDpsi();
+
+            memset(state.actuators, 0, sizeof(state.actuators));
+            memcpy(state.actuators, actuators,
+                    dynamics->actuatorCount() * sizeof(float));
+        }
+
+        /**
+         * Publishes a state.  Call from the dynamics thread only.
+         */
+        void publish(const state_t & state)
+        {
+            _lock.write(state);
+        }
+
+        /**
+         * @return latest published state; all zeros before the first
+         */
+        state_t read(void) const
+        {
+            return _lock.read();
+        }
+
+}; // class StateChannel
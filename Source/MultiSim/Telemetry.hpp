@@ -0,0 +1,303 @@
+/*
+ * Telemetry and motor messages exchanged with the flight controller
+ *
+ * Telemetry out is seventeen doubles: time in seconds, the 12D state vector
+ * (angles in degrees), and four stick demands.  A negative time tells the
+ * flight controller that the simulation is over.  Motor values come back as
+ * one float per actuator, with -1 as the first value to halt.
+ *
+ * In lockstep mode each telemetry message carries a sequence number as an
+ * eighteenth double, and the flight controller echoes it as a uint32 after
+ * the motor values, so that replies can be matched to requests.
+ *
+ * Alternatively, both kinds of message can be framed with the versioned
+ * header of sockets/WireProtocol.hpp, carrying sequence numbers and
+ * timestamps: telemetry as sixteen values (time moves to the header) in
+ * float64 or float32, and motors as float32, with halting flagged in the
+ * header.
+ *
+ * Shared by FVehicleThread and the headless simulator, so that a flight
+ * controller can't tell them apart.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StateChannel.hpp"
+
+#include "sockets/WireProtocol.hpp"
+
+class Telemetry {
+
+    private:
+
+        static double rad2deg(const double rad)
+        {
+            return (180 * rad / M_PI);
+        }
+
+    public:
+
+        // Time : State : Demands
+        static const uint8_t SIZE = 17;
+
+        // Time : State : Demands : Sequence
+        static const uint8_t SEQUENCED_SIZE = SIZE + 1;
+
+        // State : Demands, after the header
+        static const uint8_t WIRE_SIZE = SIZE - 1;
+
+        // Largest message of any format
+        static const size_t MAX_BYTES =
+            sizeof(WireProtocol::header_t) + WIRE_SIZE * sizeof(double);
+
+        typedef enum {
+
+            FORMAT_RAW,    // seventeen doubles out, floats back
+            FORMAT_WIRE,   // framed, telemetry in float64
+            FORMAT_WIRE32  // framed, telemetry in float32
+
+        } format_t;
+
+        /**
+         * @param name "raw", "wire" or "wire32"
+         * @param format output
+         * @return false for any other name
+         */
+        static bool parseFormat(const char * name, format_t & format)
+        {
+            static const char * names[] = {"raw", "wire", "wire32"};
+
+            for (uint8_t k=0; k<3; ++k) {
+                if (!strcmp(name, names[k])) {
+                    format = (format_t)k;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /**
+         * @return format named by $MULTISIM_PROTOCOL, or else raw
+         */
+        static format_t formatFromEnvironment(void)
+        {
+            format_t format = FORMAT_RAW;
+
+            const char * name = getenv("MULTISIM_PROTOCOL");
+
+            if (name) {
+                parseFormat(name, format);
+            }
+
+            return format;
+        }
+
+        /**
+         * Fills a telemetry message from a published state.
+         *
+         * @param state state to send, with its simulated time
+         * @param joyvals stick demands: throttle in [-1,+1], then roll, pitch,
+         *        and yaw
+         * @param telemetry message to fill
+         */
+        static void pack(
+                const StateChannel::state_t & state,
+                const float * joyvals,
+                double telemetry[SIZE])
+        {
+            // First output value is time
+            telemetry[0] = state.time;
+
+            // Next output values are state
+            telemetry[1] = state.x;
+            telemetry[2] = state.dx;
+            telemetry[3] = state.y;
+            telemetry[4] = state.dy;
+            telemetry[5] = state.z;
+            telemetry[6] = state.dz;
+            telemetry[7] = rad2deg(state.phi);
+            telemetry[8] = rad2deg(state.dphi);
+            telemetry[9] = rad2deg(state.theta);
+            telemetry[10] = rad2deg(state.dtheta);
+            telemetry[11] = rad2deg(state.psi);
+            telemetry[12] = rad2deg(state.dpsi);
+
+            // Remaining output values are stick demands
+            telemetry[13] = ((double)joyvals[0] + 1) / 2;  // [-1,+1] => [0,1]
+            telemetry[14] = (double)joyvals[1];
+            telemetry[15] = (double)joyvals[2];
+            telemetry[16] = (double)joyvals[3];
+        }
+
+        /**
+         * Fills a telemetry message.
+         *
+         * @param time simulated time in seconds
+         * @param dynamics vehicle dynamics
+         * @param joyvals stick demands: throttle in [-1,+1], then roll, pitch,
+         *        and yaw
+         * @param telemetry message to fill
+         */
+        static void pack(
+                const double time,
+                Dynamics * dynamics,
+                const float * joyvals,
+                double telemetry[SIZE])
+        {
+            const float actuators[Dynamics::MAX_ROTORS] = {};
+
+            StateChannel::state_t state = {};
+            StateChannel::capture(time, 0, dynamics, actuators, state);
+
+            pack(state, joyvals, telemetry);
+        }
+
+        /**
+         * Adds a sequence number to a telemetry message, for lockstep mode.
+         */
+        static void packSequence(
+                const uint32_t sequence, double telemetry[SEQUENCED_SIZE])
+        {
+            telemetry[SIZE] = sequence;
+        }
+
+        /**
+         * @return size in bytes of a sequenced motor message
+         */
+        static size_t sequencedMotorSize(const uint8_t actuatorCount)
+        {
+            return actuatorCount * sizeof(float) + sizeof(uint32_t);
+        }
+
+        /**
+         * @return sequence number echoed in a motor message, for lockstep
+         *         mode
+         */
+        static uint32_t unpackSequence(
+                const void * message, const uint8_t actuatorCount)
+        {
+            uint32_t sequence = 0;
+
+            memcpy(&sequence,
+                    (const uint8_t *)message + actuatorCount * sizeof(float),
+                    sizeof(sequence));
+
+            return sequence;
+        }
+
+        /**
+         * Fills a telemetry message telling the flight controller we're done.
+         */
+        static void packHalt(double telemetry[SIZE])
+        {
+            // Send a bogus time value
+            telemetry[0] = -1;
+        }
+
+        /**
+         * Fills a framed telemetry message.
+         *
+         * @param state state to send, with its simulated time
+         * @param joyvals stick demands, as for pack()
+         * @param sequence our message count
+         * @param ack sequence number of the newest motor message received
+         * @param format FORMAT_WIRE or FORMAT_WIRE32
+         * @param buf output, at least MAX_BYTES
+         * @param halt true to tell the flight controller we're done
+         * @return message size in bytes
+         */
+        static size_t packWire(
+                const StateChannel::state_t & state,
+                const float * joyvals,
+                const uint32_t sequence,
+                const uint32_t ack,
+                const format_t format,
+                void * buf,
+                const bool halt=false)
+        {
+            double telemetry[SIZE] = {};
+            pack(state, joyvals, telemetry);
+
+            const auto header = WireProtocol::header(
+                    WireProtocol::SCHEMA_TELEMETRY, sequence, ack, state.time,
+                    (format == FORMAT_WIRE32 ? WireProtocol::FLAG_FLOAT32 : 0) |
+                    (halt ? WireProtocol::FLAG_HALT : 0));
+
+            // Time is in the header
+            return WireProtocol::encode(
+                    header, telemetry + 1, WIRE_SIZE, buf, MAX_BYTES);
+        }
+
+        /**
+         * @return size in bytes of a telemetry message
+         */
+        static size_t telemetrySize(const format_t format)
+        {
+            return format == FORMAT_RAW ? SIZE * sizeof(double) :
+                WireProtocol::size(WIRE_SIZE, format == FORMAT_WIRE32);
+        }
+
+        /**
+         * @return size in bytes of a motor message
+         */
+        static size_t motorSize(
+                const format_t format, const uint8_t actuatorCount)
+        {
+            return format == FORMAT_RAW ? actuatorCount * sizeof(float) :
+                WireProtocol::size(actuatorCount, true);
+        }
+
+        /**
+         * Reads a framed motor message.
+         *
+         * @param message the message
+         * @param len its size in bytes
+         * @param actuatorCount values expected
+         * @param actuators output
+         * @param header output
+         * @return false if the message isn't a motor message of
+         *         actuatorCount values
+         */
+        static bool unpackWireMotors(
+                const void * message,
+                const size_t len,
+                const uint8_t actuatorCount,
+                float * actuators,
+                WireProtocol::header_t & header)
+        {
+            double values[WireProtocol::MAX_VALUES] = {};
+
+            const auto count = WireProtocol::decode(message, len, header,
+                    values, WireProtocol::MAX_VALUES);
+
+            if (count != actuatorCount ||
+                    header.schema != WireProtocol::SCHEMA_MOTORS) {
+                return false;
+            }
+
+            for (uint8_t k=0; k<actuatorCount; ++k) {
+                actuators[k] = (float)values[k];
+            }
+
+            return true;
+        }
+
+        /**
+         * @return true if the flight controller has asked us to halt
+         */
+        static bool isHalt(const float * actuators)
+        {
+            return actuators[0] == -1;
+        }
+
+}; // class Telemetry
@@ -12,37 +12,71 @@
 
 #define WIN32_LEAN_AND_MEAN
 
-#include "../sockets/UdpClientSocket.hpp"
-#include "../sockets/UdpServerSocket.hpp"
-
 #include "../Joystick.h"
 
+#include "Clock.hpp"
+#include "ControllerBatch.hpp"
+#include "ControllerLink.hpp"
 #include "Dynamics.hpp"
+#include "Executor.hpp"
+#include "Latency.hpp"
+#include "Placement.hpp"
+#include "Scheduler.hpp"
+#include "StateChannel.hpp"
+#include "Trace.hpp"
 #include "Utils.hpp"
 
 #include "Runtime/Core/Public/HAL/Runnable.h"
 
-class FVehicleThread : public FRunnable {
+class FVehicleThread : public FRunnable, public SimulationTask {
 
     private:
 
-        // Relates dynamics update to PID update
-        static const uint32_t CONTROLLER_PERIOD = 100;
+        // Fixed physics time step, independent of OS scheduling
+        SimulationClock _clock;
+
+        // Wakes the thread at a fixed rate instead of spinning
+        RateScheduler _scheduler;
+
+        // Latest wakeup jitter, for getMessage()
+        SeqLock<RateScheduler::jitter_t> _jitter;
 
-        // Time : State : Demands
-        double _telemetry[17] = {};
+        // Time taken by dynamics updates and joystick polls
+        LatencyStage _dynamicsLatency;
+        LatencyStage _joystickLatency;
 
-        // Socket comms
-        UdpClientSocket * _telemClient = NULL;
-        UdpServerSocket * _motorServer = NULL;
+        // Simulated seconds between PID updates, and time of the next one
+        double _controllerPeriod = 0;
+        double _controllerTime = 0;
+
+        // Telemetry out and motors in, on a thread of their own
+        ControllerLink * _link = NULL;
+
+        // Or, on a pool, batched with the other vehicles' (see start())
+        ControllerBatch * _batch = NULL;
+        uint32_t _batchId = 0;
+        char _batchHost[200] = {};
+        short _batchMotorPort = 0;
+        short _batchTelemPort = 0;
 
         // Guards socket comms
         bool _connected = false;
 
+        // Step K times, then wait for the controller, instead of running
+        // on wall-clock time
+        bool _lockstep = false;
+
         // Joystick / game controller / RC transmitter
         IJoystick * _joystick;
 
+        // Either a thread of our own, or a share of a pool's
         FRunnableThread * _thread = NULL;
+        SimulationExecutor * _executor = NULL;
+
+        // Cores, priority and memory locking asked for, and what we got
+        ThreadPlacement::placement_t _placement = {};
+        ThreadPlacement::report_t _physicsPlacement = {};
+        int _lockError = 0;
 
         // Flags set by begin/end play
         bool _running = false;
@@ -54,112 +88,331 @@ class FVehicleThread : public FRunnable {
         uint32_t _dynamicsCount;
         uint32_t _pidCount;
 
-        // Set by controller; returned for animation
+        // Set by controller
         float _actuatorValues[100] = {}; 
 
+        // State after each dynamics update, for the game thread
+        StateChannel _stateChannel;
+
+        // Most recently published state
+        StateChannel::state_t _state = {};
+
         uint8_t _actuatorCount = 0;
 
         Dynamics * _dynamics = NULL;
 
-        static double rad2deg(const double rad)
+        void construct(
+                Dynamics * dynamics,
+                const char * host,
+                const short motorPort,
+                const short telemPort,
+                const double controllerRate,
+                const ThreadPlacement::placement_t & placement,
+                const bool pooled=false)
         {
-            return (180 * rad / M_PI);
+            _placement = placement;
+
+            // Before the threads start, so that it covers their stacks too
+            if (_placement.lockMemory) {
+                _lockError = ThreadPlacement::lockMemory();
+            }
+
+            _startTime = FPlatformTime::Seconds();
+
+            _pidCount = 0;
+            _dynamicsCount = 0;
+
+            _controllerPeriod = 1 / controllerRate;
+
+            _actuatorCount = dynamics->actuatorCount();
+
+            _dynamics = dynamics;
+
+            _joystick = new IJoystick();
+
+            static const char * BATCH_PREFIX = "batch:";
+
+            const auto batched =
+                strncmp(host, BATCH_PREFIX, strlen(BATCH_PREFIX)) == 0;
+
+            if (batched) {
+                host += strlen(BATCH_PREFIX);
+            }
+
+            // Only a pool has frames to batch with; a vehicle on its own
+            // thread uses plain UDP
+            if (batched && pooled) {
+
+                mysprintf(_batchHost, "%s", host);
+                _batchMotorPort = motorPort;
+                _batchTelemPort = telemPort;
+
+                _link = new ControllerLink(_actuatorCount);
+            }
+
+            else {
+                _link = new ControllerLink(
+                        host, motorPort, telemPort, _actuatorCount);
+            }
+
+            _connected = true;
         }
 
-        void getActuators(const double timeSec)
+        // Starts the clock and the link to the flight controller
+        void begin(void)
         {
-            float joyvals[10] = {};
+            _running = true;
+
+            _clock.start(FPlatformTime::Seconds() - _startTime);
+
+            _link->start(_lockstep, _placement.io);
+
+            _controllerTime = _controllerPeriod;
+        }
+
+        // Logs what each thread got of the placement asked for
+        void reportPlacement(void)
+        {
+            char line[500] = {};
+
+            if (_executor) {
+                for (uint32_t w=0; w<_executor->workerCount(); ++w) {
+                    _executor->formatPlacement(w, line, sizeof(line));
+                    UE_LOG(LogTemp, Display, TEXT("Placement: %s"),
+                            ANSI_TO_TCHAR(line));
+                }
+            }
+            else {
+                ThreadPlacement::format("physics", _placement.physics,
+                        _physicsPlacement, line, sizeof(line));
+                UE_LOG(LogTemp, Display, TEXT("Placement: %s"),
+                        ANSI_TO_TCHAR(line));
+            }
+
+            _link->formatPlacement(line, sizeof(line));
+            UE_LOG(LogTemp, Display, TEXT("Placement: %s"),
+                    ANSI_TO_TCHAR(line));
+
+            if (_placement.lockMemory) {
+                ThreadPlacement::formatLock(_lockError, line, sizeof(line));
+                UE_LOG(LogTemp, Display, TEXT("Placement: %s"),
+                        ANSI_TO_TCHAR(line));
+            }
+        }
+
+        void updateDynamics(void)
+        {
+            TRACE_SCOPE("dynamics");
+
+            const auto start = LatencyStage::clock_t::now();
+
+            // Update dynamics, in single precision
+            _dynamics->update(_actuatorValues, (float)_clock.dt());
+
+            _dynamicsLatency.record(start, LatencyStage::clock_t::now());
+        }
+
+        void pollJoystick(float * joyvals)
+        {
+            TRACE_SCOPE("joystick");
+
+            const auto start = LatencyStage::clock_t::now();
+
             _joystick->poll(joyvals);
 
+            _joystickLatency.record(start, LatencyStage::clock_t::now());
+        }
+
+        // Picks up any new motor values; called every dynamics update
+        void getActuators(void)
+        {
             // Avoid null-pointer exceptions at startup, freeze after control
             // program halts
-            if (!(_telemClient && _motorServer && _connected)) {
+            if (!(_link && _connected)) {
                 return;
             }
 
-            // First output value is time
-            _telemetry[0] = timeSec;
-
-            // Next output values are state
-            _telemetry[1] = _dynamics->getStateX();
-            _telemetry[2] = _dynamics->getStateDx();
-            _telemetry[3] = _dynamics->getStateY();
-            _telemetry[4] = _dynamics->getStateDy();
-            _telemetry[5] = _dynamics->getStateZ();
-            _telemetry[6] = _dynamics->getStateDz();
-            _telemetry[7] = rad2deg(_dynamics->getStatePhi());
-            _telemetry[8] = rad2deg(_dynamics->getStateDphi());
-            _telemetry[9] = rad2deg(_dynamics->getStateTheta());
-            _telemetry[10] = rad2deg(_dynamics->getStateDtheta());
-            _telemetry[11] = rad2deg(_dynamics->getStatePsi());
-            _telemetry[12] = rad2deg(_dynamics->getStateDpsi());
-
-            // Remaining output values are stick demands
-            _telemetry[13] = ((double)joyvals[0] + 1) / 2;  // [-1,+1] => [0,1]
-            _telemetry[14] = (double)joyvals[1];
-            _telemetry[15] = (double)joyvals[2];
-            _telemetry[16] = (double)joyvals[3];
-
-            // Send telemetry values to server
-            _telemClient->sendData(_telemetry, sizeof(_telemetry));
-
-            // Get motor values from server
-            _motorServer->receiveData(
-                    _actuatorValues, sizeof(float) * _actuatorCount);
-
             // Server sends a -1 to halt
-            if (_actuatorValues[0] == -1) {
+            if (_link->halted()) {
                 _actuatorValues[0] = 0;
                 _connected = false;
                 return;
             }
+
+            _link->receive(_actuatorValues);
+        }
+
+        // Asks the I/O thread for a controller update; never waits for it
+        void requestActuators(void)
+        {
+            TRACE_SCOPE("request actuators");
+
+            float joyvals[10] = {};
+            pollJoystick(joyvals);
+
+            if (!(_link && _connected)) {
+                return;
+            }
+
+            _link->post(_state, joyvals);
+        }
+
+        // Lockstep mode: runs one controller period of dynamics, then trades
+        // telemetry for motor values
+        void runLockstep(void)
+        {
+            // Dynamics updates per controller update
+            const auto period =
+                (uint32_t)round(_controllerPeriod / _clock.dt());
+
+            const auto steps = period > 0 ? period : 1;
+
+            while (_running && _connected) {
+
+                for (uint32_t k=0; k<steps; ++k) {
+
+                    updateDynamics();
+
+                    _clock.step();
+
+                    _dynamicsCount++;
+
+                    StateChannel::capture(_clock.time(), _dynamicsCount,
+                            _dynamics, _actuatorValues, _state);
+                    _stateChannel.publish(_state);
+                }
+
+                float joyvals[10] = {};
+                pollJoystick(joyvals);
+
+                TRACE_SCOPE("exchange");
+
+                if (!_link->exchange(_state, joyvals, _actuatorValues)) {
+                    _actuatorValues[0] = 0;
+                    _connected = false;
+                }
+
+                _pidCount++;
+            }
         }
 
 
     public:
 
-        // Constructor, called main thread
+        // Stages of the loop with latency histograms
+        typedef enum {
+
+            LATENCY_DYNAMICS,  // one dynamics update
+            LATENCY_TELEMETRY, // packing and sending telemetry
+            LATENCY_MOTORS,    // waiting for motor values
+            LATENCY_COMMAND,   // age of motor values when first applied
+            LATENCY_ONE_WAY,   // controller to us, with MULTISIM_PROTOCOL=wire
+            LATENCY_JOYSTICK,  // polling the game controller
+            LATENCY_STAGES
+
+        } latency_stage_t;
+
+        /**
+         * Runs the vehicle on a thread of its own.  Called from the main
+         * thread.  The host is the flight controller's UDP host, or
+         * "shm:NAME" or "unix:PATH" to talk over shared memory or
+         * Unix-domain sockets to a controller on this machine.
+         */
         FVehicleThread(
                 Dynamics * dynamics,
                 const char * host="127.0.0.1",
                 const short motorPort=5000,
-                const short telemPort=5001)
-
+                const short telemPort=5001,
+                const double physicsRate=10000,
+                const double controllerRate=100,
+                const double wakeRate=1000,
+                const uint32_t maxSubsteps=50,
+                const SimulationClock::policy_t policy=
+                    SimulationClock::POLICY_CATCH_UP,
+                const bool lockstep=false,
+                const ThreadPlacement::placement_t & placement=
+                    ThreadPlacement::fromEnvironment())
+            : _clock(physicsRate, maxSubsteps, policy),
+              _scheduler(wakeRate < physicsRate ? wakeRate : physicsRate),
+              _dynamicsLatency("dynamics"),
+              _joystickLatency("joystick")
         {
+            _lockstep = lockstep;
+
+            construct(dynamics, host, motorPort, telemPort, controllerRate,
+                    placement);
+
             _thread =
                 FRunnableThread::Create(
                         this, TEXT("FThreadedManager"), 0, TPri_BelowNormal);
+        }
 
-            _startTime = FPlatformTime::Seconds();
+        /**
+         * Runs the vehicle on a shared pool of threads, ticked at the
+         * executor's rate along with every other vehicle registered with
+         * it, once start() is called.  Called from the main thread.  Cores
+         * and priority for the physics come from the executor's own
+         * placement.  With host "batch:HOST", telemetry and motors travel
+         * with every other such vehicle's on the executor, through one
+         * socket (see ControllerBatch), instead of on an I/O thread each.
+         */
+        FVehicleThread(
+                Dynamics * dynamics,
+                SimulationExecutor & executor,
+                const char * host="127.0.0.1",
+                const short motorPort=5000,
+                const short telemPort=5001,
+                const double physicsRate=10000,
+                const double controllerRate=100,
+                const uint32_t maxSubsteps=50,
+                const SimulationClock::policy_t policy=
+                    SimulationClock::POLICY_CATCH_UP,
+                const ThreadPlacement::placement_t & placement=
+                    ThreadPlacement::fromEnvironment())
+            : _clock(physicsRate, maxSubsteps, policy),
+              _dynamicsLatency("dynamics"),
+              _joystickLatency("joystick")
+        {
+            construct(dynamics, host, motorPort, telemPort, controllerRate,
+                    placement, true);
 
-            _pidCount = 0;
-            _dynamicsCount = 0;
+            _executor = &executor;
+        }
 
-            _actuatorCount = dynamics->actuatorCount();
+        /**
+         * Registers a pooled vehicle with its executor, whose workers then
+         * start updating the dynamics.  Called from the main thread once
+         * the dynamics are initialized, at the end of Vehicle::beginPlay().
+         * A vehicle with a thread of its own has already started.
+         */
+        void start(void)
+        {
+            if (!_executor || _running) {
+                return;
+            }
 
-            _dynamics = dynamics;
+            if (_batchHost[0]) {
+                _batch = ControllerBatch::join(*_executor, _link, _batchHost,
+                        _batchMotorPort, _batchTelemPort, _batchId);
+            }
 
-            _joystick = new IJoystick();
+            begin();
 
-            _telemClient = new UdpClientSocket(host, telemPort);
-            _motorServer = new UdpServerSocket(motorPort);
+            _executor->add(this);
 
-            _connected = true;
+            reportPlacement();
         }
 
         ~FVehicleThread(void)
         {
-            // Send a bogus time value to tell remote server we're done
-            _telemetry[0] = -1;
-            if (_telemClient) {
-                _telemClient->sendData(_telemetry, sizeof(_telemetry));
-            }
+            // Wait for dynamics to finish (none to wait for on a pool, as
+            // Stop() has already taken us off it)
+            delete _thread;
 
-            // Close sockets
-            UdpClientSocket::free(_telemClient);
-            UdpServerSocket::free(_motorServer);
+            dumpLatencies();
 
-            delete _thread;
+            // Stop I/O thread, tell remote server we're done, close sockets
+            delete _link;
         }
 
         // Called by Vehicle::tick()
@@ -167,17 +420,104 @@ class FVehicleThread : public FRunnable {
         {
             auto dt = FPlatformTime::Seconds()-_startTime;
 
+            const auto counters = _link->counters();
+
+            const auto jitter = _jitter.read();
+
+            // Controller transport failed to open
+            if (*_link->transportMessage()) {
+                mysprintf(message, "%s", _link->transportMessage());
+                return;
+            }
+
+            if (_batch && *_batch->getMessage()) {
+                mysprintf(message, "%s", _batch->getMessage());
+                return;
+            }
+
             mysprintf(message,
-                    "Dynamics=%3.3e Hz  Control=%3.3e Hz",
+                    "Dynamics=%3.3e Hz  Control=%3.3e Hz  Dropped=%3.3f s  "
+                    "Jitter=%.0f/%.0f us  "
+                    "Motors: late=%llu missing=%llu skipped=%llu "
+                    "stale=%llu dropped=%llu lost=%llu",
                     _dynamicsCount/dt,
-                    _pidCount/dt);
+                    _pidCount/dt,
+                    _clock.droppedTime(),
+                    jitter.mean,
+                    jitter.max,
+                    (unsigned long long)counters.late,
+                    (unsigned long long)counters.missing,
+                    (unsigned long long)counters.skipped,
+                    (unsigned long long)counters.stale,
+                    (unsigned long long)counters.dropped,
+                    (unsigned long long)counters.lost);
+        }
+
+        /**
+         * Returns latency statistics for the latest one-second window of a
+         * stage.  Safe to call from any thread.
+         */
+        LatencyStage::summary_t getLatency(const latency_stage_t stage)
+        {
+            return latencyStage(stage).window();
+        }
+
+        /**
+         * Logs latency statistics for the whole run, and for the latest
+         * window, of every stage.  Call once the thread has stopped, as on
+         * EndPlay.
+         */
+        void dumpLatencies(void)
+        {
+            for (uint8_t k=0; k<LATENCY_STAGES; ++k) {
+
+                auto & stage = latencyStage((latency_stage_t)k);
+
+                char line[200] = {};
+
+                stage.format(stage.total(), line, sizeof(line));
+                UE_LOG(LogTemp, Display, TEXT("Latency run:    %s"),
+                        ANSI_TO_TCHAR(line));
+
+                stage.format(stage.window(), line, sizeof(line));
+                UE_LOG(LogTemp, Display, TEXT("Latency window: %s"),
+                        ANSI_TO_TCHAR(line));
+            }
+        }
+
+        /**
+         * Returns the state after the latest dynamics update, coherent and
+         * timestamped.  Safe to call from any thread; never blocks the
+         * dynamics thread.
+         */
+        StateChannel::state_t state(void)
+        {
+            return _stateChannel.read();
         }
 
         // Called by VehiclePawn::Tick() method to get actuator value for
         // animation and sound
         float actuatorValue(uint8_t index)
         {
-            return _actuatorValues[index];
+            return _stateChannel.read().actuators[index];
+        }
+
+        LatencyStage & latencyStage(const latency_stage_t stage)
+        {
+            switch (stage) {
+                case LATENCY_TELEMETRY:
+                    return _link->telemetryLatency();
+                case LATENCY_MOTORS:
+                    return _link->motorLatency();
+                case LATENCY_COMMAND:
+                    return _link->commandAge();
+                case LATENCY_ONE_WAY:
+                    return _link->oneWayLatency();
+                case LATENCY_JOYSTICK:
+                    return _joystickLatency;
+                default:
+                    return _dynamicsLatency;
+            }
         }
 
         static void stopThread(FVehicleThread ** worker)
@@ -201,55 +541,100 @@ class FVehicleThread : public FRunnable {
 
         virtual uint32_t Run() override
         {
+            TRACE_THREAD("physics");
+
             // Initial wait before starting
             FPlatformProcess::Sleep(0.5);
 
-            _running = true;
+            _physicsPlacement = ThreadPlacement::apply(_placement.physics);
+
+            begin();
+
+            reportPlacement();
+
+            if (_lockstep) {
+                runLockstep();
+                return 0;
+            }
+
+            _scheduler.start();
 
             while (_running) {
 
-                // For computing dynamics deltaT
-                static double _previousDynamicsTime;
+                // Sleep, then spin, until the next wakeup is due
+                _scheduler.wait();
 
-                // For computing dynamics deltaT
-                static double _previousControllerTime;
+                _jitter.write(_scheduler.jitter());
 
-                // Get a high-fidelity current time value from the OS
-                double currentTime = FPlatformTime::Seconds() - _startTime;
+                tick();
+            }
 
-                // Update dynamics
-                _dynamics->update(_actuatorValues, 
-                        currentTime - _previousDynamicsTime);
+            return 0;
+        }
 
-                // PID controller: periodically update the vehicle thread with
-                // the dynamics state, getting back the actuator values
-                static uint32_t _controllerClock;
-                _controllerClock ++;
-                if (_controllerClock == CONTROLLER_PERIOD) {
+        // SimulationTask interface: runs the fixed steps that have come due
+        // since the last call.  Called by our own thread, or by the pool.
+        virtual void tick(void) override
+        {
+            TRACE_SCOPE("tick");
 
-                    getActuators(currentTime);
+            // Get a high-fidelity current time value from the OS, and find
+            // out how many fixed steps it covers
+            const auto steps =
+                _clock.advance(FPlatformTime::Seconds() - _startTime);
 
-                    _controllerClock = 0;
+            for (uint32_t k=0; k<steps; ++k) {
 
-                    // Increment count for FPS reporting
-                    _pidCount++;
+                // Time after this step, which may be behind the clock when
+                // catching up
+                const double time =
+                    _clock.time() - (steps - 1 - k) * _clock.dt();
 
-                    _previousControllerTime = currentTime;
-                }
+                // Newest motor values from the I/O thread, if any
+                getActuators();
+
+                updateDynamics();
 
                 _dynamicsCount++;
 
-                // Track previous time for deltaT
-                _previousDynamicsTime = currentTime;
-            }
+                // Publish the new state for the game thread
+                StateChannel::capture(time, _dynamicsCount,
+                        _dynamics, _actuatorValues, _state);
+                _stateChannel.publish(_state);
 
-            return 0;
+                // PID controller: at the controller rate, send the dynamics
+                // state to the I/O thread; actuator values come back
+                // asynchronously.  Half a step of slack absorbs rounding in
+                // the running sum.
+                if (time + _clock.dt() / 2 >= _controllerTime) {
+
+                    requestActuators();
+
+                    _controllerTime += _controllerPeriod;
+
+                    // Increment count for FPS reporting
+                    _pidCount++;
+                }
+            }
         }
 
         virtual void Stop() override
         {
             _running = false;
 
+            // Returns once no worker is ticking us
+            if (_executor) {
+                _executor->remove(this);
+            }
+
+            if (_batch) {
+                ControllerBatch::leave(_batch, _batchId);
+                _batch = NULL;
+            }
+
+            // Also ends any wait for motor values in lockstep mode
+            _link->stop();
+
             // Final wait after stopping
             FPlatformProcess::Sleep(0.03);
 
@@ -0,0 +1,357 @@
+/*
+ * Timeline tracing of the simulator's hot paths, for chrome://tracing and
+ * ui.perfetto.dev
+ *
+ * TRACE_SCOPE("name") records when the enclosing scope began and how long
+ * it took, into a ring buffer owned by the calling thread: no locks, no
+ * allocation, and the oldest events are overwritten once the ring is full.
+ * Tracer::writeChrome() gathers every thread's ring into a Chrome trace
+ * (JSON) file, which both viewers open, at any time from any thread.
+ *
+ * Tracing is compiled in only when MULTISIM_TRACE is defined; otherwise
+ * the macros expand to nothing and writeChrome() does nothing.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef MULTISIM_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// Events kept per thread; a power of two
+#ifndef MULTISIM_TRACE_EVENTS
+#define MULTISIM_TRACE_EVENTS 32768
+#endif
+
+class TraceBuffer {
+
+    public:
+
+        static const uint32_t CAPACITY = MULTISIM_TRACE_EVENTS;
+
+        typedef struct {
+
+            const char * name;
+
+            uint64_t start;    // nanoseconds since the tracer's epoch
+            uint64_t duration; // nanoseconds
+
+        } event_t;
+
+    private:
+
+        static_assert((CAPACITY & (CAPACITY - 1)) == 0,
+                "MULTISIM_TRACE_EVENTS must be a power of two");
+
+        // Each slot is its own seqlock: odd while being written, else twice
+        // one more than the index of the event it holds
+        typedef struct {
+
+            std::atomic<uint64_t> sequence;
+
+            std::atomic<const char *> name;
+            std::atomic<uint64_t> start;
+            std::atomic<uint64_t> duration;
+
+        } slot_t;
+
+        slot_t _slots[CAPACITY];
+
+        // Events written so far
+        std::atomic<uint64_t> _head;
+
+        uint32_t _id = 0;
+
+        char _name[64] = {};
+
+    public:
+
+        TraceBuffer(const uint32_t id)
+        {
+            _id = id;
+
+            snprintf(_name, sizeof(_name), "thread %u", id);
+
+            for (auto & slot : _slots) {
+                slot.sequence.store(0, std::memory_order_relaxed);
+            }
+
+            _head.store(0, std::memory_order_relaxed);
+        }
+
+        /**
+         * Records an event.  Call from the owning thread only.
+         */
+        void write(
+                const char * name,
+                const uint64_t start,
+                const uint64_t duration)
+        {
+            const auto index = _head.load(std::memory_order_relaxed);
+
+            auto & slot = _slots[index & (CAPACITY - 1)];
+
+            slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.start.store(start, std::memory_order_relaxed);
+            slot.duration.store(duration, std::memory_order_relaxed);
+
+            slot.sequence.store(2 * index + 2, std::memory_order_release);
+
+            _head.store(index + 1, std::memory_order_release);
+        }
+
+        /**
+         * Copies out the events still in the ring, oldest first, skipping
+         * any being overwritten meanwhile.  Safe from any thread.
+         */
+        void read(std::vector<event_t> & events)
+        {
+            const auto head = _head.load(std::memory_order_acquire);
+
+            const auto first = head > CAPACITY ? head - CAPACITY : 0;
+
+            for (auto index=first; index<head; ++index) {
+
+                auto & slot = _slots[index & (CAPACITY - 1)];
+
+                const auto before =
+                    slot.sequence.load(std::memory_order_acquire);
+
+                event_t event = {};
+                event.name = slot.name.load(std::memory_order_relaxed);
+                event.start = slot.start.load(std::memory_order_relaxed);
+                event.duration =
+                    slot.duration.load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                const auto after =
+                    slot.sequence.load(std::memory_order_relaxed);
+
+                if (before == after && before == 2 * index + 2) {
+                    events.push_back(event);
+                }
+            }
+        }
+
+        void setName(const char * name)
+        {
+            snprintf(_name, sizeof(_name), "%s", name);
+        }
+
+        const char * name(void)
+        {
+            return _name;
+        }
+
+        uint32_t id(void)
+        {
+            return _id;
+        }
+
+}; // class TraceBuffer
+
+class Tracer {
+
+    private:
+
+        typedef std::chrono::steady_clock clock_t;
+
+        // Every thread's ring, kept after the thread has gone
+        static std::mutex & registryMutex(void)
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static std::vector<TraceBuffer *> & registry(void)
+        {
+            static std::vector<TraceBuffer *> buffers;
+            return buffers;
+        }
+
+    public:
+
+        static bool enabled(void)
+        {
+            return true;
+        }
+
+        /**
+         * @return the calling thread's ring, created on first use
+         */
+        static TraceBuffer & buffer(void)
+        {
+            static thread_local TraceBuffer * buffer = NULL;
+
+            if (!buffer) {
+
+                std::lock_guard<std::mutex> lock(registryMutex());
+
+                buffer = new TraceBuffer((uint32_t)registry().size() + 1);
+
+                registry().push_back(buffer);
+            }
+
+            return *buffer;
+        }
+
+        /**
+         * @return nanoseconds since the first call
+         */
+        static uint64_t now(void)
+        {
+            static const auto epoch = clock_t::now();
+
+            return (uint64_t)std::chrono::duration_cast<
+                std::chrono::nanoseconds>(clock_t::now() - epoch).count();
+        }
+
+        /**
+         * Names the calling thread in the trace.
+         */
+        static void nameThread(const char * name)
+        {
+            buffer().setName(name);
+        }
+
+        /**
+         * Writes every thread's events as a Chrome trace.
+         *
+         * @param path output file; NULL for $MULTISIM_TRACE_FILE, or else
+         *        multisim-trace.json
+         * @return number of events written, or -1 if the file couldn't be
+         *         written
+         */
+        static int64_t writeChrome(const char * path=NULL)
+        {
+            if (!path) {
+                path = getenv("MULTISIM_TRACE_FILE");
+            }
+
+            if (!path) {
+                path = "multisim-trace.json";
+            }
+
+            FILE * fp = fopen(path, "w");
+
+            if (!fp) {
+                return -1;
+            }
+
+            fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+            fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"args\":{\"name\":\"MultiSim\"}}");
+
+            int64_t count = 0;
+
+            std::lock_guard<std::mutex> lock(registryMutex());
+
+            std::vector<TraceBuffer::event_t> events;
+
+            for (auto buffer : registry()) {
+
+                fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                        "\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                        buffer->id(), buffer->name());
+
+                events.clear();
+
+                buffer->read(events);
+
+                for (auto & event : events) {
+
+                    fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                            "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                            event.name,
+                            buffer->id(),
+                            event.start / 1e3,
+                            event.duration / 1e3);
+                }
+
+                count += events.size();
+            }
+
+            fprintf(fp, "\n]}\n");
+
+            return fclose(fp) ? -1 : count;
+        }
+
+}; // class Tracer
+
+// Records the enclosing scope as one event
+class TraceScope {
+
+    private:
+
+        const char * _name = NULL;
+
+        uint64_t _start = 0;
+
+    public:
+
+        TraceScope(const char * name)
+        {
+            _name = name;
+
+            _start = Tracer::now();
+        }
+
+        ~TraceScope(void)
+        {
+            Tracer::buffer().write(_name, _start, Tracer::now() - _start);
+        }
+
+}; // class TraceScope
+
+#define TRACE_CONCAT_(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Name must be a string literal, or otherwise outlive the trace
+#define TRACE_SCOPE(name) \
+    TraceScope TRACE_CONCAT(_traceScope, __LINE__)(name)
+
+#define TRACE_THREAD(name) Tracer::nameThread(name)
+
+#else
+
+class Tracer {
+
+    public:
+
+        static bool enabled(void)
+        {
+            return false;
+        }
+
+        static int64_t writeChrome(const char * path=NULL)
+        {
+            (void)path;
+
+            return 0;
+        }
+
+}; // class Tracer
+
+#define TRACE_SCOPE(name)
+
+#define TRACE_THREAD(name)
+
+#endif
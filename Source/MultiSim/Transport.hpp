@@ -0,0 +1,302 @@
+/*
+ * Transports for telemetry and motor messages between the simulator and
+ * the flight controller
+ *
+ * Either UDP (the default: telemetry to host:telemPort, motors on
+ * motorPort), or, for a controller on the same host, POSIX shared memory
+ * or Unix-domain datagram sockets, chosen by address: "shm:NAME" for a
+ * segment named NAME, "unix:PATH" for sockets at PATH.motor (motors to the
+ * simulator) and PATH.telem (telemetry to the controller), anything else a
+ * UDP host.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "SharedMemory.hpp"
+
+#include "sockets/UdpClientSocket.hpp"
+#include "sockets/UdpServerSocket.hpp"
+#include "sockets/UnixDatagramSocket.hpp"
+
+class ControllerTransport {
+
+    public:
+
+        typedef enum {
+
+            SIDE_SIMULATOR,  // sends telemetry, receives motors
+            SIDE_CONTROLLER  // receives telemetry, sends motors
+
+        } side_t;
+
+        virtual ~ControllerTransport(void) {}
+
+        /**
+         * Sends one message: telemetry from the simulator, motors from the
+         * controller.
+         */
+        virtual void sendData(void * buf, size_t len) = 0;
+
+        /**
+         * Receives one message, waiting at most the transport's timeout.
+         *
+         * @return true if a message of at least len bytes came
+         */
+        virtual bool receiveData(void * buf, size_t len) = 0;
+
+        /**
+         * Takes every message already waiting, without waiting for more,
+         * keeping the newest one of len bytes.
+         *
+         * @param dropped incremented for each message of another size
+         * @return number of messages of len bytes taken
+         */
+        virtual uint32_t drainData(void * buf, size_t len,
+                uint32_t & dropped) = 0;
+
+        /**
+         * Receives as receiveData() does, then takes whatever else has
+         * queued up behind it, so that a controller sending faster than we
+         * receive never leaves us working through a backlog of old
+         * messages.
+         *
+         * @param buf output: the newest message of len bytes
+         * @param len expected message size
+         * @param stale incremented for each message superseded by a newer
+         *        one
+         * @param dropped incremented for each message of another size
+         *        taken after the first
+         * @return true if a message of len bytes came
+         */
+        bool receiveLatest(void * buf, size_t len,
+                uint32_t & stale, uint32_t & dropped)
+        {
+            if (!receiveData(buf, len)) {
+                return false;
+            }
+
+            stale += drainData(buf, len, dropped);
+
+            return true;
+        }
+
+        virtual void closeConnection(void) = 0;
+
+        /**
+         * @return why the transport failed to open, or an empty string
+         */
+        virtual const char * getMessage(void) = 0;
+
+        /**
+         * Opens a transport.
+         *
+         * @param address "shm:NAME" for shared memory, "unix:PATH" for
+         *        Unix-domain sockets, else the other side's UDP host
+         * @param motorPort UDP port for motors
+         * @param telemPort UDP port for telemetry
+         * @param timeoutMsec receive timeout; zero to wait forever
+         * @param side which side we are
+         */
+        static ControllerTransport * open(
+                const char * address,
+                const short motorPort,
+                const short telemPort,
+                const uint32_t timeoutMsec,
+                const side_t side=SIDE_SIMULATOR);
+
+}; // class ControllerTransport
+
+class UdpTransport : public ControllerTransport {
+
+    private:
+
+        UdpClientSocket _client;
+        UdpServerSocket _server;
+
+    public:
+
+        UdpTransport(
+                const char * host,
+                const short motorPort,
+                const short telemPort,
+                const uint32_t timeoutMsec,
+                const side_t side)
+            : _client(host, side == SIDE_SIMULATOR ? telemPort : motorPort),
+              _server(side == SIDE_SIMULATOR ? motorPort : telemPort,
+                      timeoutMsec)
+        {
+        }
+
+        virtual void sendData(void * buf, size_t len) override
+        {
+            _client.sendData(buf, len);
+        }
+
+        virtual bool receiveData(void * buf, size_t len) override
+        {
+            return _server.receiveData(buf, len);
+        }
+
+        virtual uint32_t drainData(void * buf, size_t len,
+                uint32_t & dropped) override
+        {
+            return _server.drainData(buf, len, dropped);
+        }
+
+        virtual void closeConnection(void) override
+        {
+            _client.closeConnection();
+            _server.closeConnection();
+        }
+
+        virtual const char * getMessage(void) override
+        {
+            return *_server.getMessage() ?
+                _server.getMessage() : _client.getMessage();
+        }
+
+}; // class UdpTransport
+
+class SharedMemoryTransport : public ControllerTransport {
+
+    private:
+
+        SharedMemoryChannel _channel;
+
+        uint32_t _timeoutMsec = 0;
+
+    public:
+
+        SharedMemoryTransport(
+                const char * name,
+                const uint32_t timeoutMsec,
+                const side_t side)
+            : _channel(name, side == SIDE_SIMULATOR ?
+                    SharedMemoryChannel::SIDE_SIMULATOR :
+                    SharedMemoryChannel::SIDE_CONTROLLER)
+        {
+            _timeoutMsec = timeoutMsec;
+        }
+
+        virtual void sendData(void * buf, size_t len) override
+        {
+            _channel.sendData(buf, len);
+        }
+
+        virtual bool receiveData(void * buf, size_t len) override
+        {
+            return _channel.receiveData(buf, len, _timeoutMsec);
+        }
+
+        virtual uint32_t drainData(void * buf, size_t len,
+                uint32_t & dropped) override
+        {
+            return _channel.drainData(buf, len, dropped);
+        }
+
+        virtual void closeConnection(void) override
+        {
+            _channel.closeConnection();
+        }
+
+        virtual const char * getMessage(void) override
+        {
+            return _channel.getMessage();
+        }
+
+        bool isOpen(void)
+        {
+            return _channel.isOpen();
+        }
+
+}; // class SharedMemoryTransport
+
+class UnixTransport : public ControllerTransport {
+
+    private:
+
+        // Room for PATH and a suffix
+        char _receivePath[200] = {};
+        char _sendPath[200] = {};
+
+        UnixDatagramSocket _socket;
+
+        static const char * makePath(char * buf, const size_t size,
+                const char * base, const char * suffix)
+        {
+            snprintf(buf, size, "%s%s", base, suffix);
+
+            return buf;
+        }
+
+    public:
+
+        UnixTransport(
+                const char * path,
+                const uint32_t timeoutMsec,
+                const side_t side)
+            : _socket(
+                    makePath(_receivePath, sizeof(_receivePath), path,
+                        side == SIDE_SIMULATOR ? ".motor" : ".telem"),
+                    makePath(_sendPath, sizeof(_sendPath), path,
+                        side == SIDE_SIMULATOR ? ".telem" : ".motor"),
+                    timeoutMsec)
+        {
+        }
+
+        virtual void sendData(void * buf, size_t len) override
+        {
+            _socket.sendData(buf, len);
+        }
+
+        virtual bool receiveData(void * buf, size_t len) override
+        {
+            return _socket.receiveData(buf, len);
+        }
+
+        virtual uint32_t drainData(void * buf, size_t len,
+                uint32_t & dropped) override
+        {
+            return _socket.drainData(buf, len, dropped);
+        }
+
+        virtual void closeConnection(void) override
+        {
+            _socket.closeConnection();
+        }
+
+        virtual const char * getMessage(void) override
+        {
+            return _socket.getMessage();
+        }
+
+}; // class UnixTransport
+
+inline ControllerTransport * ControllerTransport::open(
+        const char * address,
+        const short motorPort,
+        const short telemPort,
+        const uint32_t timeoutMsec,
+        const side_t side)
+{
+    static const char * SHM = "shm:";
+    static const char * UNIX = "unix:";
+
+    if (!strncmp(address, SHM, strlen(SHM))) {
+        return new SharedMemoryTransport(
+                address + strlen(SHM), timeoutMsec, side);
+    }
+
+    if (!strncmp(address, UNIX, strlen(UNIX))) {
+        return new UnixTransport(address + strlen(UNIX), timeoutMsec, side);
+    }
+
+    return new UdpTransport(address, motorPort, telemPort, timeoutMsec, side);
+}
@@ -0,0 +1,89 @@
+/*
+ * Single-producer, single-consumer latest-value hand-off
+ *
+ * Three slots: the writer owns one, the reader owns one, and the third is
+ * swapped between them with a single atomic exchange.  Both sides are
+ * wait-free, and the reader always gets the newest complete value; older
+ * values it never got to are simply overwritten.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+template <typename T>
+class TripleBuffer {
+
+    private:
+
+        // Set in the middle index when it holds a value not yet read
+        static const uint8_t FRESH = 0x04;
+
+        static const uint8_t INDEX = 0x03;
+
+        T _buffers[3] = {};
+
+        std::atomic<uint8_t> _middle;
+
+        // Owned by the writer and reader, respectively
+        uint8_t _back = 1;
+        uint8_t _front = 2;
+
+    public:
+
+        TripleBuffer(void)
+        {
+            _middle.store(0, std::memory_order_relaxed);
+        }
+
+        TripleBuffer(const TripleBuffer &) = delete;
+
+        TripleBuffer & operator=(const TripleBuffer &) = delete;
+
+        /**
+         * Hands off a new value.  Call from the writer thread only.
+         */
+        void write(const T & value)
+        {
+            _buffers[_back] = value;
+
+            _back = _middle.exchange(
+                    _back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        /**
+         * Takes the newest value, if one has been written since the last
+         * read.  Call from the reader thread only.
+         *
+         * @param value output, untouched when there is nothing new
+         * @return true if value was updated
+         */
+        bool read(T & value)
+        {
+            if (!hasFresh()) {
+                return false;
+            }
+
+            _front = _middle.exchange(
+                    _front, std::memory_order_acq_rel) & INDEX;
+
+            value = _buffers[_front];
+
+            return true;
+        }
+
+        /**
+         * @return true if a value has been written since the last read
+         */
+        bool hasFresh(void) const
+        {
+            return (_middle.load(std::memory_order_relaxed) & FRESH) != 0;
+        }
+
+}; // class TripleBuffer
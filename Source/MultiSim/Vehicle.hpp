@@ -25,6 +25,7 @@
 #include "Dynamics.hpp"
 #include "Thread.hpp"
 #include "Camera.hpp"
+#include "Trace.hpp"
 
 #include "StaticMesh.h"
 
@@ -108,22 +109,16 @@ class Vehicle {
         // Starting location, for kinematic offset
         FVector _startLocation = {};
 
-        // Retrieves kinematics from dynamics computed in another thread
-        void updateKinematics(void)
+        // Sets kinematics from the state published by the dynamics thread
+        void updateKinematics(const StateChannel::state_t & state)
         {
             // Set vehicle pose in animation
             _pawn->SetActorLocation(_startLocation +
-                    100 * FVector(
-                        _dynamics->getStateX(),
-                        _dynamics->getStateY(),
-                        _dynamics->getStateZ()));
+                    100 * FVector(state.x, state.y, state.z));
 
             _pawn->SetActorRotation(
                     FMath::RadiansToDegrees(
-                        FRotator(
-                            _dynamics->getStateTheta(),
-                            _dynamics->getStatePsi(),
-                            _dynamics->getStatePhi())));
+                        FRotator(state.theta, state.psi, state.phi)));
         }
 
         void grabImages(void)
@@ -227,12 +222,12 @@ class Vehicle {
         // Also set in constructor, but purely for visual effect
         int8_t _rotorDirections[Dynamics::MAX_ROTORS] = {};
 
-        virtual void animateActuators(void)
+        virtual void animateActuators(const StateChannel::state_t & state)
         {
             // Compute the sum of the rotor values
             _rotorSum = 0;
             for (uint8_t j = 0; j < _nrotors; ++j) {
-                _rotorSum += _thread->actuatorValue(j);
+                _rotorSum += state.actuators[j];
             }
 
             // Rotate rotors. For visual effect, we can ignore actual rotor
@@ -390,6 +385,8 @@ class Vehicle {
 
         void beginPlay(FVehicleThread * thread)
         {
+            TRACE_THREAD("game");
+
             _thread = thread;
 
             // Player controller is useful for getting keyboard events,
@@ -471,17 +468,38 @@ class Vehicle {
 
             _view = VIEW_CHASE;
             setView();
+
+            // Only now that the dynamics are initialized can a pool's
+            // workers start updating them
+            _thread->start();
         }
 
         void endPlay(void)
         {
             FVehicleThread::stopThread(&_thread);
+
+            writeTrace();
+        }
+
+        // Writes the timeline trace, if compiled in (MULTISIM_TRACE)
+        void writeTrace(void)
+        {
+            if (!Tracer::enabled()) {
+                return;
+            }
+
+            const auto count = Tracer::writeChrome();
+
+            UE_LOG(LogTemp, Display, TEXT("Trace: %lld events written"),
+                    (long long)count);
         }
 
         void tick(float DeltaSeconds)
         {
+            TRACE_SCOPE("vehicle tick");
+
             // Report any message from thread
-            char message[100] = {};
+            char message[200] = {};
             _thread->getMessage(message);
             debugline(message);
 
@@ -496,16 +514,44 @@ class Vehicle {
                 // Use spacebar to switch player-camera view
                 setPlayerCameraView();
 
-                updateKinematics();
+                // T key writes the trace so far
+                checkTraceKey();
+
+                // One coherent state for pose, cameras, and animation
+                const auto state = _thread->state();
+
+                {
+                    TRACE_SCOPE("updateKinematics");
+                    updateKinematics(state);
+                }
 
                 grabImages();
 
-                animateActuators();
+                {
+                    TRACE_SCOPE("animateActuators");
+                    animateActuators(state);
+                }
 
                 _dynamics->setAgl(agl());
             }
         }
 
+        void checkTraceKey(void)
+        {
+            // avoid writing once per frame while the key is down
+            static bool didhit;
+
+            if (hitKey(EKeys::T)) {
+                if (!didhit) {
+                    writeTrace();
+                }
+                didhit = true;
+            }
+            else {
+                didhit = false;
+            }
+        }
+
         bool hitKey(const FKey key)
         {
             return _playerController->IsInputKeyDown(key);
@@ -549,6 +595,8 @@ class Vehicle {
         // Returns AGL when vehicle is level above ground, "infinity" otherwise
         float agl(void)
         {
+            TRACE_SCOPE("agl");
+
             // Start at the center of the vehicle
             FVector startPoint = _pawn->GetActorLocation();
             startPoint.Z += 100;
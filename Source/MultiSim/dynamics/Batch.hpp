@@ -0,0 +1,670 @@
+/*
+ * Batched dynamics for stepping many fixed-pitch vehicles at once
+ *
+ * State is kept as a structure of arrays (one array per state variable),
+ * so that each stage of the update runs as a tight loop over all vehicles.
+ * The loops take their arrays through restrict-qualified pointers and mask
+ * rather than branch on ground contact, so that the compiler vectorizes
+ * them; only the sines and cosines stay scalar.  The arithmetic otherwise
+ * follows MixerDynamics::update(), so a batch of N vehicles gives the same
+ * results as N separate instances of MixerDynamics (or QuadXBFDynamics)
+ * with the same rotor layout and scalar type.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <assert.h>
+
+#include <limits>
+
+#include "Mixer.hpp"
+
+template <typename real_t>
+class BasicDynamicsBatch {
+
+    private:
+
+        // Number of vehicles
+        uint32_t _count = 0;
+
+        // Frame layout, as a mixing matrix (see RotorLayout::mix())
+        uint8_t _rotorCount = 0;
+        real_t _mixer[4][Dynamics::MAX_ROTORS] = {};
+        real_t _gyro[Dynamics::MAX_ROTORS] = {};
+        real_t _omegaScale = 0;
+
+        typename BasicDynamics<real_t>::vehicle_params_t _vparams;
+
+        real_t _g = (real_t)9.80665;
+        real_t _rho = (real_t)1.225;
+
+        bool _autoland = true;
+
+        // State vector (see Dynamics::vehicle_state_t), one array per
+        // variable
+        real_t * _x = NULL;
+        real_t * _dx = NULL;
+        real_t * _y = NULL;
+        real_t * _dy = NULL;
+        real_t * _z = NULL;
+        real_t * _dz = NULL;
+        real_t * _phi = NULL;
+        real_t * _dphi = NULL;
+        real_t * _theta = NULL;
+        real_t * _dtheta = NULL;
+        real_t * _psi = NULL;
+        real_t * _dpsi = NULL;
+
+        // One byte per vehicle, zero or one, so that masks load as vectors
+        uint8_t * _airborne = NULL;
+
+        real_t * _agl = NULL;
+
+        // Per-step scratch: forces from rotors, and thrust in NED frame
+        real_t * _u1 = NULL;
+        real_t * _u2 = NULL;
+        real_t * _u3 = NULL;
+        real_t * _u4 = NULL;
+        real_t * _omega = NULL;
+        real_t * _accelNED[3] = {};
+
+        // Motor model (see Dynamics::setMotorModel()), rotor-major like the
+        // actuators
+        bool _motorModel = false;
+        typename BasicDynamics<real_t>::motor_params_t _mparams = {};
+        real_t * _motorSpeeds = NULL;
+        real_t _motorDt = 0;
+        real_t _motorAlpha = 1;
+        real_t _motorRise = 0;
+        real_t _motorFall = 0;
+
+        static real_t * newArray(const uint32_t n)
+        {
+            return new real_t [n]();
+        }
+
+        // Adds one rotor's share of Equation 6 to every vehicle's forces,
+        // starting from zero for the first rotor; zeroing them in a pass of
+        // their own costs a memset() call per array, which dominates small
+        // batches
+        template <bool FIRST>
+        static void mixRotor(
+                const uint32_t n,
+                const real_t * __restrict actuators,
+                const real_t scale,
+                const real_t rho,
+                const real_t column[4],
+                const real_t gyro,
+                real_t * __restrict u1,
+                real_t * __restrict u2,
+                real_t * __restrict u3,
+                real_t * __restrict u4,
+                real_t * __restrict omegas)
+        {
+            const real_t thrust = column[0];
+            const real_t roll = column[1];
+            const real_t pitch = column[2];
+            const real_t yaw = column[3];
+
+            for (uint32_t k=0; k<n; ++k) {
+
+                const real_t omega = actuators[k] * scale;
+
+                const real_t omega2 = rho * omega * omega;
+
+                u1[k] = (FIRST ? 0 : u1[k]) + thrust * omega2;
+                u2[k] = (FIRST ? 0 : u2[k]) + roll * omega2;
+                u3[k] = (FIRST ? 0 : u3[k]) + pitch * omega2;
+                u4[k] = (FIRST ? 0 : u4[k]) + yaw * omega2;
+                omegas[k] = (FIRST ? 0 : omegas[k]) + gyro * omega;
+            }
+        }
+
+        // Arrays for step(), restrict-qualified so that it vectorizes
+        // without run-time alias checks
+        typedef struct {
+
+            real_t * __restrict x;
+            real_t * __restrict dx;
+            real_t * __restrict y;
+            real_t * __restrict dy;
+            real_t * __restrict z;
+            real_t * __restrict dz;
+            real_t * __restrict phi;
+            real_t * __restrict dphi;
+            real_t * __restrict theta;
+            real_t * __restrict dtheta;
+            real_t * __restrict psi;
+            real_t * __restrict dpsi;
+
+            uint8_t * __restrict airborne;
+
+            const real_t * __restrict agl;
+
+            const real_t * __restrict u2;
+            const real_t * __restrict u3;
+            const real_t * __restrict u4;
+            const real_t * __restrict omega;
+
+            const real_t * __restrict accelNED[3];
+
+        } lanes_t;
+
+        // Ground contact, Equation 12, and Euler integration for every
+        // vehicle.  Instead of branching on ground contact, the Euler step
+        // is scaled by a mask that is one in the air and zero on the
+        // ground, and motion by one that is zero on landing, so that the
+        // loop vectorizes however the vehicles are split between the two.
+        static void step(
+                const uint32_t n,
+                const lanes_t s,
+                const typename BasicDynamics<real_t>::vehicle_params_t &
+                    vparams,
+                const real_t g,
+                const real_t landRate,
+                const real_t dt)
+        {
+            const real_t Ix = vparams.Ix;
+            const real_t Iy = vparams.Iy;
+            const real_t Iz = vparams.Iz;
+            const real_t Jr = vparams.Jr;
+
+            const real_t cap = vparams.maxspeed;
+            const real_t none = std::numeric_limits<real_t>::infinity();
+
+            for (uint32_t k=0; k<n; ++k) {
+
+                const real_t agl = s.agl[k];
+
+                // We're airborne once net downward acceleration goes below
+                // zero, and land on reaching the ground while descending
+                const real_t netz = s.accelNED[2][k] + g;
+
+                const uint8_t was = s.airborne[k];
+
+                const uint8_t lands = was & (agl <= 0) & (netz >= 0);
+
+                const uint8_t flies = (was & !lands) | (!was & (netz < 0));
+
+                s.airborne[k] = flies;
+
+                const real_t flying = flies;
+                const real_t moving = 1 - lands;
+
+                // Only moving vehicles' speeds are capped
+                const real_t limit = flies ? cap : none;
+
+                const real_t x = s.x[k];
+                const real_t dx = s.dx[k];
+                const real_t y = s.y[k];
+                const real_t dy = s.dy[k];
+                const real_t z = s.z[k];
+                const real_t dz = s.dz[k];
+                const real_t phi = s.phi[k];
+                const real_t phidot = s.dphi[k];
+                const real_t theta = s.theta[k];
+                const real_t thedot = s.dtheta[k];
+                const real_t psi = s.psi[k];
+                const real_t psidot = s.dpsi[k];
+
+                const real_t omega = s.omega[k];
+
+                // Equation 12
+                const real_t ddphi = psidot * thedot * (Iy - Iz) / Ix - Jr /
+                    Ix * thedot * omega + s.u2[k] / Ix;
+
+                const real_t ddtheta = -(psidot * phidot * (Iz - Ix) / Iy +
+                        Jr / Iy * phidot * omega + s.u3[k] / Iy);
+
+                const real_t ddpsi = thedot * phidot * (Ix - Iy) / Iz +
+                    s.u4[k] / Iz;
+
+                const real_t dxFlown = dx + dt * (s.accelNED[0][k] * flying);
+                const real_t dxFloor = dxFlown < -limit ? -limit : dxFlown;
+
+                const real_t dyFlown = dy + dt * (s.accelNED[1][k] * flying);
+                const real_t dyFloor = dyFlown < -limit ? -limit : dyFlown;
+
+                s.x[k] = x + dt * (dx * flying);
+                s.dx[k] = (dxFloor > limit ? limit : dxFloor) * moving;
+                s.y[k] = y + dt * (dy * flying);
+                s.dy[k] = (dyFloor > limit ? limit : dyFloor) * moving;
+                s.dz[k] = (dz + dt * (netz * flying)) * moving;
+                s.phi[k] = (phi + dt * (phidot * flying)) * moving;
+                s.dphi[k] = (phidot + dt * (ddphi * flying)) * moving;
+                s.theta[k] = (theta + dt * (thedot * flying)) * moving;
+                s.dtheta[k] = (thedot + dt * (ddtheta * flying)) * moving;
+                s.psi[k] = psi + dt * (psidot * flying);
+                s.dpsi[k] = (psidot + dt * (ddpsi * flying)) * moving;
+
+                // Landing puts us at zero AGL, and autoland flies us there
+                // while on the ground
+                s.z[k] = z + dt * (dz * flying) + (lands ? agl : 0) +
+                    landRate * (flies ? 0 : agl) * dt;
+            }
+        }
+
+        // Implements Equation 6 for all vehicles, one rotor at a time
+        void computeForces(const real_t * actuators)
+        {
+            for (uint8_t i=0; i<_rotorCount; ++i) {
+
+                const real_t column[4] = {
+                    _mixer[0][i], _mixer[1][i], _mixer[2][i], _mixer[3][i]
+                };
+
+                const real_t * a = &actuators[i * _count];
+
+                if (i == 0) {
+                    mixRotor<true>(_count, a, _omegaScale, _rho, column,
+                            _gyro[i], _u1, _u2, _u3, _u4, _omega);
+                }
+
+                else {
+                    mixRotor<false>(_count, a, _omegaScale, _rho, column,
+                            _gyro[i], _u1, _u2, _u3, _u4, _omega);
+                }
+            }
+        }
+
+        // Rotates the thrust vector of each vehicle into the inertial frame.
+        // Scalar, since it calls sin() and cos() as Dynamics does.
+        void computeAccelerations(void)
+        {
+            for (uint32_t k=0; k<_count; ++k) {
+
+                const real_t bodyZ = -_u1[k] / _vparams.m;
+
+                const real_t phi = _phi[k];
+                const real_t theta = _theta[k];
+                const real_t psi = _psi[k];
+
+                const real_t cph = cos(phi);
+                const real_t sph = sin(phi);
+                const real_t cth = cos(theta);
+                const real_t sth = sin(theta);
+                const real_t cps = cos(psi);
+                const real_t sps = sin(psi);
+
+                _accelNED[0][k] = bodyZ * (sph * sps + cph * cps * sth);
+                _accelNED[1][k] = bodyZ * (cph * sps * sth - cps * sph);
+                _accelNED[2][k] = bodyZ * (cph * cth);
+            }
+        }
+
+        // Implements Equation 12 and Euler integration for all vehicles
+        void integrate(const real_t dt)
+        {
+            const lanes_t lanes = {
+                _x, _dx, _y, _dy, _z, _dz,
+                _phi, _dphi, _theta, _dtheta, _psi, _dpsi,
+                _airborne, _agl, _u2, _u3, _u4, _omega,
+                { _accelNED[0], _accelNED[1], _accelNED[2] }
+            };
+
+            // Fly-to-zero-AGL rate on the ground, zero without autoland
+            step(_count, lanes, _vparams, _g, _autoland ? 5 : 0, dt);
+        }
+
+    public:
+
+        /**
+         * Creates a batch of identical vehicles.
+         *
+         * @param count number of vehicles
+         * @param rotorCount rotors per vehicle, at most Dynamics::MAX_ROTORS;
+         *        any beyond that are ignored
+         * @param rotors one entry per rotor, e.g. RotorLayout::QUAD_X_BF
+         * @param vparams vehicle parameters
+         * @param fparams fixed-pitch parameters
+         * @param autoland support fly-to-zero-AGL
+         */
+        BasicDynamicsBatch(
+                const uint32_t count,
+                const uint8_t rotorCount,
+                const RotorLayout::rotor_t * rotors,
+                const typename BasicDynamics<real_t>::vehicle_params_t &
+                    vparams,
+                const typename BasicFixedPitchDynamics<real_t>::
+                    fixed_pitch_params_t & fparams,
+                const bool autoland=true)
+        {
+            _count = count;
+
+            assert(rotorCount <= Dynamics::MAX_ROTORS);
+
+            // The mixer holds no more than this
+            _rotorCount = rotorCount < Dynamics::MAX_ROTORS ?
+                rotorCount : Dynamics::MAX_ROTORS;
+
+            for (uint8_t i=0; i<_rotorCount; ++i) {
+
+                real_t column[4] = {};
+
+                RotorLayout::mix(rotors[i], fparams.b, fparams.l, vparams.d,
+                        column, _gyro[i]);
+
+                for (uint8_t j=0; j<4; ++j) {
+                    _mixer[j][i] = column[j];
+                }
+            }
+
+            _omegaScale = RotorLayout::omegaScale<real_t>(vparams.maxrpm);
+
+            memcpy(&_vparams, &vparams, sizeof(_vparams));
+
+            _autoland = autoland;
+
+            _x = newArray(count);
+            _dx = newArray(count);
+            _y = newArray(count);
+            _dy = newArray(count);
+            _z = newArray(count);
+            _dz = newArray(count);
+            _phi = newArray(count);
+            _dphi = newArray(count);
+            _theta = newArray(count);
+            _dtheta = newArray(count);
+            _psi = newArray(count);
+            _dpsi = newArray(count);
+
+            _airborne = new uint8_t [count]();
+
+            _agl = newArray(count);
+
+            _u1 = newArray(count);
+            _u2 = newArray(count);
+            _u3 = newArray(count);
+            _u4 = newArray(count);
+            _omega = newArray(count);
+
+            for (uint8_t j=0; j<3; ++j) {
+                _accelNED[j] = newArray(count);
+            }
+
+            _motorSpeeds = newArray(count * _rotorCount);
+        }
+
+        BasicDynamicsBatch(const BasicDynamicsBatch &) = delete;
+
+        BasicDynamicsBatch & operator=(const BasicDynamicsBatch &) = delete;
+
+        ~BasicDynamicsBatch(void)
+        {
+            delete[] _x;
+            delete[] _dx;
+            delete[] _y;
+            delete[] _dy;
+            delete[] _z;
+            delete[] _dz;
+            delete[] _phi;
+            delete[] _dphi;
+            delete[] _theta;
+            delete[] _dtheta;
+            delete[] _psi;
+            delete[] _dpsi;
+
+            delete[] _airborne;
+
+            delete[] _agl;
+
+            delete[] _u1;
+            delete[] _u2;
+            delete[] _u3;
+            delete[] _u4;
+            delete[] _omega;
+
+            for (uint8_t j=0; j<3; ++j) {
+                delete[] _accelNED[j];
+            }
+
+            delete[] _motorSpeeds;
+        }
+
+        /**
+         * Initializes the pose of one vehicle; see Dynamics::init().
+         */
+        void init(
+                const uint32_t index,
+                const double rotation[3],
+                const bool airborne=false)
+        {
+            _x[index] = 0;
+            _dx[index] = 0;
+            _y[index] = 0;
+            _dy[index] = 0;
+            _z[index] = 0;
+            _dz[index] = 0;
+            _phi[index] = (real_t)rotation[0];
+            _dphi[index] = 0;
+            _theta[index] = (real_t)rotation[1];
+            _dtheta[index] = 0;
+            _psi[index] = (real_t)rotation[2];
+            _dpsi[index] = 0;
+
+            _airborne[index] = airborne;
+
+            for (uint8_t i=0; i<_rotorCount; ++i) {
+                _motorSpeeds[i * _count + index] = 0;
+            }
+        }
+
+        /**
+         * Initializes the pose of all vehicles.
+         */
+        void init(const double rotation[3], const bool airborne=false)
+        {
+            for (uint32_t k=0; k<_count; ++k) {
+                init(k, rotation, airborne);
+            }
+        }
+
+        /**
+         * Captures the flight state of one vehicle, in the same form as
+         * Dynamics::snapshot().
+         */
+        typename BasicDynamics<real_t>::snapshot_t snapshot(
+                const uint32_t index)
+        {
+            typename BasicDynamics<real_t>::snapshot_t snapshot = {};
+
+            auto & vstate = snapshot.vstate;
+
+            vstate.x = _x[index];
+            vstate.dx = _dx[index];
+            vstate.y = _y[index];
+            vstate.dy = _dy[index];
+            vstate.z = _z[index];
+            vstate.dz = _dz[index];
+            vstate.phi = _phi[index];
+            vstate.dphi = _dphi[index];
+            vstate.theta = _theta[index];
+            vstate.dtheta = _dtheta[index];
+            vstate.psi = _psi[index];
+            vstate.dpsi = _dpsi[index];
+
+            snapshot.quaternion[0] = 1;
+
+            snapshot.attitude = BasicDynamics<real_t>::ATTITUDE_EULER;
+            snapshot.airborne = _airborne[index];
+            snapshot.agl = _agl[index];
+
+            for (uint8_t j=0; j<3; ++j) {
+                snapshot.inertialAccel[j] = _accelNED[j][index];
+            }
+
+            for (uint8_t i=0; i<_rotorCount; ++i) {
+                snapshot.motorSpeeds[i] = _motorSpeeds[i * _count + index];
+            }
+
+            return snapshot;
+        }
+
+        /**
+         * Sets one vehicle to a flight state captured by Dynamics::snapshot()
+         * or snapshot(), e.g. to roll out many futures from one state.
+         */
+        void restore(
+                const uint32_t index,
+                const typename BasicDynamics<real_t>::snapshot_t & snapshot)
+        {
+            const auto & vstate = snapshot.vstate;
+
+            _x[index] = vstate.x;
+            _dx[index] = vstate.dx;
+            _y[index] = vstate.y;
+            _dy[index] = vstate.dy;
+            _z[index] = vstate.z;
+            _dz[index] = vstate.dz;
+            _phi[index] = vstate.phi;
+            _dphi[index] = vstate.dphi;
+            _theta[index] = vstate.theta;
+            _dtheta[index] = vstate.dtheta;
+            _psi[index] = vstate.psi;
+            _dpsi[index] = vstate.dpsi;
+
+            _airborne[index] = snapshot.airborne;
+            _agl[index] = snapshot.agl;
+
+            for (uint8_t i=0; i<_rotorCount; ++i) {
+                _motorSpeeds[i * _count + index] = snapshot.motorSpeeds[i];
+            }
+        }
+
+        void setAgl(const uint32_t index, const real_t agl)
+        {
+            _agl[index] = agl;
+        }
+
+        void setWorldParams(const real_t g, const real_t rho)
+        {
+            _g = g;
+            _rho = rho;
+        }
+
+        /**
+         * Adds the same motor lag to every vehicle; see
+         * Dynamics::setMotorModel().
+         */
+        void setMotorModel(
+                const typename BasicDynamics<real_t>::motor_params_t & mparams)
+        {
+            _mparams = mparams;
+            _motorModel = true;
+            _motorDt = 0;
+        }
+
+        void disableMotorModel(void)
+        {
+            _motorModel = false;
+        }
+
+        uint32_t count(void)
+        {
+            return _count;
+        }
+
+        uint8_t rotorCount(void)
+        {
+            return _rotorCount;
+        }
+
+        /**
+         * Updates the state of all vehicles.
+         *
+         * @param actuators rotor values in [0,1], rotor-major: the value for
+         *        rotor i of vehicle k is actuators[i * count() + k]
+         * @param dt time in seconds since previous update
+         */
+        void update(const real_t * actuators, const real_t dt)
+        {
+            if (_motorModel) {
+
+                if (dt != _motorDt) {
+                    _motorDt = dt;
+                    BasicDynamics<real_t>::motorCoefficients(_mparams, dt,
+                            _motorAlpha, _motorRise, _motorFall);
+                }
+
+                // One pass over every rotor of every vehicle
+                BasicDynamics<real_t>::filterMotors(actuators, _motorSpeeds,
+                        _count * _rotorCount,
+                        _motorAlpha, _motorRise, _motorFall);
+
+                actuators = _motorSpeeds;
+            }
+
+            computeForces(actuators);
+
+            computeAccelerations();
+
+            integrate(dt);
+        }
+
+        real_t getStateX(const uint32_t index)
+        {
+            return _x[index];
+        }
+
+        real_t getStateDx(const uint32_t index)
+        {
+            return _dx[index];
+        }
+
+        real_t getStateY(const uint32_t index)
+        {
+            return _y[index];
+        }
+
+        real_t getStateDy(const uint32_t index)
+        {
+            return _dy[index];
+        }
+
+        real_t getStateZ(const uint32_t index)
+        {
+            return -_z[index]; // NED => ENU
+        }
+
+        real_t getStateDz(const uint32_t index)
+        {
+            return -_dz[index]; // NED => ENU
+        }
+
+        real_t getStatePhi(const uint32_t index)
+        {
+            return _phi[index];
+        }
+
+        real_t getStateDphi(const uint32_t index)
+        {
+            return _dphi[index];
+        }
+
+        real_t getStateTheta(const uint32_t index)
+        {
+            return _theta[index];
+        }
+
+        real_t getStateDtheta(const uint32_t index)
+        {
+            return _dtheta[index];
+        }
+
+        real_t getStatePsi(const uint32_t index)
+        {
+            return _psi[index];
+        }
+
+        real_t getStateDpsi(const uint32_t index)
+        {
+            return _dpsi[index];
+        }
+
+}; // class BasicDynamicsBatch
+
+typedef BasicDynamicsBatch<float> DynamicsBatch;
@@ -16,31 +16,36 @@
 
 #pragma once
 
-#include "../Dynamics.hpp"
+#include "Static.hpp"
 
-class CoaxialDynamics : public Dynamics {
+template <typename real_t>
+class BasicCoaxialDynamics :
+    public StaticDynamics<BasicCoaxialDynamics<real_t>, real_t, 2, 5> {
 
     private:
 
         
-        static constexpr double FAKE_COLLECTIVE = 5.E-06; // XXX
+        static constexpr real_t FAKE_COLLECTIVE = 5.E-06; // XXX
 
-        static constexpr double CYCLIC_COEFFICIENT = 1.0;
+        static constexpr real_t CYCLIC_COEFFICIENT = 1.0;
 
-        static double computeCyclic(double * actuators, uint8_t axis)
+        static real_t computeCyclic(const real_t * actuators, uint8_t axis)
         {
             return CYCLIC_COEFFICIENT * actuators[axis];
         }
 
-    protected:
+    public:	
+
+        // motor direction for animation
+        static constexpr int8_t ROTOR_DIRECTIONS[2] = {-1, +1};
 
-        virtual double getThrustCoefficient(double * actuators) override
+        real_t thrustCoefficient(const real_t * actuators)
         {
             (void)actuators;
             return FAKE_COLLECTIVE;
         }
 
-        virtual void computeRollAndPitch(double * actuators, double * omegas2, double & roll, double & pitch) override
+        void rollAndPitch(const real_t * actuators, const real_t * omegas2, real_t & roll, real_t & pitch)
         {
             // For a coaxial, rotor speeds do not determine roll and pitch
             (void)omegas2;
@@ -49,19 +54,15 @@ class CoaxialDynamics : public Dynamics {
             pitch = computeCyclic(actuators, 4);
          }
 
-        // motor direction for animation
-        virtual int8_t getRotorDirection(uint8_t i) override
+        BasicCoaxialDynamics(
+                const typename BasicDynamics<real_t>::vehicle_params_t &
+                    vparams,
+                bool autoland=true)
+            : StaticDynamics<BasicCoaxialDynamics<real_t>, real_t, 2, 5>(
+                    vparams, autoland)
         {
-            const int8_t dir[2] = {-1, +1};
-            return dir[i];
         }
 
-    public:	
-
-        CoaxialDynamics(Dynamics::vehicle_params_t &vparams, bool autoland=true)
-            : Dynamics(5, vparams, autoland)
-        {
-            _rotorCount = 2;
-        }
+}; // class BasicCoaxialDynamics
 
-}; // class CoaxialDynamics
+typedef BasicCoaxialDynamics<float> CoaxialDynamics;
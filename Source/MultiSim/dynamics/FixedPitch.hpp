@@ -2,6 +2,10 @@
  * Header-only code for dynamics of vehicles with fixed rotor pitch
  * (quadcopter, hexacopter, ocotocopter, ...)
  *
+ * The stock frames (QuadXBFDynamics, MixerDynamics) reduce their rotors to a
+ * mixing table instead; see Mixer.hpp.  Subclassing this with a roll and
+ * pitch sign per rotor remains for frames of your own.
+ *
  * Copyright (C) 2021 Simon D. Levy
  *
  * MIT License
@@ -11,7 +15,8 @@
 
 #include "../Dynamics.hpp"
 
-class FixedPitchDynamics : public Dynamics {
+template <typename real_t>
+class BasicFixedPitchDynamics : public BasicDynamics<real_t> {
 
     public:
 
@@ -20,8 +25,8 @@ class FixedPitchDynamics : public Dynamics {
          */
         typedef struct {
 
-            double b;  // thrust coefficient [F=b*w^2]
-            double l;  // arm length [m]
+            real_t b;  // thrust coefficient [F=b*w^2]
+            real_t l;  // arm length [m]
 
         } fixed_pitch_params_t; 
 
@@ -31,18 +36,19 @@ class FixedPitchDynamics : public Dynamics {
 
     protected:
 
-        FixedPitchDynamics(
+        BasicFixedPitchDynamics(
                 uint8_t nmotors,
-                Dynamics::vehicle_params_t &vparams,
-                fixed_pitch_params_t &fparams,
+                const typename BasicDynamics<real_t>::vehicle_params_t &
+                    vparams,
+                const fixed_pitch_params_t &fparams,
                 bool autoland=true)
-            : Dynamics(nmotors, vparams, autoland)
+            : BasicDynamics<real_t>(nmotors, vparams, autoland)
         {
             memcpy(&_fparams, &fparams, sizeof(fixed_pitch_params_t));
         }
 
 
-        virtual double getThrustCoefficient(double * actuators) override
+        virtual real_t getThrustCoefficient(const real_t * actuators) override
         {
             // Thrust coefficient is constant for fixed-pitch rotors
 
@@ -52,10 +58,10 @@ class FixedPitchDynamics : public Dynamics {
         }
 
         virtual void computeRollAndPitch(
-                double * actuators,
-                double * omegas2,
-                double & roll,
-                double & pitch) override
+                const real_t * actuators,
+                const real_t * omegas2,
+                real_t & roll,
+                real_t & pitch) override
         {
             // We've already used actuators to compute omegas2
             (void)actuators;
@@ -63,7 +69,7 @@ class FixedPitchDynamics : public Dynamics {
             roll = 0;
             pitch = 0;
 
-            for (uint8_t i=0; i<_rotorCount; ++i) {
+            for (uint8_t i=0; i<this->_rotorCount; ++i) {
                 roll += _fparams.l * _fparams.b * omegas2[i] * getRotorRollContribution(i);
                 pitch += _fparams.l * _fparams.b * omegas2[i] * getRotorPitchContribution(i);
             }
@@ -76,4 +82,6 @@ class FixedPitchDynamics : public Dynamics {
         virtual int8_t getRotorPitchContribution(uint8_t i)= 0;
 
  
-}; // class FixedPitchDynamics
+}; // class BasicFixedPitchDynamics
+
+typedef BasicFixedPitchDynamics<float> FixedPitchDynamics;
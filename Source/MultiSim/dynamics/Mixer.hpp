@@ -0,0 +1,285 @@
+/*
+ * Table-driven dynamics for fixed-pitch frames with any number of rotors
+ *
+ * Each rotor is described by its position, spin direction, and thrust axis.
+ * At construction these are reduced to a 4xN mixing matrix taking squared
+ * rotor speeds to thrust, roll, pitch, and yaw forces, so each update is a
+ * single small matrix-vector product over a rotor count fixed at compile
+ * time.  New frames need only a new table.
+ *
+ * Only the body-Z component of each rotor's thrust moves the vehicle;
+ * tilted axes change the thrust, roll, pitch, and yaw they contribute, but
+ * their sideways force is not modeled.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include "FixedPitch.hpp"
+
+class RotorLayout {
+
+    public:
+
+        /**
+         * One rotor, in body coordinates (forward, right, down).  Positions
+         * are in multiples of the arm length l.
+         */
+        typedef struct {
+
+            double x;
+            double y;
+            double z;
+
+            int8_t direction; // spin direction, as in getRotorDirection()
+
+            double axis[3]; // unit thrust direction; {0, 0, -1} is upright
+
+        } rotor_t;
+
+        // Betaflight quad-X order, for QuadXBFDynamics
+        static constexpr rotor_t QUAD_X_BF[4] = {
+            {-1, +1, 0, -1, {0, 0, -1}}, // rear right
+            {+1, +1, 0, +1, {0, 0, -1}}, // front right
+            {-1, -1, 0, +1, {0, 0, -1}}, // rear left
+            {+1, -1, 0, -1, {0, 0, -1}}, // front left
+        };
+
+        // Clockwise from front right, at 60-degree spacing
+        static constexpr rotor_t HEXA_X[6] = {
+            {+0.8660254037844386, +0.5, 0, +1, {0, 0, -1}},
+            {0, +1, 0, -1, {0, 0, -1}},
+            {-0.8660254037844386, +0.5, 0, +1, {0, 0, -1}},
+            {-0.8660254037844386, -0.5, 0, -1, {0, 0, -1}},
+            {0, -1, 0, +1, {0, 0, -1}},
+            {+0.8660254037844386, -0.5, 0, -1, {0, 0, -1}},
+        };
+
+        // Clockwise from front right, at 45-degree spacing
+        static constexpr rotor_t OCTO_X[8] = {
+            {+0.9238795325112867, +0.3826834323650898, 0, +1, {0, 0, -1}},
+            {+0.3826834323650898, +0.9238795325112867, 0, -1, {0, 0, -1}},
+            {-0.3826834323650898, +0.9238795325112867, 0, +1, {0, 0, -1}},
+            {-0.9238795325112867, +0.3826834323650898, 0, -1, {0, 0, -1}},
+            {-0.9238795325112867, -0.3826834323650898, 0, +1, {0, 0, -1}},
+            {-0.3826834323650898, -0.9238795325112867, 0, -1, {0, 0, -1}},
+            {+0.3826834323650898, -0.9238795325112867, 0, +1, {0, 0, -1}},
+            {+0.9238795325112867, -0.3826834323650898, 0, -1, {0, 0, -1}},
+        };
+
+        // Three coaxial arms: front right, rear, front left; top rotor
+        // first on each arm
+        static constexpr rotor_t Y6[6] = {
+            {+0.5, +0.8660254037844386, -0.1, +1, {0, 0, -1}},
+            {+0.5, +0.8660254037844386, +0.1, -1, {0, 0, -1}},
+            {-1, 0, -0.1, -1, {0, 0, -1}},
+            {-1, 0, +0.1, +1, {0, 0, -1}},
+            {+0.5, -0.8660254037844386, -0.1, +1, {0, 0, -1}},
+            {+0.5, -0.8660254037844386, +0.1, -1, {0, 0, -1}},
+        };
+
+        // Quad-X with a coaxial pair on each arm, in QUAD_X_BF order; top
+        // rotor first on each arm
+        static constexpr rotor_t X8[8] = {
+            {-1, +1, -0.1, -1, {0, 0, -1}},
+            {-1, +1, +0.1, +1, {0, 0, -1}},
+            {+1, +1, -0.1, +1, {0, 0, -1}},
+            {+1, +1, +0.1, -1, {0, 0, -1}},
+            {-1, -1, -0.1, +1, {0, 0, -1}},
+            {-1, -1, +0.1, -1, {0, 0, -1}},
+            {+1, -1, -0.1, -1, {0, 0, -1}},
+            {+1, -1, +0.1, +1, {0, 0, -1}},
+        };
+
+        /**
+         * Reduces one rotor to its column of the mixing matrix, taking
+         * rho * omega^2 to thrust, roll, pitch, and yaw forces, and to its
+         * contribution of speed to net rotor speed.
+         *
+         * @param rotor the rotor
+         * @param b thrust coefficient
+         * @param l arm length
+         * @param d torque constant
+         * @param column output: thrust, roll, pitch, yaw
+         * @param gyro output
+         */
+        template <typename real_t>
+        static void mix(
+                const rotor_t & rotor,
+                const double b,
+                const double l,
+                const double d,
+                real_t column[4],
+                real_t & gyro)
+        {
+            const auto & r = rotor;
+
+            const double n = sqrt(r.axis[0] * r.axis[0] +
+                    r.axis[1] * r.axis[1] + r.axis[2] * r.axis[2]);
+
+            const double ax = r.axis[0] / n;
+            const double ay = r.axis[1] / n;
+            const double az = r.axis[2] / n;
+
+            const double x = l * r.x;
+            const double y = l * r.y;
+            const double z = l * r.z;
+
+            // Thrust is upward (negative body Z) force
+            column[0] = (real_t)(b * -az);
+
+            // Roll and pitch are the X and negated Y components of the
+            // thrust moment about the center of mass
+            column[1] = (real_t)(b * (y * az - z * ay));
+            column[2] = (real_t)(-b * (z * ax - x * az));
+
+            // Yaw adds the rotor's reaction torque to the moment
+            column[3] = (real_t)(b * (x * ay - y * ax) +
+                    d * -r.direction * -az);
+
+            gyro = -r.direction;
+        }
+
+        /**
+         * @param maxrpm rotor speed at full actuator value
+         * @return fractional speed => radians per second
+         */
+        template <typename real_t>
+        static real_t omegaScale(const double maxrpm)
+        {
+            return (real_t)(maxrpm * M_PI / 30);
+        }
+
+}; // class RotorLayout
+
+template <typename real_t, uint8_t ROTORS>
+class BasicMixerDynamics : public BasicDynamics<real_t> {
+
+    static_assert(ROTORS <= BasicDynamics<real_t>::MAX_ROTORS,
+            "too many rotors");
+
+    private:
+
+        // Rows: thrust, roll, pitch, yaw, per unit of rho * omega^2
+        real_t _mixer[4][ROTORS] = {};
+
+        // Contribution of each rotor's speed to net rotor speed
+        real_t _gyro[ROTORS] = {};
+
+        int8_t _directions[ROTORS] = {};
+
+        // Fractional speed => radians per second
+        real_t _omegaScale = 0;
+
+        real_t _b = 0;
+
+    public:
+
+        /**
+         * @param vparams vehicle parameters
+         * @param fparams thrust coefficient and arm length
+         * @param rotors one entry per rotor, e.g. RotorLayout::HEXA_X
+         * @param autoland support fly-to-zero-AGL
+         */
+        BasicMixerDynamics(
+                const typename BasicDynamics<real_t>::vehicle_params_t &
+                    vparams,
+                const typename BasicFixedPitchDynamics<real_t>::
+                    fixed_pitch_params_t & fparams,
+                const RotorLayout::rotor_t (&rotors)[ROTORS],
+                const bool autoland=true)
+            : BasicDynamics<real_t>(ROTORS, vparams, autoland)
+        {
+            for (uint8_t i=0; i<ROTORS; ++i) {
+
+                real_t column[4] = {};
+
+                RotorLayout::mix(rotors[i], fparams.b, fparams.l, vparams.d,
+                        column, _gyro[i]);
+
+                for (uint8_t j=0; j<4; ++j) {
+                    _mixer[j][i] = column[j];
+                }
+
+                _directions[i] = rotors[i].direction;
+            }
+
+            _omegaScale = RotorLayout::omegaScale<real_t>(vparams.maxrpm);
+
+            _b = fparams.b;
+        }
+
+        virtual int8_t getRotorDirection(const uint8_t i) override
+        {
+            return _directions[i];
+        }
+
+        virtual real_t getThrustCoefficient(const real_t * actuators)
+            override
+        {
+            // Thrust coefficient is constant for fixed-pitch rotors
+            (void)actuators;
+
+            return _b;
+        }
+
+        virtual void computeRollAndPitch(
+                const real_t * actuators,
+                const real_t * omegas2,
+                real_t & roll,
+                real_t & pitch) override
+        {
+            (void)actuators;
+
+            roll = 0;
+            pitch = 0;
+
+            for (uint8_t i=0; i<ROTORS; ++i) {
+                roll += _mixer[1][i] * omegas2[i];
+                pitch += _mixer[2][i] * omegas2[i];
+            }
+        }
+
+        virtual BasicDynamics<real_t> * fork(void) override
+        {
+            return new BasicMixerDynamics(*this);
+        }
+
+        /**
+         * Same as Dynamics::update(), with Equation 6 as one mixing-matrix
+         * product.
+         */
+        virtual void update(const real_t * demands, const real_t dt)
+            override
+        {
+            const real_t * actuators = this->applyMotorModel(demands, dt);
+
+            const real_t rho = this->_wparams.rho;
+
+            real_t u[4] = {};
+            real_t omega = 0;
+
+            for (uint8_t i=0; i<ROTORS; ++i) {
+
+                const real_t w = actuators[i] * _omegaScale;
+
+                const real_t w2 = rho * w * w;
+
+                u[0] += _mixer[0][i] * w2;
+                u[1] += _mixer[1][i] * w2;
+                u[2] += _mixer[2][i] * w2;
+                u[3] += _mixer[3][i] * w2;
+
+                omega += _gyro[i] * w;
+            }
+
+            this->updateState(u[0], u[1], u[2], u[3], omega, dt);
+        }
+
+}; // class BasicMixerDynamics
+
+template <uint8_t ROTORS>
+using MixerDynamics = BasicMixerDynamics<float, ROTORS>;
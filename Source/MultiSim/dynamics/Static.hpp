@@ -0,0 +1,125 @@
+/*
+ * Compile-time specialized dynamics, using the Curiously Recurring Template
+ * Pattern (CRTP)
+ *
+ * The rotor count is fixed at compile time, and the per-rotor tables and
+ * coefficients come from the derived class without virtual calls, so the
+ * compiler can fully unroll and inline the rotor loop in update().  The
+ * virtual Dynamics methods are implemented as thin adapters, so Vehicle and
+ * FVehicleThread can keep using a Dynamics pointer.
+ *
+ * A derived class Derived must provide:
+ *
+ *   static constexpr int8_t ROTOR_DIRECTIONS[ROTORS]
+ *
+ *   real_t thrustCoefficient(const real_t * actuators)
+ *
+ *   void rollAndPitch(const real_t * actuators, const real_t * omegas2,
+ *                     real_t & roll, real_t & pitch)
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include "../Dynamics.hpp"
+
+template <class Derived, typename real_t, uint8_t ROTORS,
+         uint8_t ACTUATORS=ROTORS>
+class StaticDynamics : public BasicDynamics<real_t> {
+
+    static_assert(ROTORS <= ACTUATORS, "more rotors than actuators");
+
+    static_assert(ACTUATORS <= BasicDynamics<real_t>::MAX_ROTORS,
+            "too many actuators");
+
+    private:
+
+        Derived & derived(void)
+        {
+            return *static_cast<Derived *>(this);
+        }
+
+    protected:
+
+        StaticDynamics(
+                const typename BasicDynamics<real_t>::vehicle_params_t &
+                    vparams,
+                const bool autoland=true)
+            : BasicDynamics<real_t>(ACTUATORS, vparams, autoland)
+        {
+            this->_rotorCount = ROTORS;
+        }
+
+    public:
+
+        // Dynamics method overrides, forwarding to the derived class
+
+        virtual int8_t getRotorDirection(const uint8_t i) override
+        {
+            return Derived::ROTOR_DIRECTIONS[i];
+        }
+
+        virtual real_t getThrustCoefficient(const real_t * actuators)
+            override
+        {
+            return derived().thrustCoefficient(actuators);
+        }
+
+        virtual void computeRollAndPitch(
+                const real_t * actuators,
+                const real_t * omegas2,
+                real_t & roll,
+                real_t & pitch) override
+        {
+            derived().rollAndPitch(actuators, omegas2, roll, pitch);
+        }
+
+        virtual BasicDynamics<real_t> * fork(void) override
+        {
+            return new Derived(derived());
+        }
+
+        /**
+         * Same as Dynamics::update(), but with the rotor loop resolved at
+         * compile time.
+         */
+        virtual void update(const real_t * demands, const real_t dt)
+            override
+        {
+            const real_t * actuators = this->applyMotorModel(demands, dt);
+
+            // Thrust coefficient is the same for all rotors
+            const real_t thrustCoefficient =
+                derived().thrustCoefficient(actuators);
+
+            const auto & vparams = this->_vparams;
+
+            // Radians per second of rotors, and squared radians per second
+            real_t omegas[ROTORS];
+            real_t omegas2[ROTORS];
+
+            real_t u1 = 0, u4 = 0, omega = 0;
+            for (uint8_t i=0; i<ROTORS; ++i) {
+
+                omegas[i] = actuators[i] * vparams.maxrpm * (real_t)M_PI / 30;
+
+                omegas2[i] = this->_wparams.rho * omegas[i] * omegas[i];
+
+                u1 += thrustCoefficient * omegas2[i];
+
+                const int8_t direction = Derived::ROTOR_DIRECTIONS[i];
+
+                u4 += vparams.d * omegas2[i] * -direction;
+                omega += omegas[i] * -direction;
+            }
+
+            real_t u2 = 0, u3 = 0;
+            derived().rollAndPitch(actuators, omegas2, u2, u3);
+
+            this->updateState(u1, u2, u3, u4, omega, dt);
+        }
+
+}; // class StaticDynamics
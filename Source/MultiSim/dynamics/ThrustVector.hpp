@@ -8,61 +8,59 @@
 
 #pragma once
 
-#include "../Dynamics.hpp"
+#include "Static.hpp"
 #define _USE_MATH_DEFINES
 #include <math.h>
 
-class ThrustVectorDynamics : public Dynamics {
+template <typename real_t>
+class BasicThrustVectorDynamics :
+    public StaticDynamics<BasicThrustVectorDynamics<real_t>, real_t, 2, 4> {
 
     private:
 
         // arbitrary for now
-        static constexpr double THRUST_COEFFICIENT = 1.75E-05;
+        static constexpr real_t THRUST_COEFFICIENT = 1.75E-05;
 
         // radians
-        double _nozzleMaxAngle = 0;
+        real_t _nozzleMaxAngle = 0;
 
-        double computeNozzle(double * motorvals, double * omegas2, uint8_t axis)
+        real_t computeNozzle(const real_t * motorvals, const real_t * omegas2, uint8_t axis)
         {
             return THRUST_COEFFICIENT * (omegas2[0] + omegas2[1]) * sin(motorvals[axis] * _nozzleMaxAngle);
         }
 
-    protected:
+    public:	
+
+        // StaticDynamics interface
 
-        // Dynamics method overrides
+        // motor direction for animation
+        static constexpr int8_t ROTOR_DIRECTIONS[2] = {-1, +1};
 
-        virtual void computeRollAndPitch(double * motorvals, double * omegas2, double & roll, double & pitch) override
+        void rollAndPitch(const real_t * motorvals, const real_t * omegas2, real_t & roll, real_t & pitch)
         {
             roll = computeNozzle(motorvals, omegas2, 2);
             pitch = computeNozzle(motorvals, omegas2, 3);
         }
 
-        // motor direction for animation
-        virtual int8_t getRotorDirection(uint8_t i) override
-        {
-            const int8_t dir[2] = {-1, +1};
-            return dir[i];
-        }
-
-        virtual double getThrustCoefficient(double * motorvals)
+        real_t thrustCoefficient(const real_t * motorvals)
         {
             (void)motorvals;
 
             return THRUST_COEFFICIENT;
         }
 
-    public:	
-
-        ThrustVectorDynamics(
-                Dynamics::vehicle_params_t &vparams,
-                double nozzleMaxAngle,
+        BasicThrustVectorDynamics(
+                const typename BasicDynamics<real_t>::vehicle_params_t &
+                    vparams,
+                real_t nozzleMaxAngle,
                 bool autoland=true)
-            : Dynamics(4, vparams, autoland)
+            : StaticDynamics<BasicThrustVectorDynamics<real_t>, real_t, 2, 4>(
+                    vparams, autoland)
         {
-            _rotorCount = 2;
-
             // degrees => radians
-            _nozzleMaxAngle = M_PI * nozzleMaxAngle / 180;
+            _nozzleMaxAngle = (real_t)M_PI * nozzleMaxAngle / 180;
         }
 
-}; // class ThrustVectorDynamics
+}; // class BasicThrustVectorDynamics
+
+typedef BasicThrustVectorDynamics<float> ThrustVectorDynamics;
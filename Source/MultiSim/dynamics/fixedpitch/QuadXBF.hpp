@@ -14,38 +14,29 @@
 
 #pragma once
 
-#include "../FixedPitch.hpp"
+#include "../Mixer.hpp"
 
-class QuadXBFDynamics : public FixedPitchDynamics {
+template <typename real_t>
+class BasicQuadXBFDynamics : public BasicMixerDynamics<real_t, 4> {
 
-    protected:
+    public:
 
-        virtual int8_t getRotorDirection(uint8_t i) override
-        {
-            static const int8_t d[4] = {-1, +1, +1, -1};
-            return d[i];
-        }
-
-        int8_t getRotorRollContribution(uint8_t i)
+        BasicQuadXBFDynamics(
+                const typename BasicDynamics<real_t>::vehicle_params_t &
+                    vparams,
+                const typename BasicFixedPitchDynamics<real_t>::
+                    fixed_pitch_params_t & fparams,
+                bool autoland=true)
+            : BasicMixerDynamics<real_t, 4>(
+                    vparams, fparams, RotorLayout::QUAD_X_BF, autoland)
         {
-            static const int8_t d[4] = {-1, -1, +1, +1};
-            return d[i];
         }
 
-        int8_t getRotorPitchContribution(uint8_t i)
+        virtual BasicDynamics<real_t> * fork(void) override
         {
-            static const int8_t d[4] = {+1, -1, +1, -1};
-            return d[i];
+            return new BasicQuadXBFDynamics(*this);
         }
 
-    public:	
-
-        QuadXBFDynamics(
-                Dynamics::vehicle_params_t &vparams,
-                FixedPitchDynamics::fixed_pitch_params_t &fparams,
-                bool autoland=true)
-            : FixedPitchDynamics(4, vparams, fparams, autoland)
-        {
-        }
+}; // class BasicQuadXBFDynamics
 
-}; // class QuadXBF
+typedef BasicQuadXBFDynamics<float> QuadXBFDynamics;
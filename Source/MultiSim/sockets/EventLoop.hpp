@@ -0,0 +1,423 @@
+/*
+ * Event loop for serving many sockets from one thread
+ *
+ * Handlers register file descriptors with the loop, which sleeps in
+ * epoll_wait() until one of them is ready and then calls its handler, so
+ * an idle server uses no CPU at all.  EventTimer adds periodic or one-shot
+ * timers on the same loop; TcpEndpoint.hpp and UdpEndpoint.hpp build
+ * servers on it.
+ *
+ * Handlers run on the thread calling run().  stop() may be called from any
+ * thread, or from a signal handler.
+ *
+ * Linux only.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <vector>
+
+class EventLoop {
+
+    public:
+
+        // Readiness events to watch for and to handle
+        static const uint32_t READABLE = EPOLLIN;
+        static const uint32_t WRITABLE = EPOLLOUT;
+        static const uint32_t CLOSED = EPOLLHUP | EPOLLERR | EPOLLRDHUP;
+
+        class Handler {
+
+            public:
+
+                virtual ~Handler(void) {}
+
+                /**
+                 * Called when the file descriptor being watched is ready.
+                 *
+                 * @param events READABLE, WRITABLE and/or CLOSED
+                 */
+                virtual void handleEvents(const uint32_t events) = 0;
+
+        }; // class Handler
+
+    private:
+
+        static const int MAX_EVENTS = 64;
+
+        // epoll data for the wakeup descriptor
+        static const uint64_t WAKEUP = UINT64_MAX;
+
+        // A generation per registration, so that events already fetched
+        // for a descriptor that has since been unwatched (and perhaps
+        // reused) are dropped
+        typedef struct {
+
+            Handler * handler;
+
+            uint32_t generation;
+
+        } watch_t;
+
+        int _epoll = -1;
+
+        // Written by stop()
+        int _wakeup = -1;
+
+        std::vector<watch_t> _watches;
+
+        uint32_t _generation = 0;
+
+        // Deleted once the current batch of events has been handled
+        std::vector<Handler *> _released;
+
+        std::atomic<bool> _stopping;
+
+        uint64_t _dispatched = 0;
+
+        char _message[200] = {};
+
+        static uint64_t pack(const int fd, const uint32_t generation)
+        {
+            return ((uint64_t)generation << 32) | (uint32_t)fd;
+        }
+
+        void deleteReleased(void)
+        {
+            // Deleting may release more
+            while (!_released.empty()) {
+
+                auto released = _released;
+
+                _released.clear();
+
+                for (auto handler : released) {
+                    delete handler;
+                }
+            }
+        }
+
+    public:
+
+        EventLoop(void)
+            : _stopping(false)
+        {
+            _epoll = epoll_create1(EPOLL_CLOEXEC);
+
+            if (_epoll < 0) {
+                snprintf(_message, sizeof(_message),
+                        "epoll_create1() failed: %s", strerror(errno));
+                return;
+            }
+
+            _wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+            if (_wakeup < 0) {
+                snprintf(_message, sizeof(_message),
+                        "eventfd() failed: %s", strerror(errno));
+                return;
+            }
+
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = WAKEUP;
+
+            epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &event);
+        }
+
+        EventLoop(const EventLoop &) = delete;
+
+        EventLoop & operator=(const EventLoop &) = delete;
+
+        ~EventLoop(void)
+        {
+            deleteReleased();
+
+            if (_wakeup >= 0) {
+                close(_wakeup);
+            }
+
+            if (_epoll >= 0) {
+                close(_epoll);
+            }
+        }
+
+        /**
+         * Starts calling a handler when a file descriptor is ready.
+         *
+         * @param fd descriptor, which should be non-blocking
+         * @param events READABLE and/or WRITABLE; CLOSED is always watched
+         * @param handler called on the loop's thread
+         * @return false on failure
+         */
+        bool watch(const int fd, const uint32_t events, Handler * handler)
+        {
+            if (fd < 0 || _epoll < 0) {
+                return false;
+            }
+
+            if ((size_t)fd >= _watches.size()) {
+                _watches.resize(fd + 1, watch_t {});
+            }
+
+            auto & watch = _watches[fd];
+
+            watch.handler = handler;
+            watch.generation = ++_generation;
+
+            struct epoll_event event = {};
+            event.events = events | EPOLLRDHUP;
+            event.data.u64 = pack(fd, watch.generation);
+
+            if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+                watch.handler = NULL;
+                return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * Changes the events watched for on a descriptor.
+         */
+        bool modify(const int fd, const uint32_t events)
+        {
+            if (fd < 0 || (size_t)fd >= _watches.size() ||
+                    !_watches[fd].handler) {
+                return false;
+            }
+
+            struct epoll_event event = {};
+            event.events = events | EPOLLRDHUP;
+            event.data.u64 = pack(fd, _watches[fd].generation);
+
+            return epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &event) == 0;
+        }
+
+        /**
+         * Stops watching a descriptor.  Call before closing it.
+         */
+        void unwatch(const int fd)
+        {
+            if (fd < 0 || (size_t)fd >= _watches.size() ||
+                    !_watches[fd].handler) {
+                return;
+            }
+
+            epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, NULL);
+
+            _watches[fd].handler = NULL;
+            _watches[fd].generation = ++_generation;
+        }
+
+        /**
+         * Deletes a handler once the events being handled are done with,
+         * so a handler can give up itself or another handler safely.
+         */
+        void release(Handler * handler)
+        {
+            _released.push_back(handler);
+        }
+
+        /**
+         * Waits for and handles one batch of events.
+         *
+         * @param timeoutMsec how long to wait; -1 to wait until something
+         *        is ready or stop() is called
+         * @return number of handlers called, or -1 on error
+         */
+        int runOnce(const int timeoutMsec=-1)
+        {
+            struct epoll_event events[MAX_EVENTS];
+
+            const auto count =
+                epoll_wait(_epoll, events, MAX_EVENTS, timeoutMsec);
+
+            if (count < 0) {
+                return errno == EINTR ? 0 : -1;
+            }
+
+            int handled = 0;
+
+            for (int k=0; k<count; ++k) {
+
+                const auto data = events[k].data.u64;
+
+                if (data == WAKEUP) {
+                    uint64_t value = 0;
+                    (void)!read(_wakeup, &value, sizeof(value));
+                    continue;
+                }
+
+                const auto fd = (int)(uint32_t)data;
+                const auto generation = (uint32_t)(data >> 32);
+
+                if ((size_t)fd >= _watches.size()) {
+                    continue;
+                }
+
+                auto & watch = _watches[fd];
+
+                if (!watch.handler || watch.generation != generation) {
+                    continue;
+                }
+
+                const auto ready = events[k].events;
+
+                watch.handler->handleEvents(
+                        (ready & (READABLE | WRITABLE)) |
+                        (ready & CLOSED ? CLOSED : 0));
+
+                handled++;
+            }
+
+            _dispatched += handled;
+
+            deleteReleased();
+
+            return handled;
+        }
+
+        /**
+         * Handles events until stop() is called.
+         *
+         * @return false if waiting failed
+         */
+        bool run(void)
+        {
+            while (!_stopping.load(std::memory_order_acquire)) {
+
+                if (runOnce() < 0) {
+                    snprintf(_message, sizeof(_message),
+                            "epoll_wait() failed: %s", strerror(errno));
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /**
+         * Makes run() return after the events it is handling.  Safe from
+         * any thread and from signal handlers.
+         */
+        void stop(void)
+        {
+            _stopping.store(true, std::memory_order_release);
+
+            const uint64_t one = 1;
+
+            (void)!write(_wakeup, &one, sizeof(one));
+        }
+
+        bool isStopping(void)
+        {
+            return _stopping.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @return handler calls so far
+         */
+        uint64_t dispatched(void)
+        {
+            return _dispatched;
+        }
+
+        char * getMessage(void)
+        {
+            return _message;
+        }
+
+}; // class EventLoop
+
+// Override onTimer() and call start()
+class EventTimer : public EventLoop::Handler {
+
+    private:
+
+        EventLoop * _loop = NULL;
+
+        int _fd = -1;
+
+    public:
+
+        EventTimer(EventLoop & loop)
+        {
+            _loop = &loop;
+
+            _fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+            _loop->watch(_fd, EventLoop::READABLE, this);
+        }
+
+        virtual ~EventTimer(void)
+        {
+            _loop->unwatch(_fd);
+
+            if (_fd >= 0) {
+                close(_fd);
+            }
+        }
+
+        /**
+         * @param periodSec seconds until the first call, and between calls
+         * @param repeat false for a single call
+         * @return false on failure
+         */
+        bool start(const double periodSec, const bool repeat=true)
+        {
+            const auto nsec = (uint64_t)(periodSec * 1e9);
+
+            struct itimerspec spec = {};
+            spec.it_value.tv_sec = nsec / 1000000000;
+            spec.it_value.tv_nsec = nsec % 1000000000;
+
+            // A zero value would disarm the timer
+            if (nsec == 0) {
+                spec.it_value.tv_nsec = 1;
+            }
+
+            if (repeat) {
+                spec.it_interval = spec.it_value;
+            }
+
+            return timerfd_settime(_fd, 0, &spec, NULL) == 0;
+        }
+
+        void cancel(void)
+        {
+            struct itimerspec spec = {};
+
+            timerfd_settime(_fd, 0, &spec, NULL);
+        }
+
+        virtual void onTimer(void) = 0;
+
+        virtual void handleEvents(const uint32_t events) override
+        {
+            (void)events;
+
+            // Calls missed while the loop was busy are folded into one
+            uint64_t expirations = 0;
+
+            if (read(_fd, &expirations, sizeof(expirations)) ==
+                    sizeof(expirations)) {
+                onTimer();
+            }
+        }
+
+}; // class EventTimer
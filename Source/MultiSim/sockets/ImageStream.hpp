@@ -0,0 +1,556 @@
+/*
+ * Framed image stream from the simulator's cameras
+ *
+ * Every frame is a 32-byte header followed by the pixels, so a receiver
+ * always knows where a frame starts, how big it is and when it was taken:
+ *
+ *   offset  size  field
+ *        0     2  magic, 0x494D ("MI")
+ *        2     1  version, 1
+ *        3     1  pixel format: PIXEL_BGRA8, PIXEL_RGBA8 or PIXEL_GRAY8
+ *        4     1  camera id
+ *        5     1  reserved, zero
+ *        6     2  width in pixels
+ *        8     2  height in pixels
+ *       10     2  reserved, zero
+ *       12     4  frame id, counting the camera's frames from one
+ *       16     4  bytes per row
+ *       20     4  pixel bytes following the header: rows times bytes per row
+ *       24     8  capture time, in nanoseconds since the Unix epoch
+ *       32        pixels, top row first
+ *
+ * All fields are little-endian.  Proxy/camproxy.cpp is a reference
+ * receiver.
+ *
+ * ImageSender sends the header and the pixels together in one gather
+ * write (sendmsg() on Linux and macOS, WSASend() on Windows), with Nagle's algorithm
+ * off so that a frame's last segment goes out at once.  On Linux it also
+ * asks for MSG_ZEROCOPY, letting the NIC read pixels straight from our
+ * buffers; since the kernel then holds on to a buffer until the frame has
+ * been acknowledged, frames go through a small ring of buffers from
+ * acquire().  Where the kernel reports that it copied anyway, as it does
+ * over loopback, zero-copy is turned off.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include "TcpClientSocket.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+
+// Older headers lack these
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#endif
+
+class ImageStream {
+
+    public:
+
+        static const uint16_t MAGIC = 0x494D;
+
+        static const uint8_t VERSION = 1;
+
+        typedef enum {
+
+            PIXEL_BGRA8 = 1, // as Unreal Engine's FColor
+            PIXEL_RGBA8 = 2,
+            PIXEL_GRAY8 = 3
+
+        } pixel_format_t;
+
+        typedef struct {
+
+            uint16_t magic;
+            uint8_t version;
+            uint8_t format;
+            uint8_t camera;
+            uint8_t reserved;
+            uint16_t width;
+            uint16_t height;
+            uint16_t reserved2;
+            uint32_t frame;
+            uint32_t stride;
+            uint32_t size;
+            uint64_t timestamp;
+
+        } header_t;
+
+        static_assert(sizeof(header_t) == 32, "header must be 32 bytes");
+
+        // Largest frame check() accepts, so that a corrupt header can't
+        // make a receiver allocate without limit
+        static const uint32_t MAX_FRAME_BYTES = 64 << 20;
+
+        /**
+         * @return bytes per pixel, or zero for an unknown format
+         */
+        static uint8_t bytesPerPixel(const uint8_t format)
+        {
+            switch (format) {
+                case PIXEL_BGRA8:
+                case PIXEL_RGBA8:
+                    return 4;
+                case PIXEL_GRAY8:
+                    return 1;
+                default:
+                    return 0;
+            }
+        }
+
+        /**
+         * @return nanoseconds since the Unix epoch
+         */
+        static uint64_t wallNow(void)
+        {
+            return (uint64_t)std::chrono::duration_cast<
+                std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+
+        /**
+         * Fills in a header for tightly packed rows, taken now.
+         */
+        static header_t header(
+                const uint32_t frame,
+                const uint16_t width,
+                const uint16_t height,
+                const pixel_format_t format,
+                const uint8_t camera=0)
+        {
+            header_t header = {};
+
+            header.magic = MAGIC;
+            header.version = VERSION;
+            header.format = (uint8_t)format;
+            header.camera = camera;
+            header.width = width;
+            header.height = height;
+            header.frame = frame;
+            header.stride = width * bytesPerPixel(format);
+            header.size = header.stride * height;
+            header.timestamp = wallNow();
+
+            return header;
+        }
+
+        /**
+         * @return true if a received header describes a frame we can read:
+         *         right magic and version, known format, and sizes that
+         *         agree
+         */
+        static bool check(const header_t & header)
+        {
+            const auto bpp = bytesPerPixel(header.format);
+
+            return header.magic == MAGIC &&
+                header.version == VERSION &&
+                bpp > 0 &&
+                header.stride >= (uint32_t)header.width * bpp &&
+                (uint64_t)header.stride * header.height == header.size &&
+                header.size <= MAX_FRAME_BYTES;
+        }
+
+}; // class ImageStream
+
+class ImageSender : public TcpClientSocket {
+
+    public:
+
+        typedef struct {
+
+            uint64_t frames;
+            uint64_t bytes;
+
+            // Frames the kernel read from our buffers itself
+            uint64_t zeroCopied;
+
+            // Frames sent while every ring buffer was still in flight
+            uint64_t spared;
+
+        } stats_t;
+
+    private:
+
+        // Buffers a frame can be in flight from
+        static const uint8_t RING = 3;
+
+        typedef struct {
+
+            std::vector<uint8_t> pixels;
+
+            // The kernel may read the header as late as the pixels
+            ImageStream::header_t header;
+
+            // Zero-copy sends that must complete before reuse
+            uint32_t until;
+
+            bool inFlight;
+
+        } slot_t;
+
+        slot_t _ring[RING] = {};
+
+        // For when every slot is in flight; always sent by copying
+        slot_t _spare = {};
+
+        slot_t * _acquired = NULL;
+
+        uint32_t _frame = 0;
+
+        bool _zeroCopy = false;
+
+        // Zero-copy sends made, and completed, as the kernel numbers them
+        uint32_t _zeroCopySends = 0;
+        uint32_t _zeroCopyDone = 0;
+
+        size_t _tunedFor = 0;
+
+        stats_t _stats = {};
+
+        static bool done(const uint32_t done, const uint32_t until)
+        {
+            // Signed difference copes with wraparound
+            return (int32_t)(done - until) >= 0;
+        }
+
+        // Reads zero-copy completions from the socket's error queue
+        void reap(void)
+        {
+#ifdef __linux__
+            // Completions keep coming for sends made before zero-copy
+            // was turned off
+            if (_zeroCopyDone == _zeroCopySends) {
+                return;
+            }
+
+            while (true) {
+
+                char control[128] = {};
+
+                struct msghdr msg = {};
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+
+                if (recvmsg(_conn, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                    return;
+                }
+
+                for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+                        cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+
+                    if (!((cmsg->cmsg_level == SOL_IP &&
+                                    cmsg->cmsg_type == IP_RECVERR) ||
+                                (cmsg->cmsg_level == SOL_IPV6 &&
+                                 cmsg->cmsg_type == IPV6_RECVERR))) {
+                        continue;
+                    }
+
+                    const auto err =
+                        (struct sock_extended_err *)CMSG_DATA(cmsg);
+
+                    if (err->ee_errno != 0 ||
+                            err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                        continue;
+                    }
+
+                    // Sends ee_info through ee_data have completed
+                    if (done(err->ee_data + 1, _zeroCopyDone)) {
+                        _zeroCopyDone = err->ee_data + 1;
+                    }
+
+                    // Copying anyway: pinning pages only costs us
+                    if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                        _zeroCopy = false;
+                    }
+                }
+            }
+#endif
+        }
+
+        bool isFree(slot_t & slot)
+        {
+            if (slot.inFlight && done(_zeroCopyDone, slot.until)) {
+                slot.inFlight = false;
+            }
+
+            return !slot.inFlight;
+        }
+
+        // A send buffer too small for a frame makes every send wait on
+        // the receiver's acknowledgements, so raise it to hold one.  Linux
+        // autotunes its buffers (up to net.ipv4.tcp_wmem) unless SO_SNDBUF
+        // is set, and measured over loopback forcing it bigger only queued
+        // frames up and slowed them down, so there we leave it be.
+        void tuneSendBuffer(const size_t frameBytes)
+        {
+            if (frameBytes <= _tunedFor) {
+                return;
+            }
+
+            _tunedFor = frameBytes;
+
+#ifdef _WIN32
+            const int want = (int)(frameBytes + sizeof(ImageStream::header_t));
+
+            int have = 0;
+            int len = sizeof(have);
+
+            getsockopt(_conn, SOL_SOCKET, SO_SNDBUF, (char *)&have, &len);
+
+            if (have < want) {
+                setsockopt(_conn, SOL_SOCKET, SO_SNDBUF,
+                        (const char *)&want, sizeof(want));
+            }
+#endif
+        }
+
+        bool sendAll(
+                const ImageStream::header_t & header,
+                const uint8_t * pixels,
+                const bool zeroCopy)
+        {
+#ifdef _WIN32
+            (void)zeroCopy;
+
+            WSABUF bufs[2] = {
+                {(ULONG)sizeof(header), (CHAR *)&header},
+                {(ULONG)header.size, (CHAR *)pixels}
+            };
+
+            DWORD sent = 0;
+
+            // Blocking sockets send everything or fail
+            return WSASend(_conn, bufs, 2, &sent, 0, NULL, NULL) == 0 &&
+                sent == sizeof(header) + header.size;
+#else
+            struct iovec iov[2] = {
+                {(void *)&header, sizeof(header)},
+                {(void *)pixels, header.size}
+            };
+
+            struct iovec * first = iov;
+            size_t count = 2;
+
+#ifdef __linux__
+            auto flags = MSG_NOSIGNAL | (zeroCopy ? MSG_ZEROCOPY : 0);
+#else
+            // No zero-copy, and SIGPIPE is off for the whole socket
+            (void)zeroCopy;
+            int flags = 0;
+#endif
+
+            // Keep going until the whole frame is out, so that a short
+            // write can't leave the receiver out of step
+            while (count > 0) {
+
+                struct msghdr msg = {};
+                msg.msg_iov = first;
+                msg.msg_iovlen = count;
+
+                auto sent = sendmsg(_conn, &msg, flags);
+
+                if (sent < 0) {
+
+                    if (errno == EINTR) {
+                        continue;
+                    }
+
+#ifdef __linux__
+                    // Out of memory for pinning pages: copy instead
+                    if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                        flags &= ~MSG_ZEROCOPY;
+                        continue;
+                    }
+#endif
+
+                    return false;
+                }
+
+#ifdef __linux__
+                if (flags & MSG_ZEROCOPY) {
+                    _zeroCopySends++;
+                }
+#endif
+
+                while (count > 0 && (size_t)sent >= first->iov_len) {
+                    sent -= first->iov_len;
+                    first++;
+                    count--;
+                }
+
+                if (count > 0) {
+                    first->iov_base = (uint8_t *)first->iov_base + sent;
+                    first->iov_len -= sent;
+                }
+            }
+
+            return true;
+#endif
+        }
+
+    public:
+
+        ImageSender(const char * host, const short port)
+            : TcpClientSocket(host, port)
+        {
+        }
+
+        /**
+         * Connects, then sets up the socket for frames: no Nagle delay,
+         * and zero-copy sends where the kernel supports them.
+         */
+        void openConnection(void)
+        {
+            TcpClientSocket::openConnection();
+
+            if (!_connected) {
+                return;
+            }
+
+            const int one = 1;
+
+            setsockopt(_conn, IPPROTO_TCP, TCP_NODELAY,
+                    (const char *)&one, sizeof(one));
+
+#ifdef __linux__
+            _zeroCopy = setsockopt(_conn, SOL_SOCKET, SO_ZEROCOPY,
+                    &one, sizeof(one)) == 0;
+#elif defined(SO_NOSIGPIPE)
+            // No MSG_NOSIGNAL on macOS
+            setsockopt(_conn, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        }
+
+        /**
+         * Returns a buffer to put the next frame's pixels in, then pass to
+         * sendFrame().  The buffer stays ours until the kernel has sent
+         * it, so never blocks: if every buffer is still in flight, it
+         * returns one that sendFrame() will send by copying.
+         *
+         * @param size pixel bytes in the frame
+         */
+        uint8_t * acquire(const size_t size)
+        {
+            reap();
+
+            _acquired = &_spare;
+
+            // The first free buffer is the one most likely still in cache
+            for (auto & slot : _ring) {
+
+                if (isFree(slot)) {
+                    _acquired = &slot;
+                    break;
+                }
+            }
+
+            if (_acquired->pixels.size() < size) {
+                _acquired->pixels.resize(size);
+            }
+
+            return &_acquired->pixels[0];
+        }
+
+        /**
+         * Sends one frame, header and pixels together.
+         *
+         * @param pixels tightly packed rows, ideally from acquire(); any
+         *        other buffer is sent by copying
+         * @param width frame width in pixels
+         * @param height frame height in pixels
+         * @param format pixel format
+         * @param camera camera id, for receivers of several cameras
+         * @return false if the frame couldn't be sent, as when the
+         *         receiver has gone
+         */
+        bool sendFrame(
+                const uint8_t * pixels,
+                const uint16_t width,
+                const uint16_t height,
+                const ImageStream::pixel_format_t format,
+                const uint8_t camera=0)
+        {
+            auto slot = _acquired && pixels == &_acquired->pixels[0] ?
+                _acquired : NULL;
+
+            _acquired = NULL;
+
+            if (!_connected) {
+                return false;
+            }
+
+            const auto zeroCopy = _zeroCopy && slot && slot != &_spare;
+
+            ImageStream::header_t local = {};
+
+            auto & header = slot ? slot->header : local;
+
+            header = ImageStream::header(++_frame, width, height, format,
+                    camera);
+
+            tuneSendBuffer(header.size);
+
+            const auto sendsBefore = _zeroCopySends;
+
+            if (!sendAll(header, pixels, zeroCopy)) {
+                sprintf_s(_message, "send() failed; closing image stream");
+                closesocket(_sock);
+                _sock = INVALID_SOCKET;
+                _connected = false;
+                return false;
+            }
+
+            if (zeroCopy && _zeroCopySends != sendsBefore) {
+                slot->until = _zeroCopySends;
+                slot->inFlight = true;
+                _stats.zeroCopied++;
+            }
+
+            if (slot == &_spare) {
+                _stats.spared++;
+            }
+
+            _stats.frames++;
+            _stats.bytes += sizeof(header) + header.size;
+
+            return true;
+        }
+
+        /**
+         * @return true while frames are being sent zero-copy
+         */
+        bool isZeroCopy(void)
+        {
+            return _zeroCopy;
+        }
+
+        stats_t stats(void)
+        {
+            return _stats;
+        }
+
+}; // class ImageSender
@@ -0,0 +1,435 @@
+/*
+ * TCP server endpoints for EventLoop
+ *
+ * A TcpListener accepts any number of clients, making a TcpConnection for
+ * each through accepted(), which subclasses override.  A connection buffers
+ * what arrives and calls onReceive(), from which read() takes whole
+ * messages; send() never blocks, queueing whatever the socket can't take
+ * yet.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include "LinuxSocket.hpp"
+#include "EventLoop.hpp"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <algorithm>
+
+class TcpListener;
+
+class TcpConnection : public EventLoop::Handler {
+
+    friend class TcpListener;
+
+    private:
+
+        // Bytes read per recv()
+        static const size_t CHUNK = 4096;
+
+        EventLoop * _loop = NULL;
+
+        TcpListener * _listener = NULL;
+
+        socket_t _sock = INVALID_SOCKET;
+
+        // Input not read yet starts at _inputStart
+        std::vector<uint8_t> _input;
+        size_t _inputStart = 0;
+
+        // Output the socket couldn't take yet
+        std::vector<uint8_t> _output;
+
+        bool _open = false;
+
+        // Returns false once the peer has gone
+        bool receive(void)
+        {
+            // Compact once the read part dominates
+            if (_inputStart > 0 && _inputStart >= _input.size() / 2) {
+                _input.erase(_input.begin(), _input.begin() + _inputStart);
+                _inputStart = 0;
+            }
+
+            while (true) {
+
+                const auto size = _input.size();
+
+                _input.resize(size + CHUNK);
+
+                const auto count = recv(_sock, &_input[size], CHUNK, 0);
+
+                _input.resize(size + (count > 0 ? count : 0));
+
+                if (count > 0) {
+                    continue;
+                }
+
+                return count < 0 && (errno == EAGAIN ||
+                        errno == EWOULDBLOCK || errno == EINTR);
+            }
+        }
+
+        void flush(void)
+        {
+            while (!_output.empty()) {
+
+                const auto count = ::send(_sock, &_output[0],
+                        _output.size(), MSG_NOSIGNAL);
+
+                if (count < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        close();
+                    }
+                    return;
+                }
+
+                _output.erase(_output.begin(), _output.begin() + count);
+            }
+
+            _loop->modify(_sock, EventLoop::READABLE);
+        }
+
+    public:
+
+        /**
+         * @param loop loop to serve the connection on
+         * @param sock connected socket, as from accept()
+         */
+        TcpConnection(EventLoop & loop, const socket_t sock)
+        {
+            _loop = &loop;
+            _sock = sock;
+
+            // Messages are small and each one matters now
+            const int one = 1;
+            setsockopt(_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            const auto flags = fcntl(_sock, F_GETFL);
+            fcntl(_sock, F_SETFL, flags | O_NONBLOCK);
+
+            _open = _loop->watch(_sock, EventLoop::READABLE, this);
+        }
+
+        TcpConnection(const TcpConnection &) = delete;
+
+        TcpConnection & operator=(const TcpConnection &) = delete;
+
+        virtual ~TcpConnection(void)
+        {
+            if (_open) {
+                _loop->unwatch(_sock);
+                ::close(_sock);
+            }
+        }
+
+        /**
+         * Called on new input; take it with read().
+         */
+        virtual void onReceive(void) = 0;
+
+        /**
+         * Called once when the connection closes, from either end.  The
+         * listener then deletes the connection.
+         */
+        virtual void onClose(void)
+        {
+        }
+
+        /**
+         * Sends now what the socket will take, and the rest when it can.
+         *
+         * @return false if the connection is closed
+         */
+        bool send(const void * buf, const size_t len)
+        {
+            if (!_open) {
+                return false;
+            }
+
+            size_t sent = 0;
+
+            if (_output.empty()) {
+
+                const auto count = ::send(_sock, buf, len, MSG_NOSIGNAL);
+
+                if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    close();
+                    return false;
+                }
+
+                sent = count > 0 ? count : 0;
+            }
+
+            if (sent < len) {
+
+                const auto bytes = (const uint8_t *)buf;
+
+                _output.insert(_output.end(), bytes + sent, bytes + len);
+
+                _loop->modify(_sock,
+                        EventLoop::READABLE | EventLoop::WRITABLE);
+            }
+
+            return true;
+        }
+
+        /**
+         * @return input bytes waiting to be read
+         */
+        size_t available(void)
+        {
+            return _input.size() - _inputStart;
+        }
+
+        /**
+         * Takes len bytes of input, if that many have arrived.
+         *
+         * @return false, taking nothing, if they haven't
+         */
+        bool read(void * buf, const size_t len)
+        {
+            if (available() < len) {
+                return false;
+            }
+
+            memcpy(buf, &_input[_inputStart], len);
+
+            _inputStart += len;
+
+            return true;
+        }
+
+        /**
+         * Closes the connection, calling onClose().
+         */
+        void close(void);
+
+        bool isOpen(void)
+        {
+            return _open;
+        }
+
+        virtual void handleEvents(const uint32_t events) override
+        {
+            if (events & EventLoop::WRITABLE) {
+                flush();
+            }
+
+            if (_open &&
+                    (events & (EventLoop::READABLE | EventLoop::CLOSED))) {
+
+                const auto open = receive();
+
+                // Whatever came before the peer went
+                if (available()) {
+                    onReceive();
+                }
+
+                if (!open) {
+                    close();
+                }
+            }
+        }
+
+}; // class TcpConnection
+
+// Override accepted()
+class TcpListener : public EventLoop::Handler {
+
+    private:
+
+        EventLoop * _loop = NULL;
+
+        socket_t _sock = INVALID_SOCKET;
+
+        std::vector<TcpConnection *> _connections;
+
+        char _message[200] = {};
+
+        uint64_t _accepted = 0;
+
+    public:
+
+        /**
+         * @param loop loop to serve clients on
+         * @param host address to listen on
+         * @param port port to listen on
+         * @param backlog connections waiting to be accepted
+         */
+        TcpListener(
+                EventLoop & loop,
+                const char * host,
+                const uint16_t port,
+                const int backlog=64)
+        {
+            _loop = &loop;
+
+            _sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+            if (_sock == INVALID_SOCKET) {
+                snprintf(_message, sizeof(_message), "socket() failed");
+                return;
+            }
+
+            // Restart without waiting out TIME_WAIT
+            const int one = 1;
+            setsockopt(_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+            struct sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            inet_pton(AF_INET, host, &address.sin_addr);
+
+            if (bind(_sock, (struct sockaddr *)&address, sizeof(address)) ==
+                    SOCKET_ERROR) {
+                snprintf(_message, sizeof(_message), "bind() failed: %s",
+                        strerror(errno));
+                return;
+            }
+
+            if (listen(_sock, backlog) == SOCKET_ERROR) {
+                snprintf(_message, sizeof(_message), "listen() failed: %s",
+                        strerror(errno));
+                return;
+            }
+
+            _loop->watch(_sock, EventLoop::READABLE, this);
+        }
+
+        TcpListener(const TcpListener &) = delete;
+
+        TcpListener & operator=(const TcpListener &) = delete;
+
+        virtual ~TcpListener(void)
+        {
+            for (auto connection : _connections) {
+                connection->_listener = NULL;
+                delete connection;
+            }
+
+            if (_sock != INVALID_SOCKET) {
+                _loop->unwatch(_sock);
+                ::close(_sock);
+            }
+        }
+
+        /**
+         * Makes a connection for a new client.
+         *
+         * @param loop loop to pass to the connection
+         * @param sock the client's socket
+         * @return a new connection, which the listener will delete, or NULL
+         *         to refuse the client
+         */
+        virtual TcpConnection * accepted(EventLoop & loop,
+                const socket_t sock) = 0;
+
+        /**
+         * Closes every connection, and stops accepting more.
+         */
+        void close(void)
+        {
+            // Closing removes each from the list
+            while (!_connections.empty()) {
+                _connections.back()->close();
+            }
+
+            if (_sock != INVALID_SOCKET) {
+                _loop->unwatch(_sock);
+                ::close(_sock);
+                _sock = INVALID_SOCKET;
+            }
+        }
+
+        // Called by a connection that has closed
+        void closed(TcpConnection * connection)
+        {
+            _connections.erase(std::remove(_connections.begin(),
+                        _connections.end(), connection), _connections.end());
+
+            _loop->release(connection);
+        }
+
+        virtual void handleEvents(const uint32_t events) override
+        {
+            (void)events;
+
+            while (true) {
+
+                const auto sock = accept4(_sock, NULL, NULL, SOCK_NONBLOCK);
+
+                if (sock == INVALID_SOCKET) {
+                    return;
+                }
+
+                auto connection = accepted(*_loop, sock);
+
+                if (!connection) {
+                    ::close(sock);
+                    continue;
+                }
+
+                if (!connection->isOpen()) {
+                    delete connection;
+                    continue;
+                }
+
+                connection->_listener = this;
+
+                _connections.push_back(connection);
+
+                _accepted++;
+            }
+        }
+
+        size_t connectionCount(void)
+        {
+            return _connections.size();
+        }
+
+        /**
+         * @param index from zero to connectionCount() - 1, in order of
+         *        arrival
+         */
+        TcpConnection * connection(const size_t index)
+        {
+            return _connections[index];
+        }
+
+        uint64_t acceptedCount(void)
+        {
+            return _accepted;
+        }
+
+        char * getMessage(void)
+        {
+            return _message;
+        }
+
+}; // class TcpListener
+
+inline void TcpConnection::close(void)
+{
+    if (!_open) {
+        return;
+    }
+
+    _open = false;
+
+    _loop->unwatch(_sock);
+
+    ::close(_sock);
+
+    onClose();
+
+    if (_listener) {
+        _listener->closed(this);
+    }
+}
@@ -10,9 +10,6 @@
 
 #include "TcpSocket.hpp"
 
-#ifndef _WIN32
-static void closesocket(int socket) { close(socket); }
-#endif
 
 class TcpServerSocket : public TcpSocket {
 
@@ -24,6 +21,13 @@ class TcpServerSocket : public TcpSocket {
                 const bool nonblock=false)
             : TcpSocket(host, port)        
         {
+#ifndef _WIN32
+            // A socket file left by an earlier run would make bind() fail
+            if (_addressInfo && _addressInfo->ai_family == AF_UNIX) {
+                unlink(_unixAddress.sun_path);
+            }
+#endif
+
             // Bind socket to address
             if (bind(_sock,
                         _addressInfo->ai_addr,
@@ -1,6 +1,9 @@
 /*
  * Cross-platform compatibility superclass for sockets
  *
+ * A host of "unix:PATH" gives a Unix-domain stream socket at PATH instead,
+ * for a peer on the same host (Linux and macOS only).
+ *
  * Copyright (C) 2019 Simon D. Levy
  *
  * MIT License
@@ -14,6 +17,14 @@
 #include "LinuxSocket.hpp"
 #endif
 
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/un.h>
+
+static void closesocket(int socket) { close(socket); }
+#endif
+
 class TcpSocket : public Socket {
 
     protected:
@@ -27,6 +38,41 @@ class TcpSocket : public Socket {
 
         bool _connected;
 
+#ifndef _WIN32
+        // Stands in for getaddrinfo()'s result with a "unix:" host
+        struct sockaddr_un _unixAddress;
+        struct addrinfo _unixInfo;
+#endif
+
+        bool resolveUnix(const char * path)
+        {
+#ifdef _WIN32
+            (void)path;
+            sprintf_s(_message,
+                    "Unix-domain sockets are not supported on Windows");
+            return false;
+#else
+            if (strlen(path) >= sizeof(_unixAddress.sun_path)) {
+                sprintf_s(_message, "socket path too long");
+                return false;
+            }
+
+            memset(&_unixAddress, 0, sizeof(_unixAddress));
+            _unixAddress.sun_family = AF_UNIX;
+            strcpy(_unixAddress.sun_path, path);
+
+            memset(&_unixInfo, 0, sizeof(_unixInfo));
+            _unixInfo.ai_family = AF_UNIX;
+            _unixInfo.ai_socktype = SOCK_STREAM;
+            _unixInfo.ai_addr = (struct sockaddr *)&_unixAddress;
+            _unixInfo.ai_addrlen = sizeof(_unixAddress);
+
+            _addressInfo = &_unixInfo;
+
+            return true;
+#endif
+        }
+
         TcpSocket(const char * host, const short port)
         {
             sprintf_s(_host, "%s", host);
@@ -40,20 +86,34 @@ class TcpSocket : public Socket {
             // Initialize Winsock, returning on failure
             if (!initWinsock()) return;
 
-            // Set up client address info
-            struct addrinfo hints = {0};
-            hints.ai_family = AF_INET;
-            hints.ai_socktype = SOCK_STREAM;
-
-            // Resolve the server address and port, returning on failure
             _addressInfo = NULL;
-            int iResult = getaddrinfo(_host, _port, &hints, &_addressInfo);
-            if ( iResult != 0 ) {
-                sprintf_s(
-                        _message, "getaddrinfo() failed with error: %d", 
-                        iResult);
-                cleanup();
-                return;
+
+            // Port is unused for a Unix-domain socket
+            if (!strncmp(_host, "unix:", 5)) {
+
+                if (!resolveUnix(_host + 5)) {
+                    cleanup();
+                    return;
+                }
+            }
+
+            else {
+
+                // Set up client address info
+                struct addrinfo hints = {0};
+                hints.ai_family = AF_INET;
+                hints.ai_socktype = SOCK_STREAM;
+
+                // Resolve the server address and port, returning on failure
+                int iResult =
+                    getaddrinfo(_host, _port, &hints, &_addressInfo);
+                if ( iResult != 0 ) {
+                    sprintf_s(
+                            _message, "getaddrinfo() failed with error: %d", 
+                            iResult);
+                    cleanup();
+                    return;
+                }
             }
 
             // Create a socket for connecting to server, returning on failure
@@ -70,14 +130,45 @@ class TcpSocket : public Socket {
 
     public:
 
+        // TCP may take or deliver a large buffer a piece at a time, so
+        // these loop until all len bytes are done
+
         bool sendData(void *buf, size_t len)
         {
-            return (size_t)send(_conn, (const char *)buf, len, 0) == len;
+            auto bytes = (const char *)buf;
+
+            while (len > 0) {
+
+                const auto count = send(_conn, bytes, (int)len, 0);
+
+                if (count <= 0) {
+                    return false;
+                }
+
+                bytes += count;
+                len -= count;
+            }
+
+            return true;
         }
 
         bool receiveData(void *buf, size_t len)
         {
-            return (size_t)recv(_conn, (char *)buf, len, 0) == len;
+            auto bytes = (char *)buf;
+
+            while (len > 0) {
+
+                const auto count = recv(_conn, bytes, (int)len, 0);
+
+                if (count <= 0) {
+                    return false;
+                }
+
+                bytes += count;
+                len -= count;
+            }
+
+            return true;
         }
 
         bool isConnected()
@@ -0,0 +1,406 @@
+/*
+ * Class for a UDP socket shared by many vehicles
+ *
+ * Each packet starts with a header naming the vehicle it belongs to.
+ * queue() collects outgoing packets and flush() sends them all with one
+ * sendmmsg(); drain() takes every waiting packet with as few recvmmsg()
+ * calls as it can, handing each to the receiver of the vehicle named in
+ * its header.  So a cycle for any number of vehicles costs a couple of
+ * system calls, instead of a sendto() and a recvfrom() per vehicle.
+ *
+ * Elsewhere than Linux, flush() and drain() fall back to a sendto() or
+ * recvfrom() per packet.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#ifdef _WIN32
+#include "WindowsSocket.hpp"
+#else
+#include "LinuxSocket.hpp"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+class UdpBatchSocket : public Socket {
+
+    public:
+
+        // Packets per system call
+        static const uint32_t BATCH = 64;
+
+        // Largest payload, after the header
+        static const uint32_t PAYLOAD_BYTES = 248;
+
+        // Eight bytes, so that payloads of doubles stay aligned
+        typedef struct {
+
+            uint32_t id;     // vehicle
+            uint32_t length; // payload bytes following
+
+        } header_t;
+
+        // Gets the packets for one vehicle
+        class Receiver {
+
+            public:
+
+                virtual void receive(const void * payload, size_t len) = 0;
+
+        }; // class Receiver
+
+        typedef struct {
+
+            uint64_t sent;       // packets
+            uint64_t dropped;    // packets flush() couldn't send, e.g.
+                                 // with the socket buffer full
+            uint64_t received;   // packets
+            uint64_t unrouted;   // packets with no receiver for their id,
+                                 // or a bad header
+            uint64_t sendCalls;  // system calls
+            uint64_t recvCalls;  // system calls, including empty ones
+
+        } stats_t;
+
+    private:
+
+        typedef struct {
+
+            header_t header;
+
+            uint8_t payload[PAYLOAD_BYTES];
+
+        } packet_t;
+
+        typedef struct {
+
+            struct sockaddr_in address;
+
+            Receiver * receiver;
+
+        } route_t;
+
+        // Indexed by vehicle id
+        std::vector<route_t> _routes;
+
+        packet_t _outgoing[BATCH];
+        struct sockaddr_in _destinations[BATCH];
+        uint32_t _queued = 0;
+
+        packet_t _incoming[BATCH];
+
+        stats_t _stats = {};
+
+#ifdef __linux__
+        struct mmsghdr _sendHeaders[BATCH];
+        struct iovec _sendVectors[BATCH];
+
+        struct mmsghdr _recvHeaders[BATCH];
+        struct iovec _recvVectors[BATCH];
+#endif
+
+        void route(const packet_t & packet, const size_t size)
+        {
+            _stats.received++;
+
+            const auto id = packet.header.id;
+
+            if (size < sizeof(header_t) ||
+                    packet.header.length > size - sizeof(header_t) ||
+                    id >= _routes.size() || !_routes[id].receiver) {
+                _stats.unrouted++;
+                return;
+            }
+
+            _routes[id].receiver->receive(
+                    packet.payload, packet.header.length);
+        }
+
+        // Receives up to BATCH packets without waiting; returns how many
+        uint32_t receiveBatch(void)
+        {
+            _stats.recvCalls++;
+
+#ifdef __linux__
+            for (uint32_t k=0; k<BATCH; ++k) {
+                _recvHeaders[k].msg_hdr.msg_flags = 0;
+            }
+
+            const auto count = recvmmsg(_sock, _recvHeaders, BATCH,
+                    MSG_DONTWAIT, NULL);
+
+            if (count <= 0) {
+                return 0;
+            }
+
+            for (int k=0; k<count; ++k) {
+                route(_incoming[k], _recvHeaders[k].msg_len);
+            }
+
+            return (uint32_t)count;
+#else
+            const auto size = recv(_sock, (char *)&_incoming[0],
+                    (int)sizeof(packet_t), 0);
+
+            if ((int)size <= 0) {
+                return 0;
+            }
+
+            route(_incoming[0], (size_t)size);
+
+            return 1;
+#endif
+        }
+
+    public:
+
+        /**
+         * @param port port to receive on; 0 to send only
+         */
+        UdpBatchSocket(const short port=0)
+        {
+            _message[0] = 0;
+
+            // Initialize Winsock, returning on failure
+            if (!initWinsock()) return;
+
+            // Create socket
+            _sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            if (_sock == INVALID_SOCKET) {
+                sprintf_s(_message, "socket() failed");
+                return;
+            }
+
+            if (port) {
+
+                struct sockaddr_in server = {};
+                server.sin_family = AF_INET;
+                server.sin_addr.s_addr = INADDR_ANY;
+                server.sin_port = htons(port);
+
+                if (bind(
+                            _sock,
+                            (struct sockaddr *)&server,
+                            sizeof(server)) == SOCKET_ERROR) {
+
+                    sprintf_s(_message, "bind() failed");
+                    return;
+                }
+            }
+
+            // drain() must never wait
+            if (!setNonblocking()) {
+                sprintf_s(_message, "setNonblocking() failed");
+                return;
+            }
+
+#ifdef __linux__
+            memset(_sendHeaders, 0, sizeof(_sendHeaders));
+            memset(_recvHeaders, 0, sizeof(_recvHeaders));
+
+            for (uint32_t k=0; k<BATCH; ++k) {
+
+                _sendVectors[k].iov_base = &_outgoing[k];
+                _sendHeaders[k].msg_hdr.msg_iov = &_sendVectors[k];
+                _sendHeaders[k].msg_hdr.msg_iovlen = 1;
+                _sendHeaders[k].msg_hdr.msg_name = &_destinations[k];
+                _sendHeaders[k].msg_hdr.msg_namelen =
+                    sizeof(_destinations[k]);
+
+                _recvVectors[k].iov_base = &_incoming[k];
+                _recvVectors[k].iov_len = sizeof(packet_t);
+                _recvHeaders[k].msg_hdr.msg_iov = &_recvVectors[k];
+                _recvHeaders[k].msg_hdr.msg_iovlen = 1;
+            }
+#endif
+        }
+
+        /**
+         * Sets where a vehicle's packets go, and who gets the packets
+         * carrying its id.
+         *
+         * @param id vehicle id; keep these small, as they index a table
+         * @param host destination host
+         * @param port destination port
+         * @param receiver gets this vehicle's incoming packets; NULL to
+         *        drop them
+         */
+        void addVehicle(
+                const uint32_t id,
+                const char * host,
+                const short port,
+                Receiver * receiver=NULL)
+        {
+            if (id >= _routes.size()) {
+                _routes.resize(id + 1, route_t {});
+            }
+
+            auto & route = _routes[id];
+
+            memset(&route.address, 0, sizeof(route.address));
+            route.address.sin_family = AF_INET;
+            route.address.sin_port = htons(port);
+            Socket::inetPton(host, route.address);
+
+            route.receiver = receiver;
+        }
+
+        /**
+         * Queues a packet for a vehicle, flushing first if the batch is
+         * full.
+         *
+         * @return false if the vehicle is unknown or the payload too big
+         */
+        bool queue(const uint32_t id, const void * payload, const size_t len)
+        {
+            if (id >= _routes.size() || len > PAYLOAD_BYTES) {
+                return false;
+            }
+
+            if (_queued == BATCH) {
+                flush();
+            }
+
+            auto & packet = _outgoing[_queued];
+
+            packet.header.id = id;
+            packet.header.length = (uint32_t)len;
+            memcpy(packet.payload, payload, len);
+
+            _destinations[_queued] = _routes[id].address;
+
+#ifdef __linux__
+            _sendVectors[_queued].iov_len = sizeof(header_t) + len;
+#endif
+
+            _queued++;
+
+            return true;
+        }
+
+        /**
+         * Sends every queued packet, dropping (and counting) any the socket
+         * won't take without waiting.
+         *
+         * @return packets sent
+         */
+        uint32_t flush(void)
+        {
+            uint32_t sent = 0;
+
+#ifdef __linux__
+            while (sent < _queued) {
+
+                _stats.sendCalls++;
+
+                const auto count = sendmmsg(_sock, _sendHeaders + sent,
+                        _queued - sent, 0);
+
+                // Drop the rest, as a full socket buffer would
+                if (count <= 0) {
+                    _stats.dropped += _queued - sent;
+                    break;
+                }
+
+                sent += count;
+            }
+#else
+            for (uint32_t k=0; k<_queued; ++k) {
+
+                _stats.sendCalls++;
+
+                if (sendto(_sock, (const char *)&_outgoing[k],
+                            (int)(sizeof(header_t) +
+                                _outgoing[k].header.length),
+                            0, (struct sockaddr *)&_destinations[k],
+                            (int)sizeof(_destinations[k])) != SOCKET_ERROR) {
+                    sent++;
+                }
+                else {
+                    _stats.dropped++;
+                }
+            }
+#endif
+
+            _stats.sent += sent;
+
+            _queued = 0;
+
+            return sent;
+        }
+
+        /**
+         * Hands every packet waiting on the socket to its vehicle's
+         * receiver, without waiting for more.
+         *
+         * @return packets received
+         */
+        uint32_t drain(void)
+        {
+            uint32_t total = 0;
+
+            while (true) {
+
+                const auto count = receiveBatch();
+
+                total += count;
+
+#ifdef __linux__
+                // A short batch means the socket is empty
+                if (count < BATCH) {
+                    break;
+                }
+#else
+                if (count == 0) {
+                    break;
+                }
+#endif
+            }
+
+            return total;
+        }
+
+        /**
+         * Builds a packet as a controller sends it: header, then payload.
+         *
+         * @return packet bytes, or zero if the payload is too big
+         */
+        static size_t pack(
+                const uint32_t id,
+                const void * payload,
+                const size_t len,
+                void * packet,
+                const size_t packetSize)
+        {
+            if (len > PAYLOAD_BYTES || sizeof(header_t) + len > packetSize) {
+                return 0;
+            }
+
+            header_t header = {id, (uint32_t)len};
+
+            memcpy(packet, &header, sizeof(header));
+            memcpy((uint8_t *)packet + sizeof(header), payload, len);
+
+            return sizeof(header) + len;
+        }
+
+        stats_t stats(void)
+        {
+            return _stats;
+        }
+
+        static UdpBatchSocket * free(UdpBatchSocket * socket)
+        {
+            socket->closeConnection();
+            delete socket;
+            return NULL;
+        }
+
+}; // class UdpBatchSocket
@@ -0,0 +1,136 @@
+/*
+ * UDP endpoint for EventLoop
+ *
+ * Calls onReceive(), which subclasses override, for each datagram as it
+ * arrives, along with who sent it, so one endpoint can serve any number
+ * of peers.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include "LinuxSocket.hpp"
+#include "EventLoop.hpp"
+
+class UdpEndpoint : public EventLoop::Handler {
+
+    private:
+
+        static const size_t MAX_DATAGRAM = 65536;
+
+        EventLoop * _loop = NULL;
+
+        socket_t _sock = INVALID_SOCKET;
+
+        uint8_t _buffer[MAX_DATAGRAM];
+
+        char _message[200] = {};
+
+    public:
+
+        /**
+         * @param loop loop to receive on
+         * @param port port to receive on; 0 for any
+         */
+        UdpEndpoint(EventLoop & loop, const uint16_t port=0)
+        {
+            _loop = &loop;
+
+            _sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+
+            if (_sock == INVALID_SOCKET) {
+                snprintf(_message, sizeof(_message), "socket() failed");
+                return;
+            }
+
+            struct sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = INADDR_ANY;
+            address.sin_port = htons(port);
+
+            if (bind(_sock, (struct sockaddr *)&address, sizeof(address)) ==
+                    SOCKET_ERROR) {
+                snprintf(_message, sizeof(_message), "bind() failed: %s",
+                        strerror(errno));
+                return;
+            }
+
+            _loop->watch(_sock, EventLoop::READABLE, this);
+        }
+
+        UdpEndpoint(const UdpEndpoint &) = delete;
+
+        UdpEndpoint & operator=(const UdpEndpoint &) = delete;
+
+        virtual ~UdpEndpoint(void)
+        {
+            closeConnection();
+        }
+
+        /**
+         * Called for each datagram.
+         *
+         * @param buf the datagram, valid only during the call
+         * @param len its size
+         * @param from its sender, for replying with sendTo()
+         */
+        virtual void onReceive(const void * buf, const size_t len,
+                const struct sockaddr_in & from) = 0;
+
+        bool sendTo(const void * buf, const size_t len,
+                const struct sockaddr_in & to)
+        {
+            return sendto(_sock, buf, len, 0,
+                    (const struct sockaddr *)&to, sizeof(to)) == (ssize_t)len;
+        }
+
+        bool sendTo(const void * buf, const size_t len,
+                const char * host, const uint16_t port)
+        {
+            struct sockaddr_in to = {};
+            to.sin_family = AF_INET;
+            to.sin_port = htons(port);
+            inet_pton(AF_INET, host, &to.sin_addr);
+
+            return sendTo(buf, len, to);
+        }
+
+        void closeConnection(void)
+        {
+            if (_sock != INVALID_SOCKET) {
+                _loop->unwatch(_sock);
+                close(_sock);
+                _sock = INVALID_SOCKET;
+            }
+        }
+
+        virtual void handleEvents(const uint32_t events) override
+        {
+            (void)events;
+
+            // Drain the socket
+            while (_sock != INVALID_SOCKET) {
+
+                struct sockaddr_in from = {};
+                socklen_t fromlen = sizeof(from);
+
+                const auto count = recvfrom(_sock, _buffer, sizeof(_buffer),
+                        0, (struct sockaddr *)&from, &fromlen);
+
+                if (count < 0) {
+                    return;
+                }
+
+                onReceive(_buffer, count, from);
+            }
+        }
+
+        char * getMessage(void)
+        {
+            return _message;
+        }
+
+}; // class UdpEndpoint
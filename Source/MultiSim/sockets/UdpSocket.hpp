@@ -14,8 +14,15 @@
 #include "LinuxSocket.hpp"
 #endif
 
+#include <string.h>
+
 class UdpSocket : public Socket {
 
+    private:
+
+        // Largest datagram drainData() can tell the size of
+        static const size_t MAX_DRAIN = 2048;
+
     protected:
 
         struct sockaddr_in _si_other;
@@ -39,11 +46,71 @@ class UdpSocket : public Socket {
 
         bool receiveData(void * buf, size_t len)
         {
+            // recvfrom() sets _slen to the sender's address length, which
+            // for other address families can exceed _si_other
+            _slen = sizeof(_si_other);
+
             return recvfrom(_sock, (char *)buf, (int)len, 0,
                     (struct sockaddr *) &_si_other, &_slen) 
                 == (recv_size_t)len;
         }
 
+        /**
+         * Takes every datagram already waiting, without waiting for more,
+         * keeping the newest one of the right size.
+         *
+         * @param buf output, untouched if no datagram of len bytes came
+         * @param len expected datagram size
+         * @param dropped incremented for each datagram of another size
+         * @return number of datagrams of the right size taken
+         */
+        uint32_t drainData(void * buf, size_t len, uint32_t & dropped)
+        {
+            char scratch[MAX_DRAIN];
+
+            uint32_t count = 0;
+
+            while (true) {
+
+                _slen = sizeof(_si_other);
+
+#ifdef _WIN32
+                fd_set readable;
+                FD_ZERO(&readable);
+                FD_SET(_sock, &readable);
+
+                struct timeval zero = {};
+
+                if (select(0, &readable, NULL, NULL, &zero) <= 0) {
+                    break;
+                }
+
+                const auto size = (int)recvfrom(_sock, scratch,
+                        (int)sizeof(scratch), 0,
+                        (struct sockaddr *) &_si_other, &_slen);
+#else
+                const auto size = (int)recvfrom(_sock, scratch,
+                        sizeof(scratch), MSG_DONTWAIT,
+                        (struct sockaddr *) &_si_other, &_slen);
+#endif
+
+                if (size < 0) {
+                    break;
+                }
+
+                if ((size_t)size != len) {
+                    dropped++;
+                    continue;
+                }
+
+                memcpy(buf, scratch, len);
+
+                count++;
+            }
+
+            return count;
+        }
+
         static UdpSocket * free(UdpSocket * socket)
         {
             socket->closeConnection();
@@ -0,0 +1,129 @@
+/*
+ * Class for Unix-domain datagram sockets, for a peer on the same host
+ *
+ * Works as a UdpSocket does, but is addressed by filesystem paths rather
+ * than ports: it binds its own path to receive on and sends to its peer's.
+ * The kernel queues each datagram straight onto the receiving socket,
+ * skipping the IP, UDP and loopback-device layers, and paths can't collide
+ * the way ports 5000-5003 do when several simulators share a host.
+ *
+ * Unlike UDP, a full receive queue would block the sender, so sends never
+ * wait: a datagram the peer has no room for is dropped, as UDP would drop
+ * it.
+ *
+ * Linux and macOS only; elsewhere the socket never opens.
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include "UdpSocket.hpp"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/un.h>
+#endif
+
+class UnixDatagramSocket : public UdpSocket {
+
+    private:
+
+#ifndef _WIN32
+        struct sockaddr_un _local = {};
+        struct sockaddr_un _peer = {};
+#endif
+
+    public:
+
+        /**
+         * @param path path to receive on; a stale socket there from an
+         *        earlier run is replaced
+         * @param peerPath path of the peer's socket, to send to
+         * @param timeoutMsec receive timeout; zero to wait forever
+         */
+        UnixDatagramSocket(
+                const char * path,
+                const char * peerPath,
+                const uint32_t timeoutMsec=0)
+        {
+            _sock = INVALID_SOCKET;
+            *_message = 0;
+
+#ifdef _WIN32
+            (void)path;
+            (void)peerPath;
+            (void)timeoutMsec;
+
+            sprintf_s(_message,
+                    "Unix-domain datagram sockets are not supported on "
+                    "Windows");
+#else
+            if (strlen(path) >= sizeof(_local.sun_path) ||
+                    strlen(peerPath) >= sizeof(_peer.sun_path)) {
+                sprintf_s(_message, "socket path too long");
+                return;
+            }
+
+            _local.sun_family = AF_UNIX;
+            strcpy(_local.sun_path, path);
+
+            _peer.sun_family = AF_UNIX;
+            strcpy(_peer.sun_path, peerPath);
+
+            _sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+            if (_sock == INVALID_SOCKET) {
+                sprintf_s(_message, "socket() failed");
+                return;
+            }
+
+            unlink(path);
+
+            if (bind(_sock, (struct sockaddr *)&_local, sizeof(_local)) ==
+                    SOCKET_ERROR) {
+                snprintf(_message, sizeof(_message), "bind(%s) failed: %s",
+                        path, strerror(errno));
+                close(_sock);
+                _sock = INVALID_SOCKET;
+                return;
+            }
+
+            UdpSocket::setupTimeout(timeoutMsec);
+#endif
+        }
+
+        UnixDatagramSocket(const UnixDatagramSocket &) = delete;
+
+        UnixDatagramSocket & operator=(const UnixDatagramSocket &) = delete;
+
+        ~UnixDatagramSocket(void)
+        {
+            closeConnection();
+        }
+
+        void sendData(void * buf, size_t len)
+        {
+#ifndef _WIN32
+            sendto(_sock, buf, len, MSG_DONTWAIT,
+                    (struct sockaddr *)&_peer, sizeof(_peer));
+#endif
+        }
+
+        /**
+         * Closes the socket and removes its path.
+         */
+        void closeConnection(void)
+        {
+#ifndef _WIN32
+            if (_sock != INVALID_SOCKET) {
+                close(_sock);
+                _sock = INVALID_SOCKET;
+                unlink(_local.sun_path);
+            }
+#endif
+        }
+
+}; // class UnixDatagramSocket
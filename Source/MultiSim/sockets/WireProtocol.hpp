@@ -0,0 +1,271 @@
+/*
+ * Versioned binary framing for messages between the simulator and the
+ * flight controller
+ *
+ * Every message is a 32-byte header followed by an array of float64 or
+ * float32 values, whose meaning the header's schema gives:
+ *
+ *   offset  size  field
+ *        0     2  magic, 0x574D ("MW")
+ *        2     1  version, 1
+ *        3     1  flags: FLAG_FLOAT32, FLAG_HALT
+ *        4     1  schema: SCHEMA_TELEMETRY or SCHEMA_MOTORS
+ *        5     1  reserved, zero
+ *        6     2  vehicle id
+ *        8     4  sequence number, counting the sender's messages
+ *       12     4  sequence number of the last message received from the
+ *                 other side, i.e. the telemetry that motors answer
+ *       16     8  simulated time in seconds (float64)
+ *       24     8  sender's wall-clock time, in nanoseconds since the Unix
+ *                 epoch
+ *       32        values, as many as the message has room for
+ *
+ * All fields are little-endian.  The sequence numbers let a receiver count
+ * lost and reordered messages; the wall-clock time gives one-way latency
+ * between hosts whose clocks agree (as on the same host).
+ *
+ * Copyright (C) 2023 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+
+class WireProtocol {
+
+    public:
+
+        static const uint16_t MAGIC = 0x574D;
+
+        static const uint8_t VERSION = 1;
+
+        // Values are float32 rather than float64
+        static const uint8_t FLAG_FLOAT32 = 0x01;
+
+        // Sender is done: the simulation is over, or the controller wants
+        // it to be
+        static const uint8_t FLAG_HALT = 0x02;
+
+        typedef enum {
+
+            SCHEMA_TELEMETRY = 1, // state vector, then stick demands
+            SCHEMA_MOTORS    = 2  // one value per actuator
+
+        } schema_t;
+
+        typedef struct {
+
+            uint16_t magic;
+            uint8_t version;
+            uint8_t flags;
+            uint8_t schema;
+            uint8_t reserved;
+            uint16_t vehicle;
+            uint32_t sequence;
+            uint32_t ack;
+            double simTime;
+            uint64_t wallTime;
+
+        } header_t;
+
+        static_assert(sizeof(header_t) == 32, "header must be 32 bytes");
+
+        // Largest message decode() accepts values from
+        static const uint16_t MAX_VALUES = 64;
+
+        /**
+         * @return size in bytes of a message of count values
+         */
+        static size_t size(const uint16_t count, const bool float32)
+        {
+            return sizeof(header_t) +
+                count * (float32 ? sizeof(float) : sizeof(double));
+        }
+
+        /**
+         * @return nanoseconds since the Unix epoch
+         */
+        static uint64_t wallNow(void)
+        {
+            return (uint64_t)std::chrono::duration_cast<
+                std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+
+        /**
+         * Fills in a header's fixed fields and the time of sending.
+         */
+        static header_t header(
+                const schema_t schema,
+                const uint32_t sequence,
+                const uint32_t ack,
+                const double simTime,
+                const uint8_t flags=0,
+                const uint16_t vehicle=0)
+        {
+            header_t header = {};
+
+            header.magic = MAGIC;
+            header.version = VERSION;
+            header.flags = flags;
+            header.schema = (uint8_t)schema;
+            header.vehicle = vehicle;
+            header.sequence = sequence;
+            header.ack = ack;
+            header.simTime = simTime;
+            header.wallTime = wallNow();
+
+            return header;
+        }
+
+        /**
+         * Writes a message: the header, then the values, as float32 if the
+         * header's flags say so.
+         *
+         * @return message size in bytes, or zero if it won't fit
+         */
+        static size_t encode(
+                const header_t & header,
+                const double * values,
+                const uint16_t count,
+                void * buf,
+                const size_t bufSize)
+        {
+            const auto float32 = (header.flags & FLAG_FLOAT32) != 0;
+
+            const auto bytes = size(count, float32);
+
+            if (bytes > bufSize) {
+                return 0;
+            }
+
+            auto out = (uint8_t *)buf;
+
+            memcpy(out, &header, sizeof(header));
+
+            out += sizeof(header);
+
+            for (uint16_t k=0; k<count; ++k) {
+
+                if (float32) {
+                    const auto value = (float)values[k];
+                    memcpy(out + k * sizeof(value), &value, sizeof(value));
+                }
+                else {
+                    memcpy(out + k * sizeof(double), &values[k],
+                            sizeof(double));
+                }
+            }
+
+            return bytes;
+        }
+
+        /**
+         * Reads a message.
+         *
+         * @param buf message
+         * @param len its size in bytes
+         * @param header output
+         * @param values output, at least maxCount of them
+         * @param maxCount most values wanted
+         * @return number of values in the message, or -1 if it isn't one
+         *         of ours: wrong magic, version or size
+         */
+        static int decode(
+                const void * buf,
+                const size_t len,
+                header_t & header,
+                double * values,
+                const uint16_t maxCount)
+        {
+            if (len < sizeof(header)) {
+                return -1;
+            }
+
+            memcpy(&header, buf, sizeof(header));
+
+            if (header.magic != MAGIC || header.version != VERSION) {
+                return -1;
+            }
+
+            const auto valueSize = (header.flags & FLAG_FLOAT32) ?
+                sizeof(float) : sizeof(double);
+
+            const auto payload = len - sizeof(header);
+
+            if (payload % valueSize != 0 ||
+                    payload / valueSize > MAX_VALUES) {
+                return -1;
+            }
+
+            const auto count = (uint16_t)(payload / valueSize);
+
+            const auto in = (const uint8_t *)buf + sizeof(header);
+
+            for (uint16_t k=0; k<count && k<maxCount; ++k) {
+
+                if (valueSize == sizeof(float)) {
+                    float value = 0;
+                    memcpy(&value, in + k * sizeof(value), sizeof(value));
+                    values[k] = value;
+                }
+                else {
+                    memcpy(&values[k], in + k * sizeof(double),
+                            sizeof(double));
+                }
+            }
+
+            return count;
+        }
+
+        /**
+         * Spots lost and reordered messages from their sequence numbers.
+         */
+        class SequenceTracker {
+
+            private:
+
+                uint32_t _last = 0;
+
+                bool _started = false;
+
+            public:
+
+                /**
+                 * @param sequence sequence number of a message taken
+                 * @param skipped messages taken but deliberately passed
+                 *        over since the last one observed, e.g. as stale
+                 * @return how many messages went missing just before this
+                 *         one, or -1 if it is older than one already seen
+                 */
+                int64_t observe(const uint32_t sequence,
+                        const uint32_t skipped=0)
+                {
+                    if (!_started) {
+                        _started = true;
+                        _last = sequence;
+                        return 0;
+                    }
+
+                    // Signed difference copes with wraparound
+                    const auto gap = (int32_t)(sequence - _last);
+
+                    if (gap <= 0) {
+                        return -1;
+                    }
+
+                    _last = sequence;
+
+                    return (uint32_t)gap > 1 + skipped ?
+                        gap - 1 - skipped : 0;
+                }
+
+        }; // class SequenceTracker
+
+}; // class WireProtocol
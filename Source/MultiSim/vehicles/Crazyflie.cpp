@@ -67,7 +67,7 @@ void ACrazyflie::addArm(
 // Called when the game starts or when spawned
 void ACrazyflie::BeginPlay()
 {
-    vehicle.beginPlay(new FVehicleThread(&dynamics));
+    vehicle.beginPlay(new FVehicleThread(&dynamics, SimulationExecutor::shared()));
 
     Super::BeginPlay();
 }
@@ -38,7 +38,7 @@ AIngenuity::AIngenuity()
 // Called when the game starts or when spawned
 void AIngenuity::BeginPlay()
 {
-    vehicle.beginPlay(new FVehicleThread(&dynamics));
+    vehicle.beginPlay(new FVehicleThread(&dynamics, SimulationExecutor::shared()));
 
     Super::BeginPlay();
 }
@@ -25,7 +25,7 @@ APhantom::APhantom()
 // Called when the game starts or when spawned
 void APhantom::BeginPlay()
 {
-    vehicle.beginPlay(new FVehicleThread(&dynamics));
+    vehicle.beginPlay(new FVehicleThread(&dynamics, SimulationExecutor::shared()));
 
     Super::BeginPlay();
 }